@@ -0,0 +1,106 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_AUDIO_BLOCK_H
+#define DOSBOX_AUDIO_BLOCK_H
+
+#include <algorithm>
+#include <cassert>
+
+/*  Audio blocks
+ *  ------------
+ *  Helpers for running effects over whole blocks of non-interleaved
+ *  (planar) samples instead of one frame at a time. The loops are kept free
+ *  of branches and index masking so the compiler can vectorise them; only
+ *  the filters, being recursive, stay sample by sample, but at least each
+ *  one keeps its state in registers for the whole block.
+ */
+
+// Splits interleaved stereo frames into separate left and right blocks
+inline void deinterleave_frames(const float* frames, float* left, float* right,
+                                const int num_frames)
+{
+	assert(num_frames >= 0);
+	for (int i = 0; i < num_frames; ++i) {
+		left[i]  = frames[i * 2];
+		right[i] = frames[i * 2 + 1];
+	}
+}
+
+// The inverse of deinterleave_frames()
+inline void interleave_frames(const float* left, const float* right,
+                              float* frames, const int num_frames)
+{
+	assert(num_frames >= 0);
+	for (int i = 0; i < num_frames; ++i) {
+		frames[i * 2]     = left[i];
+		frames[i * 2 + 1] = right[i];
+	}
+}
+
+// Copies frames out of a ring buffer of interleaved stereo frames into
+// separate left and right blocks, only splitting the copy where the ring
+// wraps around
+inline void read_ring_frames(const float* ring, const int ring_frames,
+                             const int start_pos, const int num_frames,
+                             float* left, float* right)
+{
+	assert(start_pos >= 0 && start_pos < ring_frames);
+	assert(num_frames >= 0 && num_frames <= ring_frames);
+
+	const auto first = std::min(num_frames, ring_frames - start_pos);
+	deinterleave_frames(ring + start_pos * 2, left, right, first);
+	deinterleave_frames(ring, left + first, right + first, num_frames - first);
+}
+
+// The inverse of read_ring_frames()
+inline void write_ring_frames(const float* left, const float* right,
+                              float* ring, const int ring_frames,
+                              const int start_pos, const int num_frames)
+{
+	assert(start_pos >= 0 && start_pos < ring_frames);
+	assert(num_frames >= 0 && num_frames <= ring_frames);
+
+	const auto first = std::min(num_frames, ring_frames - start_pos);
+	interleave_frames(left, right, ring + start_pos * 2, first);
+	interleave_frames(left + first, right + first, ring, num_frames - first);
+}
+
+// Mixes the source block into the destination block
+inline void add_samples(float* dest, const float* src, const int num_samples)
+{
+	assert(num_samples >= 0);
+	for (int i = 0; i < num_samples; ++i) {
+		dest[i] += src[i];
+	}
+}
+
+// Runs a single-channel filter, such as one of the Iir filters, over the
+// block in place
+template <typename Filter>
+inline void filter_samples(Filter& filter, float* samples, const int num_samples)
+{
+	assert(num_samples >= 0);
+	for (int i = 0; i < num_samples; ++i) {
+		samples[i] = static_cast<float>(filter.filter(samples[i]));
+	}
+}
+
+#endif
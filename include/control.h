@@ -55,6 +55,8 @@ struct CommandLineArguments {
 	bool exit;
 	bool securemode;
 	bool noautoexec;
+	bool headless;
+	bool capture_audio;
 	std::string working_dir;
 	std::string lang;
 	std::string machine;
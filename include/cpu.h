@@ -22,6 +22,8 @@
 
 #include "dosbox.h"
 
+#include <vector>
+
 #include "support.h"
 
 #ifndef DOSBOX_REGS_H
@@ -66,6 +68,39 @@ extern Bitu CPU_AutoDetermineMode;
 
 extern ArchitectureType CPU_ArchitectureType;
 
+// The idle governor lets the host sleep until the next scheduled event or
+// input while the guest is only waiting for one
+enum class IdleDetection {
+	Off,
+	Halt,    // HLT with interrupts enabled
+	Polling, // also tight loops reading a status port
+};
+extern IdleDetection CPU_IdleDetection;
+
+struct IdleStats {
+	int64_t idle_cycles  = 0; // given up because the guest was waiting
+	int64_t total_cycles = 0; // scheduled for the elapsed ticks
+	int64_t slept_us     = 0; // host time spent sleeping
+};
+extern IdleStats CPU_IdleStats;
+
+// What the auto cycles governor measured over its last window
+struct AutoCyclesStats {
+	int32_t achieved_cycles = 0;   // run per host millisecond
+	double host_utilization = 0.0; // share of host time spent emulating
+	double ns_per_cycle     = 0.0; // smoothed host cost of a cycle
+	int64_t slept_us        = 0;   // host time slept between ticks
+	int64_t overruns        = 0;   // times emulation fell behind, in total
+	int64_t num_windows     = 0;
+};
+extern AutoCyclesStats CPU_AutoCyclesStats;
+
+// Whether the guest is waiting for the next event or input
+bool CPU_IsIdle();
+
+// Called for every byte read from an IO port, to spot polling loops
+void CPU_CheckPortPolling(uint16_t port, uint8_t value);
+
 extern Bitu CPU_PrefetchQueueSize;
 
 /* Some common Defines */
@@ -92,6 +127,50 @@ Bits CPU_Core_Prefetch_Trap_Run() noexcept;
 
 void CPU_Reset_AutoAdjust(void);
 
+// Gives a page holding dynamic code back to its original page handler
+void CPU_ReleaseCodePage(Bitu phys_page);
+
+// Execution counts of a block translated by the dynrec core
+struct DynrecBlockProfile {
+	PhysPt first_byte = 0; // physical addresses of the guest code
+	PhysPt last_byte  = 0;
+	uint32_t entries  = 0;
+	uint32_t cycles   = 0; // emulated cycles charged by the block
+	size_t host_bytes = 0; // size of the translated code
+};
+
+// Enabling or disabling retranslates all code, as the counters are part of
+// the translated blocks. Returns false if there's no dynrec core.
+bool CPU_SetDynrecBlockProfiling(bool enabled);
+bool CPU_IsDynrecBlockProfiling();
+
+// The blocks that charged the most cycles, hottest first
+std::vector<DynrecBlockProfile> CPU_GetDynrecHotBlocks(size_t max_blocks);
+
+// Counters of the dynamic core's translation cache
+struct DynamicCacheStats {
+	size_t cache_bytes      = 0;
+	uint64_t translations   = 0; // blocks translated
+	uint64_t retranslations = 0; // of code that had been translated before
+	uint64_t evicted_blocks = 0; // to make room for new blocks
+	uint64_t evicted_pages  = 0; // to make room for new code pages
+	uint64_t spared_blocks  = 0; // recently run blocks passed over by eviction
+	uint64_t wraps          = 0; // times the cache started over at its start
+	uint64_t flushes        = 0; // times all code was dropped at once
+	uint64_t dead_flag_ops  = 0; // instructions translated without flags
+	uint64_t traces         = 0; // blocks extended across hot branches
+	uint64_t trace_cuts     = 0; // traces cut short at a hot side exit
+	uint64_t warmed_blocks  = 0; // translated ahead from the persistent cache
+	int64_t translate_us    = 0; // spent translating blocks as they're reached
+};
+
+// Returns false if there's no dynamic core
+bool CPU_GetDynamicCacheStats(DynamicCacheStats &stats);
+
+// Translates code known from earlier sessions ahead of time, until the host
+// time given by deadline_us (as returned by GetTicksUs) has come
+void CPU_WarmDynamicCache(int64_t deadline_us);
+
 
 //CPU Stuff
 
@@ -0,0 +1,146 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_FREE_EXTENTS_H
+#define DOSBOX_FREE_EXTENTS_H
+
+/*  Free Extents
+ *  ------------
+ *  Keeps track of the free runs of pages in a pool, so the best fitting run
+ *  for an allocation can be found without scanning every page.
+ *
+ *  Each run is indexed twice: by its first page, to find and merge with its
+ *  neighbours when pages are released, and by its length, to find the
+ *  smallest run that fits. Among equally long runs, the lowest one wins.
+ *
+ *  Page 0 can't be part of the pool, as it's used to report that no run
+ *  fits.
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
+
+class FreeExtents {
+public:
+	// Makes [first, first + count) the only free pages
+	void Reset(const uint32_t first, const uint32_t count)
+	{
+		by_start.clear();
+		by_length.clear();
+		num_free = 0;
+		if (count) {
+			assert(first > 0);
+			Add(first, count);
+		}
+	}
+
+	// First page of the smallest free run that holds count pages, or 0
+	uint32_t FindBestFit(const uint32_t count) const
+	{
+		assert(count > 0);
+		const auto it = by_length.lower_bound({count, 0});
+		return it != by_length.end() ? it->second : 0;
+	}
+
+	// Number of free pages starting at page, up to the next used page
+	uint32_t LengthAt(const uint32_t page) const
+	{
+		const auto it = by_start.find(page);
+		return it != by_start.end() ? it->second : 0;
+	}
+
+	// Marks [first, first + count) as used; the pages must start a free run
+	void Take(const uint32_t first, const uint32_t count)
+	{
+		const auto it = by_start.find(first);
+		assert(it != by_start.end() && count > 0 && count <= it->second);
+
+		const auto length = it->second;
+		Remove(it);
+		if (count < length)
+			Add(first + count, length - count);
+	}
+
+	// Marks [first, first + count) as free, merging it with the free runs
+	// on either side
+	void Release(uint32_t first, uint32_t count)
+	{
+		assert(first > 0 && count > 0);
+
+		auto next = by_start.lower_bound(first);
+		assert(next == by_start.end() || next->first >= first + count);
+		if (next != by_start.end() && next->first == first + count) {
+			count += next->second;
+			next = Remove(next);
+		}
+		if (next != by_start.begin()) {
+			const auto prev = std::prev(next);
+			assert(prev->first + prev->second <= first);
+			if (prev->first + prev->second == first) {
+				first = prev->first;
+				count += prev->second;
+				Remove(prev);
+			}
+		}
+		Add(first, count);
+	}
+
+	uint32_t Total() const
+	{
+		return num_free;
+	}
+
+	uint32_t Largest() const
+	{
+		return by_length.empty() ? 0 : by_length.rbegin()->first;
+	}
+
+	size_t NumExtents() const
+	{
+		return by_start.size();
+	}
+
+private:
+	using start_map = std::map<uint32_t, uint32_t>;
+
+	void Add(const uint32_t first, const uint32_t count)
+	{
+		by_start.emplace(first, count);
+		by_length.emplace(count, first);
+		num_free += count;
+	}
+
+	start_map::iterator Remove(const start_map::iterator it)
+	{
+		by_length.erase({it->second, it->first});
+		num_free -= it->second;
+		return by_start.erase(it);
+	}
+
+	start_map by_start                                = {}; // first -> length
+	std::set<std::pair<uint32_t, uint32_t>> by_length = {}; // (length, first)
+	uint32_t num_free                                 = 0;
+};
+
+#endif
@@ -51,6 +51,7 @@ class PageDirectory;
 #define PFLAG_NOCODE		0x10			//No dynamic code can be generated here
 #define PFLAG_INIT			0x20			//No dynamic code can be generated here
 #define PFLAG_HASCODE16		0x40			//Page contains 16-bit dynamic code
+#define PFLAG_DEBUGWATCH	0x80			//Watched by the debugger, runs on the normal core
 #define PFLAG_HASCODE		(PFLAG_HASCODE32|PFLAG_HASCODE16)
 
 #define LINK_START	((1024+64)/4)			//Start right after the HMA
@@ -88,6 +89,12 @@ Bitu PAGING_GetDirBase();
 void PAGING_SetDirBase(Bitu cr3);
 void PAGING_InitTLB();
 void PAGING_ClearTLB();
+// Only unlinks the pages of the current address space, the links kept for
+// the others stay
+void PAGING_ClearCurrentTLB();
+// Drops the links kept for other address spaces to these physical pages,
+// for when they get a different handler
+void PAGING_ForgetPhysPages(Bitu phys_page, Bitu pages);
 
 void PAGING_LinkPage(uint32_t lin_page,uint32_t phys_page);
 void PAGING_LinkPage_ReadOnly(uint32_t lin_page,uint32_t phys_page);
@@ -336,33 +343,12 @@ static inline PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 }
 #endif
 
-extern PhysPt memReadWatch1;
-extern PhysPt memReadWatch2;
-extern bool memReadWatchHit1;
-extern bool memReadWatchHit2;
-
 /* Special inlined memory reading/writing */
 
 static inline uint8_t mem_readb_inline(PhysPt address) {
 	HostPt tlb_addr=get_tlb_read(address);
-	uint8_t result;
-	if (tlb_addr) result = host_readb(tlb_addr+address);
-	else
-		result = (get_tlb_readhandler(address))->readb(address);
-
-	bool wasHit;
-	// if (address == 0x00196C64) {
-	if (address == memReadWatch1 || address == memReadWatch2) {
-		uint16_t seg = SegValue(cs);
-		uint32_t off = reg_eip;
-		if (address == memReadWatch1) {
-			memReadWatchHit1 = true;
-		} else {
-			memReadWatchHit2 = true;
-		}
-		wasHit = true;
-	}
-	return result;
+	if (tlb_addr) return host_readb(tlb_addr+address);
+	else return (get_tlb_readhandler(address))->readb(address);
 }
 
 extern bool mouseBreakpoint;
@@ -401,28 +387,6 @@ static inline uint16_t mem_readw_inline(PhysPt address) {
 	if (address == 0x001966E4 && result == 1 && mouseBreakpoint && !mouseBreakpointHit) {
 		mouseBreakpointHit = true;
 	}
-	PhysPt xAddress = 0x00196A18;
-	bool wasHit;
-	// if (address == 0x00196C64) {
-	if (address == memReadWatch1 || address == memReadWatch2) {
-		uint16_t seg = SegValue(cs);
-		uint32_t off = reg_eip;
-
-		if (address == memReadWatch1) {
-			memReadWatchHit1 = true;
-		} else {
-			memReadWatchHit2 = true;
-		}
-
-		wasHit = true;
-	}
-	if (result == 0x805) {
-		uint16_t seg = SegValue(cs);
-		uint32_t off = reg_eip;
-
-		wasHit = true;
-	}
-
 	uint16_t seg = SegValue(cs);
 	uint32_t off = reg_eip;
 	if (GetAddress(seg, off) == memReadOverride) {
@@ -447,56 +411,27 @@ static inline uint32_t mem_readd_inline(PhysPt address)
 
 
 
-struct memwrite_entry {
-	uint16_t caller_seg;
-	uint32_t caller_off;
-	PhysPt address;
-	uint16_t size;
-	uint32_t value;
-};
-
-extern std::vector<memwrite_entry> memwrites;
-
+#if C_HEAVY_DEBUG
+// Set while the debugger wants to see guest memory writes; see
+// src/debug/memwrite_trace.h
+extern bool memwrite_trace_active;
+void MEMTRACE_LogWrite(PhysPt address, uint16_t size, uint32_t value);
 
+// Set whenever the TLB is flushed, as page mappings or handlers may have
+// changed under the debugger's memory watchpoints; see src/debug/debug_watch.h
+extern bool memwatch_stale;
+#endif
 
-static void handleWriteBreakpoint(PhysPt address, uint16_t size, uint32_t value)
+// Compiles to nothing without the heavy debugger, and to a single
+// predictable branch with it while no write tracing is active
+static inline void handleWriteBreakpoint([[maybe_unused]] PhysPt address,
+                                         [[maybe_unused]] uint16_t size,
+                                         [[maybe_unused]] uint32_t value)
 {
-	// Check if we are tracking writes at the moment
-	if (!outsideStackWriteBreakpoint) {
-		return;
-	}
-
-	// Check if we are writing outside of the stack (between SP and BP)
-	uint16_t ss_value = SegValue(ss);
-	uint32_t sp       = reg_sp;
-	uint32_t bp       = reg_bp;
-
-	uint32_t topAddress    = GetAddress(ss_value, sp);
-	uint32_t bottomAddress = GetAddress(ss_value, bp);
-
-	// Account for pushes - a push will decrease SP after the write. The most we might write is a word, so we ignore the 2 bytes below SP
-	bool isOnStack = topAddress - 2 <= address && address <= bottomAddress;
-
-	if (!isOnStack) {
-		outsideStackWriteBreakpointHit = true;
-	}
-
-	memwrite_entry entry;
-	entry.caller_seg = SegValue(cs);
-	entry.caller_off = reg_eip;
-	entry.size       = size;
-	entry.value      = value;
-	entry.address    = address;
-	memwrites.push_back(entry);
-
-
-	// TODO: Could be that some code plays around with BP, need to watch out
-	// for these cases
-	// TODO: Could also define a list of known globals
-
-	// Maybe: Check if we are in game code at the moment
-
-	// return false;
+#if C_HEAVY_DEBUG
+	if (GCC_UNLIKELY(memwrite_trace_active))
+		MEMTRACE_LogWrite(address, size, value);
+#endif
 }
 
 static inline void mem_writeb_inline(PhysPt address,uint8_t val) {
@@ -519,6 +454,7 @@ static inline void mem_writew_inline(PhysPt address,uint16_t val) {
 }
 
 static inline void mem_writed_inline(PhysPt address,uint32_t val) {
+	handleWriteBreakpoint(address, 4, val);
 	if ((address & 0xfff)<0xffd) {
 		HostPt tlb_addr=get_tlb_write(address);
 		if (tlb_addr) host_writed(tlb_addr+address,val);
@@ -73,5 +73,9 @@ void PIC_AddEvent(PIC_EventHandler handler, double delay, uint32_t val = 0);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, uint32_t val);
 
+// Milliseconds from the start of the current tick to the next scheduled
+// event, or a negative value if nothing is scheduled
+double PIC_GetNextEventIndex();
+
 void PIC_SetIRQMask(uint32_t irq, bool masked);
 #endif
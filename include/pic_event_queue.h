@@ -0,0 +1,238 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_PIC_EVENT_QUEUE_H
+#define DOSBOX_PIC_EVENT_QUEUE_H
+
+#include "pic.h"
+
+/*  PIC Event Queue
+ *  ---------------
+ *  Holds the scheduled PIC events as a binary min-heap ordered by their
+ *  index, so adding an event takes O(log n) and the next one to run is
+ *  always at the top. Events scheduled for the same index run in the order
+ *  they were added.
+ *
+ *  The events of each handler are additionally chained together, so
+ *  removing them only visits that handler's events instead of the whole
+ *  queue.
+ *
+ *  Events live in a pool that grows as needed; freed slots are reused, so
+ *  once the pool is warmed up, scheduling doesn't allocate.
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class PicEventQueue {
+public:
+	struct Event {
+		double index;
+		PIC_EventHandler handler;
+		uint32_t value;
+	};
+
+	bool IsEmpty() const
+	{
+		return heap.empty();
+	}
+
+	size_t Size() const
+	{
+		return heap.size();
+	}
+
+	// The event that's due first
+	const Event& Next() const
+	{
+		assert(!heap.empty());
+		return slots[heap.front()].event;
+	}
+
+	Event Pop()
+	{
+		assert(!heap.empty());
+		const auto event = slots[heap.front()].event;
+		Free(heap.front());
+		return event;
+	}
+
+	void Add(const double index, const PIC_EventHandler handler,
+	         const uint32_t value)
+	{
+		uint32_t id = 0;
+		if (free_ids.empty()) {
+			id = static_cast<uint32_t>(slots.size());
+			slots.emplace_back();
+		} else {
+			id = free_ids.back();
+			free_ids.pop_back();
+		}
+		auto& slot    = slots[id];
+		slot.event    = {index, handler, value};
+		slot.sequence = next_sequence++;
+
+		// Chain it to the front of the handler's events
+		auto& head = handler_heads.try_emplace(handler, none).first->second;
+		slot.prev  = none;
+		slot.next  = head;
+		if (head != none)
+			slots[head].prev = id;
+		head = id;
+
+		slot.heap_pos = static_cast<uint32_t>(heap.size());
+		heap.push_back(id);
+		SiftUp(slot.heap_pos);
+	}
+
+	void RemoveAll(const PIC_EventHandler handler)
+	{
+		const auto it = handler_heads.find(handler);
+		if (it == handler_heads.end())
+			return;
+		while (it->second != none)
+			Free(it->second);
+	}
+
+	void RemoveSpecific(const PIC_EventHandler handler, const uint32_t value)
+	{
+		const auto it = handler_heads.find(handler);
+		if (it == handler_heads.end())
+			return;
+		auto id = it->second;
+		while (id != none) {
+			const auto next = slots[id].next;
+			if (slots[id].event.value == value)
+				Free(id);
+			id = next;
+		}
+	}
+
+	// Moves every event closer by the given amount, which keeps their order
+	void Advance(const double amount)
+	{
+		for (const auto id : heap)
+			slots[id].event.index -= amount;
+	}
+
+	void Clear()
+	{
+		slots.clear();
+		heap.clear();
+		free_ids.clear();
+		handler_heads.clear();
+	}
+
+private:
+	static constexpr uint32_t none = UINT32_MAX;
+
+	struct Slot {
+		Event event       = {};
+		uint64_t sequence = 0;
+		uint32_t heap_pos = none;
+		uint32_t prev     = none; // within the handler's events
+		uint32_t next     = none;
+	};
+
+	bool IsBefore(const uint32_t a, const uint32_t b) const
+	{
+		const auto& slot_a = slots[a];
+		const auto& slot_b = slots[b];
+		if (slot_a.event.index != slot_b.event.index)
+			return slot_a.event.index < slot_b.event.index;
+		return slot_a.sequence < slot_b.sequence;
+	}
+
+	void Place(const uint32_t pos, const uint32_t id)
+	{
+		heap[pos]          = id;
+		slots[id].heap_pos = pos;
+	}
+
+	void SiftUp(uint32_t pos)
+	{
+		const auto id = heap[pos];
+		while (pos > 0) {
+			const auto parent = (pos - 1) / 2;
+			if (!IsBefore(id, heap[parent]))
+				break;
+			Place(pos, heap[parent]);
+			pos = parent;
+		}
+		Place(pos, id);
+	}
+
+	void SiftDown(uint32_t pos)
+	{
+		const auto id   = heap[pos];
+		const auto size = static_cast<uint32_t>(heap.size());
+		while (true) {
+			auto child = 2 * pos + 1;
+			if (child >= size)
+				break;
+			if (child + 1 < size && IsBefore(heap[child + 1], heap[child]))
+				++child;
+			if (!IsBefore(heap[child], id))
+				break;
+			Place(pos, heap[child]);
+			pos = child;
+		}
+		Place(pos, id);
+	}
+
+	// Takes the event out of the heap and its handler's chain
+	void Free(const uint32_t id)
+	{
+		auto& slot = slots[id];
+
+		const auto pos  = slot.heap_pos;
+		const auto last = heap.back();
+		heap.pop_back();
+		if (last != id) {
+			Place(pos, last);
+			if (pos > 0 && IsBefore(last, heap[(pos - 1) / 2]))
+				SiftUp(pos);
+			else
+				SiftDown(pos);
+		}
+
+		if (slot.prev != none)
+			slots[slot.prev].next = slot.next;
+		else
+			handler_heads[slot.event.handler] = slot.next;
+		if (slot.next != none)
+			slots[slot.next].prev = slot.prev;
+
+		slot.heap_pos = none;
+		free_ids.push_back(id);
+	}
+
+	std::vector<Slot> slots        = {};
+	std::vector<uint32_t> heap     = {}; // slot ids
+	std::vector<uint32_t> free_ids = {};
+	uint64_t next_sequence         = 0;
+
+	// First of each handler's events
+	std::unordered_map<PIC_EventHandler, uint32_t> handler_heads = {};
+};
+
+#endif
@@ -95,6 +95,7 @@ struct SDL_Block {
 	bool updating        = false;
 	bool resizing_window = false;
 	bool wait_on_error = false;
+	bool headless      = false; // no window or audio device, nothing is drawn
 
 	RenderingBackend rendering_backend      = RenderingBackend::Texture;
 	RenderingBackend want_rendering_backend = RenderingBackend::Texture;
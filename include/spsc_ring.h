@@ -0,0 +1,171 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SPSC_RING_H
+#define DOSBOX_SPSC_RING_H
+
+#include "dosbox.h"
+
+/*  SPSC (Single-Producer/Single-Consumer) Ring
+ *  -------------------------------------------
+ *  A fixed-size lock-free ring buffer for handing items from exactly one
+ *  producer thread to exactly one consumer thread.
+ *
+ *  Unlike the RWQueue, neither side ever blocks: pushing into a full ring or
+ *  popping from an empty one simply reports that nothing was transferred, and
+ *  it's up to the caller to decide whether to drop, retry, or yield. This
+ *  makes it suitable for hot paths such as the emulation loop, where taking a
+ *  mutex per item is too expensive.
+ *
+ *  The capacity is rounded up to the next power of two so indices can be
+ *  wrapped with a mask. Items must be trivially copyable.
+ */
+
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+template <typename T>
+class SpscRing {
+	static_assert(std::is_trivially_copyable_v<T>,
+	              "SpscRing items are copied with memcpy");
+
+public:
+	SpscRing()                             = delete;
+	SpscRing(const SpscRing<T>& other)     = delete;
+	SpscRing<T>& operator=(const SpscRing<T>& other) = delete;
+
+	explicit SpscRing(const size_t min_capacity)
+	{
+		assert(min_capacity > 0);
+		size_t capacity = 1;
+		while (capacity < min_capacity)
+			capacity <<= 1;
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+
+	size_t Capacity() const noexcept
+	{
+		return mask + 1;
+	}
+
+	// Safe to call from either side; the result is only a snapshot
+	size_t Size() const noexcept
+	{
+		const auto head = write_index.load(std::memory_order_acquire);
+		const auto tail = read_index.load(std::memory_order_acquire);
+		return head - tail;
+	}
+
+	bool IsEmpty() const noexcept
+	{
+		return Size() == 0;
+	}
+
+	// Producer side. Returns false if the ring is full.
+	bool TryPush(const T& item) noexcept
+	{
+		const auto head = write_index.load(std::memory_order_relaxed);
+		if (head - cached_read_index > mask) {
+			cached_read_index = read_index.load(std::memory_order_acquire);
+			if (head - cached_read_index > mask)
+				return false;
+		}
+		slots[head & mask] = item;
+		write_index.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Producer side. Pushes as many of the items as fit and returns how
+	// many were pushed.
+	size_t TryPushBulk(const T* items, const size_t num_items) noexcept
+	{
+		const auto head = write_index.load(std::memory_order_relaxed);
+		cached_read_index = read_index.load(std::memory_order_acquire);
+		const auto num_free = Capacity() - (head - cached_read_index);
+		const auto n        = num_items < num_free ? num_items : num_free;
+
+		CopyWrapped(head, items, n);
+		write_index.store(head + n, std::memory_order_release);
+		return n;
+	}
+
+	// Consumer side. Returns false if the ring is empty.
+	bool TryPop(T& item) noexcept
+	{
+		const auto tail = read_index.load(std::memory_order_relaxed);
+		if (tail == cached_write_index) {
+			cached_write_index = write_index.load(std::memory_order_acquire);
+			if (tail == cached_write_index)
+				return false;
+		}
+		item = slots[tail & mask];
+		read_index.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side. Pops up to max_items into the given array and returns
+	// how many were popped.
+	size_t PopBulk(T* into, const size_t max_items) noexcept
+	{
+		const auto tail = read_index.load(std::memory_order_relaxed);
+		cached_write_index = write_index.load(std::memory_order_acquire);
+		const auto num_used = cached_write_index - tail;
+		const auto n        = max_items < num_used ? max_items : num_used;
+
+		const auto first = tail & mask;
+		const auto run   = n < Capacity() - first ? n : Capacity() - first;
+		if (run)
+			std::memcpy(into, &slots[first], run * sizeof(T));
+		if (n > run)
+			std::memcpy(into + run, &slots[0], (n - run) * sizeof(T));
+
+		read_index.store(tail + n, std::memory_order_release);
+		return n;
+	}
+
+private:
+	void CopyWrapped(const size_t head, const T* items, const size_t n) noexcept
+	{
+		const auto first = head & mask;
+		const auto run   = n < Capacity() - first ? n : Capacity() - first;
+		if (run)
+			std::memcpy(&slots[first], items, run * sizeof(T));
+		if (n > run)
+			std::memcpy(&slots[0], items + run, (n - run) * sizeof(T));
+	}
+
+	std::vector<T> slots = {};
+	size_t mask          = 0;
+
+	// Indices increase monotonically and are only masked when accessing
+	// the slots, so head - tail is always the number of queued items. Each
+	// side keeps a private copy of the other's index to avoid touching the
+	// shared cache line on every call.
+	alignas(64) std::atomic<size_t> write_index = 0;
+	size_t cached_read_index                    = 0;
+	alignas(64) std::atomic<size_t> read_index  = 0;
+	size_t cached_write_index                   = 0;
+};
+
+#endif
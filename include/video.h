@@ -294,6 +294,10 @@ constexpr uint8_t GFX_CAN_RANDOM = 1 << 6; // interface can also do random acces
 // - false means event loop wants to quit.
 bool GFX_Events();
 
+// Sleeps until there's an event for GFX_Events to handle, or until the
+// timeout passes
+void GFX_WaitForEvents(int timeout_ms);
+
 // Let the presentation layer safely call no-op functions.
 // Useful during output initialization or transitions.
 void GFX_DisengageRendering();
@@ -352,6 +352,41 @@ FILE* CAPTURE_CreateFile(const CaptureType type,
 	return handle;
 }
 
+void CAPTURE_StartAudioCapture()
+{
+	switch (capture.state.audio) {
+	case CaptureState::Off:
+		// Capturing the audio output will start in the next few
+		// milliseconds when CAPTURE_AddAudioData is called
+		capture.state.audio = CaptureState::Pending;
+		break;
+	case CaptureState::Pending:
+	case CaptureState::InProgress:
+		LOG_WARNING("CAPTURE: Already capturing audio output");
+		break;
+	}
+}
+
+void CAPTURE_StopAudioCapture()
+{
+	switch (capture.state.audio) {
+	case CaptureState::Off:
+		LOG_WARNING("CAPTURE: Not capturing audio output");
+		break;
+	case CaptureState::Pending:
+		// It's practically impossible to hit this branch; handling it
+		// for completeness only
+		capture.state.audio = CaptureState::Off;
+		LOG_MSG("CAPTURE: Cancelled pending audio output capture");
+		break;
+	case CaptureState::InProgress:
+		capture_audio_finalise();
+		capture.state.audio = CaptureState::Off;
+		LOG_MSG("CAPTURE: Stopped capturing audio output");
+		break;
+	}
+}
+
 void CAPTURE_StartVideoCapture()
 {
 	switch (capture.state.video) {
@@ -449,23 +484,10 @@ static void handle_capture_audio_event(bool pressed)
 		return;
 	}
 
-	switch (capture.state.audio) {
-	case CaptureState::Off:
-		// Capturing the audio output will start in the next few
-		// milliseconds when CAPTURE_AddAudioData is called
-		capture.state.audio = CaptureState::Pending;
-		break;
-	case CaptureState::Pending:
-		// It's practically impossible to hit this branch; handling it
-		// for completeness only
-		capture.state.audio = CaptureState::Off;
-		LOG_MSG("CAPTURE: Cancelled pending audio output capture");
-		break;
-	case CaptureState::InProgress:
-		capture_audio_finalise();
-		capture.state.audio = CaptureState::Off;
-		LOG_MSG("CAPTURE: Stopped capturing audio output");
-		break;
+	if (capture.state.audio != CaptureState::Off) {
+		CAPTURE_StopAudioCapture();
+	} else {
+		CAPTURE_StartAudioCapture();
 	}
 }
 
@@ -601,6 +623,12 @@ static void capture_init(Section* sec)
 
 	image_capturer = std::make_unique<ImageCapturer>(prefs);
 
+	// Batch runs record everything the mixer renders from the very start
+	if (control->arguments.capture_audio &&
+	    capture.state.audio == CaptureState::Off) {
+		CAPTURE_StartAudioCapture();
+	}
+
 	constexpr auto changeable_at_runtime = true;
 	sec->AddDestroyFunction(&capture_destroy, changeable_at_runtime);
 }
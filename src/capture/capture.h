@@ -66,6 +66,9 @@ void CAPTURE_AddAudioData(const uint32_t sample_rate, const uint32_t num_sample_
 
 void CAPTURE_AddMidiData(const bool sysex, const size_t len, const uint8_t* data);
 
+void CAPTURE_StartAudioCapture();
+void CAPTURE_StopAudioCapture();
+
 void CAPTURE_StartVideoCapture();
 void CAPTURE_StopVideoCapture();
 
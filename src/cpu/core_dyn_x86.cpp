@@ -157,6 +157,7 @@ static struct {
 
 #define dyn_return(a,b) gen_return(a)
 #include "dyn_cache.h"
+#include "dyn_cache_persistent.h"
 
 static struct {
 	Bitu callback;
@@ -324,6 +325,10 @@ Bits CPU_Core_Dyn_X86_Run() noexcept
 	/* Determine the linear address of CS:EIP */
 restart_core:
 	PhysPt ip_point=SegPhys(cs)+reg_eip;
+	// translating needs a few spare blocks, so start afresh if the cache
+	// got split up into too many
+	if (GCC_UNLIKELY(cache_free_blocks < cache_min_free_blocks))
+		cache_flush();
 #if C_DEBUG
 #if C_HEAVY_DEBUG
 		if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
@@ -341,7 +346,9 @@ restart_core:
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
 		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			const auto start_us = GetTicksUs();
 			block=CreateCacheBlock(chandler,ip_point,32);
+			cache_stats.translate_us += GetTicksUs() - start_us;
 		} else {
 			int32_t old_cycles=CPU_Cycles;
 			CPU_Cycles=1;
@@ -506,19 +513,40 @@ void CPU_Core_Dyn_X86_Init(void) {
 #	endif
 }
 
+void CPU_Core_Dyn_X86_Cache_SetSize(const size_t size) {
+	cache_set_size(size);
+}
+
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
 	/* Initialize code cache and dynamic blocks */
 	cache_init(enable_cache);
 }
 
+void CPU_Core_Dyn_X86_Cache_LoadPersistent(const std::string& filename) {
+	persistent_cache_load(filename);
+}
+
+void CPU_Core_Dyn_X86_Cache_Warm(const int64_t deadline_us) {
+	persistent_cache_warm(deadline_us);
+}
+
 void CPU_Core_Dyn_X86_Cache_Close(void) {
+	persistent_cache_save();
 	cache_close();
 }
 
+void CPU_Core_Dyn_X86_Cache_ReleasePage(Bitu phys_page) {
+	cache_release_page(phys_page);
+}
+
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu) {
 #if defined(X86_DYNFPU_DH_ENABLED)
 	dyn_dh_fpu.dh_fpu_enabled=dh_fpu;
 #endif
 }
 
+DynamicCacheStats CPU_Core_Dyn_X86_GetCacheStats() {
+	return cache_get_stats();
+}
+
 #endif
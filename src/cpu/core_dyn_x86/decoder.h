@@ -82,7 +82,10 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
 			}
 		}
 		if (handler->flags & PFLAG_NOCODE) {
-			LOG_MSG("DYNX86:Can't run code in this page!");
+			// debugger watches are expected to fall back to the
+			// normal core, and are entered far too often to log
+			if (!(handler->flags & PFLAG_DEBUGWATCH))
+				LOG_MSG("DYNX86:Can't run code in this page!");
 			cph = nullptr;
 			return false;
 		}
@@ -96,6 +99,7 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
 	}
 	/* Find a free CodePage */
 	if (!cache.free_pages && cache.used_pages) {
+		++cache_stats.evicted_pages;
 		if (cache.used_pages != decode.page.code)
 			cache.used_pages->ClearRelease();
 		else {
@@ -120,6 +124,7 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
 	if (!cache.used_pages) cache.used_pages=cpagehandler;
 	cpagehandler->SetupAt(phys_page,handler);
 	MEM_SetPageHandler(phys_page,1,cpagehandler);
+	persistent_cache_add_page(cpagehandler,phys_page,lin_page);
 	PAGING_UnlinkPages(lin_page,1);
 	cph=cpagehandler;
 	return false;
@@ -2195,6 +2200,8 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=decode.page.index;
 	codepage->AddCacheBlock(decode.block);
+	cache_count_translation(static_cast<PhysPt>(
+	        (codepage->GetPhysPage() << 12) + decode.page.index));
 
 	auto cache_addr = static_cast<void *>(
 	        const_cast<uint8_t *>(decode.block->cache.start));
@@ -2207,6 +2214,8 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 	}
 	gen_reinit();
 	gen_save_host_direct(&cache.block.running,(Bitu)decode.block);
+	// keeps the block from being evicted for another round
+	gen_save_host_direct(&decode.block->cache.used,1);
 	/* Start with the cycles check */
 	gen_protectflags();
 	gen_dop_word(DOP_TEST,true,DREG(CYCLES),DREG(CYCLES));
@@ -2219,6 +2228,8 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 	bool fpu_used=false;
 #endif
 	while (max_opcodes--) {
+		if (GCC_UNLIKELY(persistent_cache_stop_decoding(decode.page.index)))
+			break;
 /* Init prefixes */
 		decode.big_addr=cpu.code.big;
 		decode.big_op=cpu.code.big;
@@ -2920,5 +2931,6 @@ finish_block:
 	assert(decode.block->cache.size <= cache_bytes);
 	//	LOG_MSG("Created block size %d start %d end
 	//%d",decode.block->cache.size,decode.block->page.start,decode.block->page.end);
+	persistent_cache_add_block(decode.block);
 	return decode.block;
 }
@@ -20,6 +20,7 @@
 
 #if (C_DYNREC)
 
+#include <algorithm>
 #include <cassert>
 #include <cstdarg>
 #include <cstddef>
@@ -27,6 +28,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <type_traits>
+#include <unordered_map>
 
 #if defined (WIN32)
 // clang-format off
@@ -63,6 +65,18 @@
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
 
+// a block whose conditional exit branch is taken this often is checked for
+// being translated again, continuing at the branch target, and so is a trace
+// whose side exit was taken this often (see dyn_branched_exit)
+#define DYN_TRACE_THRESHOLD		(64)
+// share of the runs in percent a followed branch has to be taken in
+#define DYN_TRACE_MIN_TAKEN		(90)
+#define DYN_TRACE_MAX_BRANCHES	(4)
+// most bytes of skipped code between the branch and its target
+#define DYN_TRACE_MAX_GAP		(256)
+// most block starts to remember the followed branches of
+#define DYN_TRACE_MAX_BLOCKS	(64*1024)
+
 
 //#define DYN_LOG 1 //Turn Logging on.
 
@@ -114,7 +128,9 @@ enum BlockReturn {
 #endif
 	BR_Iret,
 	BR_CallBack,
-	BR_SMCBlock
+	BR_SMCBlock,
+	BR_Trace,
+	BR_TraceExit
 };
 
 // identificator to signal self-modification of the currently executed block
@@ -134,6 +150,9 @@ struct core_dynrec_t {
 
 static core_dynrec_t core_dynrec;
 
+// translate blocks with entry and cycle counters, see CacheBlock::profile
+static bool block_profiling = false;
+
 // core_dynrec is often being used this way:
 //
 //   function_expecting_int16_ptr((uint16_t*)(&core_dynrec.readdata));
@@ -150,6 +169,7 @@ static_assert(offsetof(core_dynrec_t, readdata) % sizeof(uint32_t) == 0,
               "core_dynrec.readdata must be double-word aligned");
 
 #include "dyn_cache.h"
+#include "dyn_cache_persistent.h"
 
 #define X86			0x01
 #define X86_64		0x02
@@ -233,6 +253,10 @@ Bits CPU_Core_Dynrec_Run() noexcept
 	for (;;) {
 		// Determine the linear address of CS:EIP
 		PhysPt ip_point=SegPhys(cs)+reg_eip;
+		// translating needs a few spare blocks, so start afresh if the
+		// cache got split up into too many
+		if (GCC_UNLIKELY(cache_free_blocks < cache_min_free_blocks))
+			cache_flush();
 #if C_HEAVY_DEBUG
 		if (DEBUG_HeavyIsBreakpoint())
 			return debugCallback;
@@ -256,7 +280,9 @@ Bits CPU_Core_Dynrec_Run() noexcept
 			// unless the instruction is known to be modified
 			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
 				// translate up to 32 instructions
+				const auto start_us = GetTicksUs();
 				block=CreateCacheBlock(chandler,ip_point,32);
+				cache_stats.translate_us += GetTicksUs() - start_us;
 			} else {
 				// let the normal core handle this instruction to avoid zero-sized blocks
 				Bitu old_cycles=CPU_Cycles;
@@ -346,6 +372,19 @@ run_block:
 			if (block) goto run_block;
 			break;
 
+		case BR_Trace:
+			// the conditional branch at the end of the block is taken
+			// a lot, so the block gets translated again to continue at
+			// its target the next time it's run
+			dyn_trace_block(cache.block.running);
+			break;
+
+		case BR_TraceExit:
+			// a side exit of a trace is taken a lot, so the trace may
+			// get cut short before the branch it leaves at
+			dyn_trace_side_exit(cache.block.running);
+			break;
+
 		default:
 			E_Exit("Invalid return code %d", ret);
 		}
@@ -376,13 +415,81 @@ Bits CPU_Core_Dynrec_Trap_Run() noexcept
 void CPU_Core_Dynrec_Init(void) {
 }
 
+void CPU_Core_Dynrec_Cache_SetSize(const size_t size) {
+	cache_set_size(size);
+}
+
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
 }
 
+void CPU_Core_Dynrec_Cache_LoadPersistent(const std::string& filename) {
+	persistent_cache_load(filename);
+}
+
+void CPU_Core_Dynrec_Cache_Warm(const int64_t deadline_us) {
+	persistent_cache_warm(deadline_us);
+}
+
 void CPU_Core_Dynrec_Cache_Close(void) {
+	persistent_cache_save();
 	cache_close();
+	trace_branches.clear();
+}
+
+void CPU_Core_Dynrec_Cache_ReleasePage(Bitu phys_page) {
+	cache_release_page(phys_page);
+}
+
+void CPU_Core_Dynrec_SetBlockProfiling(const bool enabled) {
+	if (enabled == block_profiling)
+		return;
+	block_profiling = enabled;
+	cache_release_all();
+}
+
+bool CPU_Core_Dynrec_IsBlockProfiling() {
+	return block_profiling;
+}
+
+std::vector<DynrecBlockProfile> CPU_Core_Dynrec_GetHotBlocks(const size_t max_blocks) {
+	std::vector<DynrecBlockProfile> blocks = {};
+	for (const auto& block : cache_blocks) {
+		// free blocks and the page-crossing parts of blocks have no
+		// counts of their own
+		if (!block.page.handler || !block.profile.entries)
+			continue;
+		const PhysPt page_base = static_cast<PhysPt>(block.page.handler->GetPhysPage() << 12);
+
+		DynrecBlockProfile profile = {};
+		profile.first_byte = page_base + block.page.start;
+		profile.last_byte  = page_base + block.page.end;
+		if (block.crossblock)
+			profile.last_byte = static_cast<PhysPt>(
+			        (block.crossblock->page.handler->GetPhysPage() << 12) +
+			        block.crossblock->page.end);
+		profile.entries    = block.profile.entries;
+		profile.cycles     = block.profile.cycles;
+		profile.host_bytes = block.cache.size;
+		blocks.push_back(profile);
+	}
+
+	const auto hotter = [](const DynrecBlockProfile& a, const DynrecBlockProfile& b) {
+		return a.cycles > b.cycles;
+	};
+	if (blocks.size() > max_blocks) {
+		std::partial_sort(blocks.begin(), blocks.begin() + max_blocks,
+		                  blocks.end(), hotter);
+		blocks.resize(max_blocks);
+	} else {
+		std::sort(blocks.begin(), blocks.end(), hotter);
+	}
+	return blocks;
+}
+
+DynamicCacheStats CPU_Core_Dynrec_GetCacheStats() {
+	return cache_get_stats();
 }
 
 #endif
@@ -42,6 +42,19 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=(uint16_t)decode.page.index;
 	codepage->AddCacheBlock(decode.block);
+	cache_count_translation(static_cast<PhysPt>(
+	        (codepage->GetPhysPage() << 12) + decode.page.index));
+
+	// blocks can only be traced when translated right before they run, as
+	// following branches needs the current instruction pointer
+	const auto trace = trace_branches.find(dyn_block_phys_start(decode.block));
+	decode.trace.depth=(trace!=trace_branches.end()) ? trace->second : 0;
+	decode.trace.follow=decode.trace.depth;
+	decode.trace.ip_known=(start==SegPhys(cs)+reg_eip);
+	decode.trace.ip=reg_eip;
+	decode.block->trace.countdown=DYN_TRACE_THRESHOLD;
+	decode.block->trace.not_taken=0;
+	decode.block->trace.entries=0;
 
 	auto cache_addr = static_cast<void *>(
 	        const_cast<uint8_t *>(decode.block->cache.start));
@@ -54,6 +67,8 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	// every codeblock that is run sets cache.block.running to itself
 	// so the block linking knows the last executed block
 	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
+	// keeps the block from being evicted for another round
+	gen_mov_direct_ptr(&decode.block->cache.used,1);
 
 	// start with the cycles check
 	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
@@ -61,8 +76,19 @@ static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start, Bit
 	save_info_dynrec[used_save_info_dynrec].type=cycle_check;
 	used_save_info_dynrec++;
 
+	// count the entries only once the block really runs, as it's entered
+	// again after running out of cycles
+	decode.block->profile = {};
+	if (block_profiling)
+		gen_add_direct_word(&decode.block->profile.entries,1,true);
+	// traces count their runs, to tell when a side exit is taken too often
+	if (decode.trace.depth && decode.trace.ip_known)
+		gen_add_direct_word(&decode.block->trace.entries,1,true);
+
 	decode.cycles=0;
 	while (max_opcodes--) {
+		if (GCC_UNLIKELY(persistent_cache_stop_decoding(decode.page.index)))
+			break;
 		// Init prefixes
 		decode.big_addr=cpu.code.big;
 		decode.big_op=cpu.code.big;
@@ -199,8 +225,8 @@ restart_prefix:
 				// short conditional jumps
 				case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:	
 				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:	
-					dyn_branched_exit((BranchTypes)(dual_code&0xf),
-						decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw());
+					if (dyn_branched_exit((BranchTypes)(dual_code&0xf),
+						decode.big_op ? (int32_t)decode_fetchd() : (int16_t)decode_fetchw())) break;
 					goto finish_block;
 
 				// conditional byte set instructions
@@ -302,7 +328,7 @@ restart_prefix:
 		// short conditional jumps
 		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:	
 		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:	
-			dyn_branched_exit((BranchTypes)(opcode&0xf),(int8_t)decode_fetchb());	
+			if (dyn_branched_exit((BranchTypes)(opcode&0xf),(int8_t)decode_fetchb())) break;
 			goto finish_block;
 
 		// 'op []/reg8,imm8'
@@ -626,5 +652,6 @@ finish_block:
 	assert(decode.block->cache.size <= cache_bytes);
 	//	LOG_MSG("Created block size %d start %d end
 	//%d",decode.block->cache.size,decode.block->page.start,decode.block->page.end);
+	persistent_cache_add_block(decode.block);
 	return decode.block;
 }
@@ -114,8 +114,97 @@ static struct DynDecode {
 		uint_fast8_t rm;
 		uint_fast8_t reg;
 	} modrm;
+
+	// taken conditional branches the block is translated across
+	struct {
+		Bitu follow;	// branches still to be followed
+		Bitu depth;		// branches to be followed in total
+		bool ip_known;	// whether ip holds the eip at code_start
+		uint32_t ip;
+	} trace;
 } decode;
 
+// number of taken branches to follow by the blocks starting at a physical
+// address, for the blocks whose exits turned out to be hot
+static std::unordered_map<PhysPt, uint8_t> trace_branches;
+
+static PhysPt dyn_block_phys_start(const CacheBlock* block) {
+	return static_cast<PhysPt>((block->page.handler->GetPhysPage() << 12) +
+	                           block->page.start);
+}
+
+// whether a branch was taken in enough of the runs to be followed
+static bool dyn_trace_mostly_taken(uint32_t taken, uint32_t runs) {
+	return static_cast<uint64_t>(taken) * 100 >=
+	       static_cast<uint64_t>(runs) * DYN_TRACE_MIN_TAKEN;
+}
+
+// a block that ran into its trace threshold is dropped, so it's translated
+// again following one more taken branch, if the branch was taken nearly
+// every time; otherwise it's checked again after another round
+static void dyn_trace_block(CacheBlock* block) {
+	if (!block || !block->page.handler) return;
+	const uint32_t not_taken=block->trace.not_taken;
+	if (!dyn_trace_mostly_taken(DYN_TRACE_THRESHOLD,
+	                            DYN_TRACE_THRESHOLD+not_taken)) {
+		block->trace.countdown=DYN_TRACE_THRESHOLD;
+		block->trace.not_taken=0;
+		return;
+	}
+	const auto start = dyn_block_phys_start(block);
+	// start over once too many blocks were traced, the blocks already
+	// translated keep their traces
+	if (trace_branches.size() >= DYN_TRACE_MAX_BLOCKS &&
+	    !trace_branches.count(start))
+		trace_branches.clear();
+	auto& branches = trace_branches[start];
+	if (branches < DYN_TRACE_MAX_BRANCHES) ++branches;
+	block->Clear();
+	++cache_stats.traces;
+}
+
+// a trace that is left through one of its side exits too often is dropped,
+// so it's translated again ending at the branch of that exit
+static void dyn_trace_side_exit(CacheBlock* side_exit) {
+	CacheBlock* block=side_exit ? side_exit->trace.owner : nullptr;
+	if (!block || !block->page.handler) return;
+	const uint32_t runs=block->trace.entries-side_exit->trace.entries;
+	side_exit->trace.entries=block->trace.entries;
+	side_exit->trace.countdown=DYN_TRACE_THRESHOLD;
+	if (runs>=DYN_TRACE_THRESHOLD &&
+	    dyn_trace_mostly_taken(runs-DYN_TRACE_THRESHOLD,runs))
+		return;
+
+	const auto start = dyn_block_phys_start(block);
+	if (side_exit->trace.branch) trace_branches[start]=side_exit->trace.branch;
+	else trace_branches.erase(start);
+	// also drops the side exits
+	block->Clear();
+	++cache_stats.trace_cuts;
+}
+
+// the block holding the link of a side exit the trace being translated
+// leaves through when a followed branch isn't taken
+static CacheBlock* dyn_new_side_exit() {
+	CacheBlock* side_exit=cache_getblock();
+	side_exit->page.handler=nullptr;
+	side_exit->hash.index=0;
+	side_exit->crossblock=nullptr;
+	for (auto& link : side_exit->link) {
+		link.next=nullptr;
+		link.from=nullptr;
+	}
+	side_exit->link[0].to=&link_blocks[0];
+	side_exit->link[1].to=&link_blocks[1];
+	side_exit->trace={};
+	side_exit->trace.countdown=DYN_TRACE_THRESHOLD;
+	side_exit->trace.branch=static_cast<uint32_t>(decode.trace.depth-decode.trace.follow);
+	side_exit->trace.owner=decode.block;
+	side_exit->trace.side_exits=decode.block->trace.side_exits;
+	decode.block->trace.side_exits=side_exit;
+	return side_exit;
+}
+
 static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
 {
 	uint8_t rdval;
@@ -148,7 +237,10 @@ static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
 			}
 		}
 		if (handler->flags & PFLAG_NOCODE) {
-			LOG_MSG("DYNREC:Can't run code in this page");
+			// debugger watches are expected to fall back to the
+			// normal core, and are entered far too often to log
+			if (!(handler->flags & PFLAG_DEBUGWATCH))
+				LOG_MSG("DYNREC:Can't run code in this page");
 			cph = nullptr;
 			return false;
 		}
@@ -163,6 +255,7 @@ static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
 	}
 	// find a free CodePage
 	if (!cache.free_pages) {
+		++cache_stats.evicted_pages;
 		if (cache.used_pages!=decode.page.code) cache.used_pages->ClearRelease();
 		else {
 			// try another page to avoid clearing our source-crosspage
@@ -187,6 +280,7 @@ static bool MakeCodePage(Bitu lin_addr, CodePageHandler *&cph)
 	// initialize the code page handler and add the handler to the memory page
 	cpagehandler->SetupAt(phys_page,handler);
 	MEM_SetPageHandler(phys_page,1,cpagehandler);
+	persistent_cache_add_page(cpagehandler,phys_page,lin_page);
 	PAGING_UnlinkPages(lin_page,1);
 	cph=cpagehandler;
 	return false;
@@ -432,6 +526,8 @@ static void dyn_reduce_cycles(void) {
 		++decode.cycles;
 	}
 	gen_sub_direct_word(&CPU_Cycles,decode.cycles,true);
+	if (block_profiling)
+		gen_add_direct_word(&decode.block->profile.cycles,decode.cycles,true);
 }
 
 
@@ -1148,71 +1244,111 @@ static void gen_restore_reg(HostReg reg,HostReg dest_reg) {
 // they try to find out if a function can be replaced by another
 // one that does not generate any flags at all
 
+// Every queued instruction generates condition flags that nothing has read
+// yet. live_flags holds the flags it's still the last writer of; once later
+// instructions have overwritten all of them, none of its flags can ever be
+// read and it's replaced by its simpler variant. Instructions that read
+// flags take the instructions that generated them off the queue for good.
+// Flags still live at the end of the block are kept, as the next block or
+// an exception might read them.
+
 static Bitu mf_functions_num=0;
 static struct {
 	const uint8_t* pos;
 	void* fct_ptr;
 	Bitu ftype;
+	Bitu live_flags;
 } mf_functions[64];
 
 static void InitFlagsOptimization(void) {
 	mf_functions_num=0;
 }
 
-// replace all queued functions with their simpler variants
-// because the current instruction destroys all condition flags and
-// the flags are not required before
-static void InvalidateFlags(void) {
+// the current instruction always overwrites the flags in flags_mask, so
+// queued instructions no longer provide them
+static void KillFlags([[maybe_unused]] Bitu flags_mask) {
 #ifdef DRC_FLAGS_INVALIDATION
+	Bitu kept=0;
 	for (Bitu ct=0; ct<mf_functions_num; ct++) {
-		gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
+		mf_functions[ct].live_flags&=~flags_mask;
+		if (mf_functions[ct].live_flags) {
+			mf_functions[kept++]=mf_functions[ct];
+		} else {
+			gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
+			++cache_stats.dead_flag_ops;
+		}
 	}
-	mf_functions_num=0;
+	mf_functions_num=kept;
 #endif
 }
 
+// enqueue the instruction whose function call is generated at pos
+static void QueueFlags([[maybe_unused]] void* current_simple_function,
+                       [[maybe_unused]] const uint8_t* pos,
+                       [[maybe_unused]] Bitu flags_type,
+                       [[maybe_unused]] Bitu flags_mask) {
+#ifdef DRC_FLAGS_INVALIDATION
+	// a full queue just keeps the flags of the current instruction
+	if (mf_functions_num>=sizeof(mf_functions)/sizeof(mf_functions[0])) return;
+	mf_functions[mf_functions_num].pos=pos;
+	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
+	mf_functions[mf_functions_num].ftype=flags_type;
+	mf_functions[mf_functions_num].live_flags=flags_mask;
+	++mf_functions_num;
+#endif
+}
+
+// replace all queued functions with their simpler variants
+// because the current instruction destroys all condition flags and
+// the flags are not required before
+static void InvalidateFlags(void) {
+	KillFlags(FMASK_TEST);
+}
+
+// replace the queued functions that only generate flags in flags_mask,
+// because the current instruction destroys these and leaves the others
+static void InvalidateFlags(Bitu flags_mask) {
+	KillFlags(flags_mask);
+}
+
 // replace all queued functions with their simpler variants
 // because the current instruction destroys all condition flags and
 // the flags are not required before
 static void InvalidateFlags(void* current_simple_function,Bitu flags_type) {
-#ifdef DRC_FLAGS_INVALIDATION
-	for (Bitu ct=0; ct<mf_functions_num; ct++) {
-		gen_fill_function_ptr(mf_functions[ct].pos,mf_functions[ct].fct_ptr,mf_functions[ct].ftype);
-	}
-	mf_functions_num=1;
-	mf_functions[0].pos=cache.pos;
-	mf_functions[0].fct_ptr=current_simple_function;
-	mf_functions[0].ftype=flags_type;
-#endif
+	KillFlags(FMASK_TEST);
+	QueueFlags(current_simple_function,cache.pos,flags_type,FMASK_TEST);
+}
+
+// like above, but the current instruction only destroys the flags in
+// flags_mask and leaves the others as they were
+static void InvalidateFlags(void* current_simple_function,Bitu flags_type,Bitu flags_mask) {
+	KillFlags(flags_mask);
+	QueueFlags(current_simple_function,cache.pos,flags_type,flags_mask);
 }
 
 // enqueue this instruction, if later an instruction is encountered that
 // destroys all condition flags and the flags weren't needed in-between
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,Bitu flags_type) {
-#ifdef DRC_FLAGS_INVALIDATION
-	mf_functions[mf_functions_num].pos=cache.pos;
-	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
-	mf_functions[mf_functions_num].ftype=flags_type;
-	++mf_functions_num;
-#endif
+	QueueFlags(current_simple_function,cache.pos,flags_type,FMASK_TEST);
 }
 
 // enqueue this instruction, if later an instruction is encountered that
 // destroys all condition flags and the flags weren't needed in-between
 // this function can be replaced by a simpler one as well
 static void InvalidateFlagsPartially(void* current_simple_function,const uint8_t* cpos,Bitu flags_type) {
-#ifdef DRC_FLAGS_INVALIDATION
-	mf_functions[mf_functions_num].pos=cpos;
-	mf_functions[mf_functions_num].fct_ptr=current_simple_function;
-	mf_functions[mf_functions_num].ftype=flags_type;
-	++mf_functions_num;
-#endif
+	QueueFlags(current_simple_function,cpos,flags_type,FMASK_TEST);
 }
 
-// the current function needs the condition flags thus reset the queue
+// the current function needs the flags in flags_mask, thus the queued
+// functions that generate them have to stay
 static void AcquireFlags([[maybe_unused]] Bitu flags_mask) {
 #ifdef DRC_FLAGS_INVALIDATION
-	mf_functions_num=0;
+	Bitu kept=0;
+	for (Bitu ct=0; ct<mf_functions_num; ct++) {
+		if (!(mf_functions[ct].live_flags & flags_mask))
+			mf_functions[kept++]=mf_functions[ct];
+	}
+	mf_functions_num=kept;
 #endif
 }
@@ -1092,7 +1092,7 @@ static void dyn_cwd(void) {
 static void dyn_sahf(void) {
 	MOV_REG_WORD16_TO_HOST_REG(FC_OP1,DRC_REG_EAX);
 	gen_call_function_raw((void *)&dynrec_sahf);
-	InvalidateFlags();
+	InvalidateFlags(FMASK_TEST & ~FLAG_OF);
 }
 
 
@@ -1104,22 +1104,107 @@ static void dyn_exit_link(Bits eip_change) {
 }
 
 
-static void dyn_branched_exit(BranchTypes btype,int32_t eip_add) {
+// whether translation could continue at the target of a conditional branch
+// that's about to end the block
+static bool dyn_trace_possible(int32_t eip_add) {
+	if (!decode.trace.ip_known) return false;
+	// the target has to follow in the page the block started in, skipped
+	// bytes are counted as part of the block
+	if (decode.active_block!=decode.block) return false;
+	if (eip_add<0 || eip_add>DYN_TRACE_MAX_GAP) return false;
+	if (decode.page.index+eip_add>=4096) return false;
+	if (!decode.big_op) {
+		// ip must not wrap around
+		const uint32_t ip=decode.trace.ip+(uint32_t)(decode.code-decode.code_start);
+		if (ip+eip_add>0xffff) return false;
+	}
+	return true;
+}
+
+// continue translating at the target of a taken branch, the branch itself
+// has already been translated
+static void dyn_trace_follow(Bitu eip_base,int32_t eip_add) {
+	gen_add_direct_word(&reg_eip,eip_base+eip_add,decode.big_op);
+	// the flags were read by the branch and the exit
+	AcquireFlags(FMASK_TEST);
+	// the cycles so far have been taken off already
+	decode.cycles=0;
+
+	for (int32_t i=0; i<eip_add; i++) decode.page.wmap[decode.page.index+i]+=0x01;
+	decode.page.index+=eip_add;
+	decode.code+=eip_add;
+	decode.code_start=decode.code;
+	if (!decode.big_op) decode.trace.ip=(decode.trace.ip+eip_base+eip_add)&0xffff;
+	else decode.trace.ip+=(uint32_t)(eip_base+eip_add);
+	--decode.trace.follow;
+}
+
+// leave a trace where a followed branch isn't taken
+static void dyn_trace_side_exit_code() {
+	// keep the spare blocks the cache needs to close this block
+	if (cache_free_blocks<=cache_min_free_blocks) {
+		dyn_return(BR_Normal);
+		return;
+	}
+	CacheBlock* side_exit=dyn_new_side_exit();
+	// linking goes through the running block
+	gen_mov_direct_ptr(&cache.block.running,(Bitu)side_exit);
+	// count down the exits, and have the trace checked once they reach
+	// the threshold
+	gen_mov_word_to_reg(FC_OP1,&side_exit->trace.countdown,true);
+	gen_add_imm(FC_OP1,(uint32_t)(-1));
+	gen_mov_word_from_reg(FC_OP1,&side_exit->trace.countdown,true);
+	const uint8_t* not_hot=gen_create_branch_on_nonzero(FC_OP1,true);
+	dyn_return(BR_TraceExit);
+	gen_fill_branch(not_hot);
+	gen_jmp_ptr(&side_exit->link[0].to, offsetof(CacheBlock, cache.start));
+}
+
+// returns true if the translation continues at the branch target
+static bool dyn_branched_exit(BranchTypes btype,int32_t eip_add) {
 	Bitu eip_base=decode.code-decode.code_start;
 	dyn_reduce_cycles();
 
 	dyn_branchflag_to_reg(btype);
 	const uint8_t* data=gen_create_branch_on_nonzero(FC_RETOP,true);
 
+	const bool trace_possible=dyn_trace_possible(eip_add);
+	if (trace_possible && decode.trace.follow) {
+		// the branch is usually taken, so leave the block through a side
+		// exit when it isn't; the block's own links belong to the exit at
+		// the end of the trace
+		gen_add_direct_word(&reg_eip,eip_base,decode.big_op);
+		dyn_trace_side_exit_code();
+		gen_fill_branch(data);
+		dyn_trace_follow(eip_base,eip_add);
+		return true;
+	}
+
+	const bool may_trace=trace_possible && decode.trace.depth<DYN_TRACE_MAX_BRANCHES;
+
  	// Branch not taken
 	gen_add_direct_word(&reg_eip,eip_base,decode.big_op);
+	// only branches that are nearly always taken get followed
+	if (may_trace) gen_add_direct_word(&decode.block->trace.not_taken,1,true);
 	gen_jmp_ptr(&decode.block->link[0].to, offsetof(CacheBlock, cache.start));
 	gen_fill_branch(data);
 
  	// Branch taken
 	gen_add_direct_word(&reg_eip,eip_base+eip_add,decode.big_op);
+	if (may_trace) {
+		// count down the taken branches, and have the block checked for
+		// being translated again across the branch once they reach the
+		// threshold
+		gen_mov_word_to_reg(FC_OP1,&decode.block->trace.countdown,true);
+		gen_add_imm(FC_OP1,(uint32_t)(-1));
+		gen_mov_word_from_reg(FC_OP1,&decode.block->trace.countdown,true);
+		const uint8_t* not_hot=gen_create_branch_on_nonzero(FC_OP1,true);
+		dyn_return(BR_Trace);
+		gen_fill_branch(not_hot);
+	}
 	gen_jmp_ptr(&decode.block->link[1].to, offsetof(CacheBlock, cache.start));
 	dyn_closeblock();
+	return false;
 }
 
 /*
@@ -399,7 +399,7 @@ static void dyn_dop_byte_gencall(DualOps op) {
 			break;
 		case DOP_ADC:
 			AcquireFlags(FLAG_CF);
-			InvalidateFlagsPartially((void*)&dynrec_adc_byte_simple,t_ADCb);
+			InvalidateFlags((void*)&dynrec_adc_byte_simple,t_ADCb);
 			gen_call_function_raw((void*)&dynrec_adc_byte);
 			break;
 		case DOP_SUB:
@@ -408,7 +408,7 @@ static void dyn_dop_byte_gencall(DualOps op) {
 			break;
 		case DOP_SBB:
 			AcquireFlags(FLAG_CF);
-			InvalidateFlagsPartially((void*)&dynrec_sbb_byte_simple,t_SBBb);
+			InvalidateFlags((void*)&dynrec_sbb_byte_simple,t_SBBb);
 			gen_call_function_raw((void*)&dynrec_sbb_byte);
 			break;
 		case DOP_CMP:
@@ -444,7 +444,7 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 				break;
 			case DOP_ADC:
 				AcquireFlags(FLAG_CF);
-				InvalidateFlagsPartially((void*)&dynrec_adc_dword_simple,t_ADCd);
+				InvalidateFlags((void*)&dynrec_adc_dword_simple,t_ADCd);
 				gen_call_function_raw((void*)&dynrec_adc_dword);
 				break;
 			case DOP_SUB:
@@ -453,7 +453,7 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 				break;
 			case DOP_SBB:
 				AcquireFlags(FLAG_CF);
-				InvalidateFlagsPartially((void*)&dynrec_sbb_dword_simple,t_SBBd);
+				InvalidateFlags((void*)&dynrec_sbb_dword_simple,t_SBBd);
 				gen_call_function_raw((void*)&dynrec_sbb_dword);
 				break;
 			case DOP_CMP:
@@ -486,7 +486,7 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 				break;
 			case DOP_ADC:
 				AcquireFlags(FLAG_CF);
-				InvalidateFlagsPartially((void*)&dynrec_adc_word_simple,t_ADCw);
+				InvalidateFlags((void*)&dynrec_adc_word_simple,t_ADCw);
 				gen_call_function_raw((void*)&dynrec_adc_word);
 				break;
 			case DOP_SUB:
@@ -495,7 +495,7 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 				break;
 			case DOP_SBB:
 				AcquireFlags(FLAG_CF);
-				InvalidateFlagsPartially((void*)&dynrec_sbb_word_simple,t_SBBw);
+				InvalidateFlags((void*)&dynrec_sbb_word_simple,t_SBBw);
 				gen_call_function_raw((void*)&dynrec_sbb_word);
 				break;
 			case DOP_CMP:
@@ -666,11 +666,11 @@ static uint32_t DRC_CALL_CONV dynrec_neg_dword_simple(uint32_t op) {
 static void dyn_sop_byte_gencall(SingleOps op) {
 	switch (op) {
 		case SOP_INC:
-			InvalidateFlagsPartially((void*)&dynrec_inc_byte_simple,t_INCb);
+			InvalidateFlags((void*)&dynrec_inc_byte_simple,t_INCb,FMASK_TEST & ~FLAG_CF);
 			gen_call_function_raw((void*)&dynrec_inc_byte);
 			break;
 		case SOP_DEC:
-			InvalidateFlagsPartially((void*)&dynrec_dec_byte_simple,t_DECb);
+			InvalidateFlags((void*)&dynrec_dec_byte_simple,t_DECb,FMASK_TEST & ~FLAG_CF);
 			gen_call_function_raw((void*)&dynrec_dec_byte);
 			break;
 		case SOP_NOT:
@@ -688,11 +688,11 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 	if (dword) {
 		switch (op) {
 			case SOP_INC:
-				InvalidateFlagsPartially((void*)&dynrec_inc_dword_simple,t_INCd);
+				InvalidateFlags((void*)&dynrec_inc_dword_simple,t_INCd,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_inc_dword);
 				break;
 			case SOP_DEC:
-				InvalidateFlagsPartially((void*)&dynrec_dec_dword_simple,t_DECd);
+				InvalidateFlags((void*)&dynrec_dec_dword_simple,t_DECd,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_dec_dword);
 				break;
 			case SOP_NOT:
@@ -707,11 +707,11 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 	} else {
 		switch (op) {
 			case SOP_INC:
-				InvalidateFlagsPartially((void*)&dynrec_inc_word_simple,t_INCw);
+				InvalidateFlags((void*)&dynrec_inc_word_simple,t_INCw,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_inc_word);
 				break;
 			case SOP_DEC:
-				InvalidateFlagsPartially((void*)&dynrec_dec_word_simple,t_DECw);
+				InvalidateFlags((void*)&dynrec_dec_word_simple,t_DECw,FMASK_TEST & ~FLAG_CF);
 				gen_call_function_raw((void*)&dynrec_dec_word);
 				break;
 			case SOP_NOT:
@@ -98,6 +98,10 @@ static struct {
 	bool rep_zero;
 	Bitu prefixes;
 	GetEAHandler * ea_table;
+	// host memory of the code page the instruction started in, looked up
+	// once per instruction so fetches within that page skip the TLB
+	PhysPt fetch_page;
+	HostPt fetch_host;
 } core;
 
 #define GETIP		(core.cseip-SegBase(cs))
@@ -108,19 +112,46 @@ static struct {
 #define BaseDS		core.base_ds
 #define BaseSS		core.base_ss
 
+// TODO: This only makes fetching cheaper; every instruction is still decoded
+// each time it runs. Caching decoded instructions per physical page (handler
+// plus precomputed operands, dispatched one to the next and dropped on writes
+// to the code page) is not done yet.
+static inline void SetupFetch() {
+	core.fetch_page=core.cseip & ~static_cast<PhysPt>(4095);
+	const HostPt tlb_addr=get_tlb_read(core.fetch_page);
+	core.fetch_host=tlb_addr ? tlb_addr+core.fetch_page : nullptr;
+}
+
+// Whether the next size bytes can be read from the cached code page
+static inline bool CanFetchDirect(const PhysPt size) {
+	return core.fetch_host && (core.cseip-core.fetch_page) <= 4096-size;
+}
+
 static inline uint8_t Fetchb() {
-	uint8_t temp=LoadMb(core.cseip);
+	uint8_t temp;
+	if (GCC_LIKELY(CanFetchDirect(1)))
+		temp=host_readb(core.fetch_host+(core.cseip-core.fetch_page));
+	else
+		temp=LoadMb(core.cseip);
 	core.cseip+=1;
 	return temp;
 }
 
 static inline uint16_t Fetchw() {
-	uint16_t temp=LoadMw(core.cseip);
+	uint16_t temp;
+	if (GCC_LIKELY(CanFetchDirect(2)))
+		temp=host_readw(core.fetch_host+(core.cseip-core.fetch_page));
+	else
+		temp=LoadMw(core.cseip);
 	core.cseip+=2;
 	return temp;
 }
 static inline uint32_t Fetchd() {
-	uint32_t temp=LoadMd(core.cseip);
+	uint32_t temp;
+	if (GCC_LIKELY(CanFetchDirect(4)))
+		temp=host_readd(core.fetch_host+(core.cseip-core.fetch_page));
+	else
+		temp=LoadMd(core.cseip);
 	core.cseip+=4;
 	return temp;
 }
@@ -162,6 +193,7 @@ Bits CPU_Core_Normal_Run() noexcept
 #endif
 		cycle_count++;
 #endif
+		SetupFetch();
 restart_opcode:
 		switch (core.opcode_index+Fetchb()) {
 		#include "core_normal/prefix_none.h"
@@ -21,14 +21,17 @@
 
 #include <assert.h>
 #include <sstream>
+#include <string>
 #include <stddef.h>
 
+#include "cross.h"
 #include "memory.h"
 #include "debug.h"
 #include "mapper.h"
 #include "setup.h"
 #include "programs.h"
 #include "paging.h"
+#include "pic.h"
 #include "lazyflags.h"
 #include "support.h"
 
@@ -75,13 +78,26 @@ void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
+void CPU_Core_Dyn_X86_Cache_SetSize(size_t size);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
+void CPU_Core_Dyn_X86_Cache_LoadPersistent(const std::string& filename);
+void CPU_Core_Dyn_X86_Cache_Warm(int64_t deadline_us);
 void CPU_Core_Dyn_X86_Cache_Close(void);
+void CPU_Core_Dyn_X86_Cache_ReleasePage(Bitu phys_page);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+DynamicCacheStats CPU_Core_Dyn_X86_GetCacheStats();
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
+void CPU_Core_Dynrec_Cache_SetSize(size_t size);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+void CPU_Core_Dynrec_Cache_LoadPersistent(const std::string& filename);
+void CPU_Core_Dynrec_Cache_Warm(int64_t deadline_us);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_Cache_ReleasePage(Bitu phys_page);
+void CPU_Core_Dynrec_SetBlockProfiling(bool enabled);
+bool CPU_Core_Dynrec_IsBlockProfiling();
+std::vector<DynrecBlockProfile> CPU_Core_Dynrec_GetHotBlocks(size_t max_blocks);
+DynamicCacheStats CPU_Core_Dynrec_GetCacheStats();
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -2077,6 +2093,8 @@ static Bits HLT_Decode(void) {
 	if (reg_eip!=cpu.hlt.eip || SegValue(cs) != cpu.hlt.cs) {
 		cpudecoder=cpu.hlt.old_decoder;
 	} else {
+		if (GETFLAG(IF))
+			CPU_IdleStats.idle_cycles += CPU_Cycles;
 		CPU_IODelayRemoved += CPU_Cycles;
 		CPU_Cycles=0;
 	}
@@ -2085,6 +2103,8 @@ static Bits HLT_Decode(void) {
 
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
+	if (GETFLAG(IF))
+		CPU_IdleStats.idle_cycles += CPU_Cycles;
 	CPU_IODelayRemoved += CPU_Cycles;
 	CPU_Cycles=0;
 	cpu.hlt.cs=SegValue(cs);
@@ -2183,13 +2203,146 @@ static void CPU_CycleDecrease(bool pressed) {
 	}
 }
 
-extern int64_t ticksDone;
-extern int64_t ticksScheduled;
+void CPU_ReleaseCodePage(Bitu phys_page) {
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_Cache_ReleasePage(phys_page);
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_Cache_ReleasePage(phys_page);
+#else
+	(void)phys_page;
+#endif
+}
 
-void CPU_Reset_AutoAdjust(void) {
-	CPU_IODelayRemoved = 0;
-	ticksDone = 0;
-	ticksScheduled = 0;
+bool CPU_SetDynrecBlockProfiling(const bool enabled) {
+#if (C_DYNREC)
+	CPU_Core_Dynrec_SetBlockProfiling(enabled);
+	return true;
+#else
+	(void)enabled;
+	return false;
+#endif
+}
+
+bool CPU_IsDynrecBlockProfiling() {
+#if (C_DYNREC)
+	return CPU_Core_Dynrec_IsBlockProfiling();
+#else
+	return false;
+#endif
+}
+
+std::vector<DynrecBlockProfile> CPU_GetDynrecHotBlocks(const size_t max_blocks) {
+#if (C_DYNREC)
+	return CPU_Core_Dynrec_GetHotBlocks(max_blocks);
+#else
+	(void)max_blocks;
+	return {};
+#endif
+}
+
+IdleDetection CPU_IdleDetection = IdleDetection::Off;
+IdleStats CPU_IdleStats = {};
+
+// A loop is polling once it read the same value from the same status port
+// this many times in a row, with little else done in between. This has to
+// be seen again on every tick before it counts as idle.
+constexpr uint32_t polling_min_reads = 64;
+constexpr int32_t polling_max_cycles = 64;
+
+static struct {
+	uint16_t port      = 0;
+	uint8_t value      = 0;
+	uint32_t tick      = 0; // the tick the reads were counted in
+	int32_t tick_index = 0; // when the port was read last
+	uint32_t reads     = 0;
+	bool idle          = false;
+} port_polling = {};
+
+// The ports whose value only changes with a scheduled event or with input.
+// The video status ports (0x3ba, 0x3da) are left out: their retrace bits are
+// worked out from the time within the frame, so skipping ahead could jump
+// over the edge the guest is waiting for.
+static bool is_status_port(const uint16_t port)
+{
+	switch (port) {
+	case 0x60: // keyboard data
+	case 0x64: // keyboard controller status
+		return true;
+	default: return false;
+	}
+}
+
+void CPU_CheckPortPolling(const uint16_t port, const uint8_t value)
+{
+	if (CPU_IdleDetection != IdleDetection::Polling)
+		return;
+
+	const auto tick_index = PIC_TickIndexND();
+	const auto gap        = tick_index - port_polling.tick_index;
+	const bool same_read  = port == port_polling.port &&
+	                       value == port_polling.value;
+	port_polling.tick_index = tick_index;
+
+	// Counting starts over on each tick, and whenever the loop did more
+	// than poll in between, so a read that merely repeats a while later
+	// doesn't throw away the rest of a busy slice
+	if (!same_read || !is_status_port(port) || port_polling.tick != PIC_Ticks ||
+	    gap < 0 || gap > polling_max_cycles) {
+		port_polling.port  = port;
+		port_polling.value = value;
+		port_polling.tick  = PIC_Ticks;
+		port_polling.reads = 0;
+		port_polling.idle  = false;
+		return;
+	}
+	if (!port_polling.idle && ++port_polling.reads < polling_min_reads)
+		return;
+
+	// Nothing can change the value before the next event, so skip ahead
+	port_polling.idle = true;
+	CPU_IdleStats.idle_cycles += CPU_Cycles;
+	CPU_IODelayRemoved += CPU_Cycles;
+	CPU_Cycles = 0;
+
+	// The skipped cycles don't count towards the gap to the next read
+	port_polling.tick_index = PIC_TickIndexND();
+}
+
+bool CPU_IsIdle()
+{
+	const bool halted = cpudecoder == &HLT_Decode && GETFLAG(IF);
+	switch (CPU_IdleDetection) {
+	case IdleDetection::Off: return false;
+	case IdleDetection::Halt: return halted;
+	case IdleDetection::Polling:
+		// Only the tick that just ran counts
+		return halted ||
+		       (port_polling.idle && port_polling.tick == PIC_Ticks);
+	}
+	return false;
+}
+
+void CPU_WarmDynamicCache(const int64_t deadline_us) {
+#if (C_DYNAMIC_X86)
+	CPU_Core_Dyn_X86_Cache_Warm(deadline_us);
+#elif (C_DYNREC)
+	CPU_Core_Dynrec_Cache_Warm(deadline_us);
+#else
+	(void)deadline_us;
+#endif
+}
+
+bool CPU_GetDynamicCacheStats(DynamicCacheStats &stats) {
+#if (C_DYNAMIC_X86)
+	stats = CPU_Core_Dyn_X86_GetCacheStats();
+	return true;
+#elif (C_DYNREC)
+	stats = CPU_Core_Dynrec_GetCacheStats();
+	return true;
+#else
+	(void)stats;
+	return false;
+#endif
 }
 
 class CPU final : public Module_base {
@@ -2346,6 +2499,14 @@ public:
 		CPU_CycleUp=section->Get_int("cycleup");
 		CPU_CycleDown=section->Get_int("cycledown");
 		std::string core(section->Get_string("core"));
+
+		const std::string idle_detection = section->Get_string("idle_detection");
+		if (idle_detection == "halt")
+			CPU_IdleDetection = IdleDetection::Halt;
+		else if (idle_detection == "polling")
+			CPU_IdleDetection = IdleDetection::Polling;
+		else
+			CPU_IdleDetection = IdleDetection::Off;
 		cpudecoder=&CPU_Core_Normal_Run;
 		if (core == "normal") {
 			cpudecoder=&CPU_Core_Normal_Run;
@@ -2374,10 +2535,23 @@ public:
 #endif
 		}
 
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+		const auto cache_size = static_cast<size_t>(
+		        section->Get_int("dynamic_cache_size")) * 1024 * 1024;
+		const auto persistent_cache_file = section->Get_bool("dynamic_cache_persist")
+		        ? (GetConfigDir() / "dynamic_cache.bin").string()
+		        : std::string();
+#endif
 #if (C_DYNAMIC_X86)
+		CPU_Core_Dyn_X86_Cache_SetSize(cache_size);
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
+		if (!persistent_cache_file.empty())
+			CPU_Core_Dyn_X86_Cache_LoadPersistent(persistent_cache_file);
 #elif (C_DYNREC)
+		CPU_Core_Dynrec_Cache_SetSize(cache_size);
 		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
+		if (!persistent_cache_file.empty())
+			CPU_Core_Dynrec_Cache_LoadPersistent(persistent_cache_file);
 #endif
 
 		CPU_ArchitectureType = ArchitectureType::Mixed;
@@ -2438,6 +2612,11 @@ public:
 static CPU * test;
 
 void CPU_ShutDown([[maybe_unused]] Section* sec) {
+	if (CPU_IdleDetection != IdleDetection::Off && CPU_IdleStats.total_cycles > 0)
+		LOG_MSG("CPU: Guest was idle %.1f%% of the time, the host slept %.1f s",
+		        100.0 * static_cast<double>(CPU_IdleStats.idle_cycles) /
+		                static_cast<double>(CPU_IdleStats.total_cycles),
+		        static_cast<double>(CPU_IdleStats.slept_us) / 1e6);
 #if (C_DYNAMIC_X86)
 	CPU_Core_Dyn_X86_Cache_Close();
 #elif (C_DYNREC)
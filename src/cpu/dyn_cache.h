@@ -19,10 +19,13 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <algorithm>
 #include <cassert>
 #include <cerrno>
 #include <new>
 #include <type_traits>
+#include <unordered_set>
+#include <vector>
 
 #include "mem_unaligned.h"
 #include "paging.h"
@@ -88,6 +91,9 @@ public:
 		uint8_t* wmapmask = {};
 		uint16_t maskstart = 0;
 		uint16_t masklen   = 0;
+		// set by the translated code whenever the block is entered and
+		// cleared when eviction passes it by, see cache_openblock
+		Bitu used = 0;
 
 		// Manage the write mask
 		void DeleteWriteMask();
@@ -116,12 +122,38 @@ public:
 	} link[2] = {};                // maximum two links (conditional jumps)
 
 	CacheBlock* crossblock = {};
+
+	// The dynrec core's traces across hot conditional branches. A side
+	// exit of a trace is a block without code that only holds the link of
+	// the exit; the side exits of a trace are chained through side_exits.
+	struct Trace {
+		// taken branches left until the block is checked for extending
+		// across its conditional exit; for a side exit, the exits left
+		// until the trace is checked for being cut short
+		uint32_t countdown = 0;
+		uint32_t not_taken = 0; // the other way out in the meantime
+		// runs of a block that follows branches; for a side exit, the
+		// runs of its trace at the last check
+		uint32_t entries = 0;
+		// for a side exit, the branches the trace follows before it
+		uint32_t branch = 0;
+		CacheBlock* owner = {}; // for a side exit, the trace
+		CacheBlock* side_exits = {};
+	} trace = {};
+
+	// Only updated by blocks translated while block profiling is on
+	struct Profile {
+		uint32_t entries = 0;
+		uint32_t cycles  = 0;
+	} profile = {};
 };
 
 static_assert(std::is_standard_layout_v<CacheBlock::Page>, "standard-layout is required for offsetof");
 static_assert(std::is_standard_layout_v<CacheBlock::Cache>, "standard-layout is required for offsetof");
 static_assert(std::is_standard_layout_v<CacheBlock::Hash>, "standard-layout is required for offsetof");
 static_assert(std::is_standard_layout_v<CacheBlock::Link>, "standard-layout is required for offsetof");
+static_assert(std::is_standard_layout_v<CacheBlock::Profile>, "standard-layout is required for offsetof");
+static_assert(std::is_standard_layout_v<CacheBlock::Trace>, "standard-layout is required for offsetof");
 static_assert(std::is_standard_layout_v<CacheBlock>, "standard-layout is required for offsetof");
 
 static struct {
@@ -151,7 +183,38 @@ static uint8_t* cache_code_start_ptr   = {};
 static uint8_t* cache_code             = {};
 static uint8_t* cache_code_link_blocks = {};
 
+// the size of the cache can be set at startup, the number of blocks and code
+// pages grows along with it
+static size_t cache_total_size = CACHE_TOTAL;
+
+static size_t cache_size_factor()
+{
+	return std::max<size_t>((cache_total_size + CACHE_TOTAL - 1) / CACHE_TOTAL, 1);
+}
+
+static size_t cache_num_blocks()
+{
+	return CACHE_BLOCKS * cache_size_factor();
+}
+
+static size_t cache_num_pages()
+{
+	return CACHE_PAGES * cache_size_factor();
+}
+
 static std::vector<CacheBlock> cache_blocks(CACHE_BLOCKS);
+static size_t cache_free_blocks = 0;
+
+// enough for splitting off the rest of a block and for the blocks of code
+// crossing into the next page; below that the cache is flushed
+constexpr size_t cache_min_free_blocks = 16;
+
+static DynamicCacheStats cache_stats = {};
+
+// the guest addresses that have started a block, to tell retranslations
+// apart; a set rather than a bitmap so far-off physical addresses (ROMs,
+// linear frame buffers) don't grow it to the size of the address space
+static std::unordered_set<PhysPt> cache_translated_code = {};
 static CacheBlock link_blocks[2] = {}; // default linking (specially marked)
 
 // the CodePageHandler class provides access to the contained
@@ -477,7 +540,7 @@ public:
 	{
 		// revert to old handler
 		MEM_SetPageHandler(phys_page,1,old_pagehandler);
-		PAGING_ClearTLB();
+		PAGING_ClearCurrentTLB();
 
 		// remove page from the lists
 		if (prev) prev->next=next;
@@ -505,6 +568,11 @@ public:
 		Release(); // now can release this page
 	}
 
+	Bitu GetPhysPage() const
+	{
+		return phys_page;
+	}
+
 	CacheBlock *FindCacheBlock(Bitu start)
 	{
 		CacheBlock *block = hash_map[1 + (start >> DYN_HASH_SHIFT)];
@@ -550,11 +618,20 @@ private:
 	Bitu phys_page = 0;
 };
 
+// Counts a block translated from the given physical address
+static void cache_count_translation(const PhysPt phys_addr)
+{
+	++cache_stats.translations;
+	if (!cache_translated_code.insert(phys_addr).second)
+		++cache_stats.retranslations;
+}
+
 static inline void cache_add_unused_block(CacheBlock *block)
 {
 	// block has become unused, add it to the freelist
 	block->cache.next = cache.block.free;
 	cache.block.free = block;
+	++cache_free_blocks;
 }
 
 static CacheBlock *cache_getblock()
@@ -564,7 +641,10 @@ static CacheBlock *cache_getblock()
 	if (!ret)
 		E_Exit("Ran out of CacheBlocks");
 	cache.block.free=ret->cache.next;
+	--cache_free_blocks;
 	ret->cache.next=nullptr;
+	ret->cache.used=0;
+	ret->profile={};
 	return ret;
 }
 
@@ -572,6 +652,24 @@ CacheBlock::~CacheBlock() {
 	cache.DeleteWriteMask();
 }
 
+// takes a block off the list of the blocks linking to its link target
+static void cache_unlink(CacheBlock *block, const Bitu ind)
+{
+	if (block->link[ind].to == &link_blocks[ind])
+		return;
+	// not linked to the standard linkcode, find the block that links to
+	// this block
+	CacheBlock **wherelink = &block->link[ind].to->link[ind].from;
+	while (*wherelink != block && *wherelink) {
+		wherelink = &(*wherelink)->link[ind].next;
+	}
+	// now remove the link
+	if (*wherelink)
+		*wherelink = (*wherelink)->link[ind].next;
+	else
+		LOG(LOG_CPU, LOG_ERROR)("Cache anomaly. please investigate");
+}
+
 void CacheBlock::Cache::DeleteWriteMask()
 {
 	delete[] wmapmask;
@@ -661,22 +759,18 @@ void CacheBlock::Clear()
 
 			fromlink=nextlink;
 		}
-		if (link[ind].to!=&link_blocks[ind]) {
-			// not linked to the standard linkcode, find the block
-			// that links to this block
-			CacheBlock **wherelink = &link[ind].to->link[ind].from;
-			while (*wherelink != this && *wherelink) {
-				wherelink = &(*wherelink)->link[ind].next;
-			}
-			// now remove the link
-			if (*wherelink)
-				*wherelink = (*wherelink)->link[ind].next;
-			else
-				LOG(LOG_CPU, LOG_ERROR)("Cache anomaly. please investigate");
-		}
+		cache_unlink(this, ind);
 	} else {
 		cache_add_unused_block(this);
 	}
+	// side exits only ever link on through their first link
+	while (trace.side_exits) {
+		CacheBlock *side_exit = trace.side_exits;
+		trace.side_exits = side_exit->trace.side_exits;
+		cache_unlink(side_exit, 0);
+		side_exit->trace = {};
+		cache_add_unused_block(side_exit);
+	}
 	if (crossblock) {
 		// clear out the crossblock (in the page before) as well
 		crossblock->crossblock=nullptr;
@@ -691,33 +785,86 @@ void CacheBlock::Clear()
 	cache.DeleteWriteMask();
 }
 
+// the block that follows this one in the cache, restarting at the first
+// block once the end of the cache is reached
+static CacheBlock *cache_next_active(const CacheBlock *block)
+{
+#if (C_DYNAMIC_X86)
+	const bool cache_is_full = !block->cache.next;
+#elif (C_DYNREC)
+	const uint8_t *limit = (cache_code_start_ptr + cache_total_size - CACHE_MAXSIZE);
+	const bool cache_is_full = (!block->cache.next ||
+	                            (block->cache.next->cache.start > limit));
+#endif
+	if (cache_is_full) {
+		// LOG_DEBUG("Cache full; restarting");
+		++cache_stats.wraps;
+		return cache.block.first;
+	}
+	return block->cache.next;
+}
+
+// blocks that ran since eviction last came by get a second chance
+static bool cache_spare_block(CacheBlock *block)
+{
+	if (!block->page.handler || !block->cache.used)
+		return false;
+	block->cache.used = 0;
+	++cache_stats.spared_blocks;
+	return true;
+}
+
+static void cache_evict_block(CacheBlock *block)
+{
+	if (!block->page.handler)
+		return;
+	block->Clear();
+	++cache_stats.evicted_blocks;
+}
+
 static CacheBlock *cache_openblock()
 {
-	CacheBlock *block = cache.block.active;
-	// check for enough space in this block
-	Bitu size=block->cache.size;
-	CacheBlock *nextblock = block->cache.next;
-	if (block->page.handler)
-		block->Clear();
-	// block size must be at least CACHE_MAXSIZE
-	while (size<CACHE_MAXSIZE) {
-		if (!nextblock)
-			goto skipresize;
-		// merge blocks
-		size+=nextblock->cache.size;
-		CacheBlock *tempblock = nextblock->cache.next;
-		if (nextblock->page.handler)
-			nextblock->Clear();
-		// block is free now
-		cache_add_unused_block(nextblock);
-		nextblock=tempblock;
+	// Clock-style eviction: walk the cache from the active block and
+	// skip the blocks that were run since the last pass, so hot code
+	// survives the cache wrapping around. Each pass clears the used
+	// flags it skips over, so this ends within two rounds.
+	for (;;) {
+		while (cache_spare_block(cache.block.active))
+			cache.block.active = cache_next_active(cache.block.active);
+
+		CacheBlock *block = cache.block.active;
+		// check for enough space in this block
+		Bitu size=block->cache.size;
+		CacheBlock *nextblock = block->cache.next;
+		cache_evict_block(block);
+		// block size must be at least CACHE_MAXSIZE
+		bool spared = false;
+		while (size<CACHE_MAXSIZE && nextblock) {
+			if (cache_spare_block(nextblock)) {
+				spared = true;
+				break;
+			}
+			// merge blocks
+			size+=nextblock->cache.size;
+			CacheBlock *tempblock = nextblock->cache.next;
+			cache_evict_block(nextblock);
+			// block is free now
+			cache_add_unused_block(nextblock);
+			nextblock=tempblock;
+		}
+		block->cache.size=size;
+		block->cache.next=nextblock;
+		if (spared) {
+			// the space gathered so far is too small, leave it for
+			// the next round and carry on behind the spared block
+			cache.block.active=cache_next_active(nextblock);
+			continue;
+		}
+		// open this block
+		block->cache.used=0;
+		cache.pos=block->cache.start;
+		return block;
 	}
-skipresize:
-	// adjust parameters and open this block
-	block->cache.size=size;
-	block->cache.next=nextblock;
-	cache.pos=block->cache.start;
-	return block;
 }
 
 static void cache_closeblock()
@@ -744,8 +891,9 @@ static void cache_closeblock()
 	} else {
 		Bitu new_size;
 		Bitu left=block->cache.size-written;
-		// smaller than cache align then don't bother to resize
-		if (left>CACHE_ALIGN) {
+		// smaller than cache align then don't bother to resize; without
+		// spare blocks the rest stays with this block until the next flush
+		if (left>CACHE_ALIGN && cache.block.free) {
 			new_size=((written-1)|(CACHE_ALIGN-1))+1;
 			CacheBlock *newblock = cache_getblock();
 			// align block now to CACHE_ALIGN
@@ -757,19 +905,7 @@ static void cache_closeblock()
 		}
 	}
 	// advance the active block pointer
-#if (C_DYNAMIC_X86)
-	const bool cache_is_full = !block->cache.next;
-#elif (C_DYNREC)
-	const uint8_t *limit = (cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE);
-	const bool cache_is_full = (!block->cache.next ||
-	                            (block->cache.next->cache.start > limit));
-#endif
-	if (cache_is_full) {
-		// LOG_DEBUG("Cache full; restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	cache.block.active=cache_next_active(block);
 }
 
 // TODO functions cache_addb, cache_addw, cache_addd, cache_addq definitely
@@ -844,7 +980,11 @@ static void cache_block_before_close();
 static void cache_block_closing(const uint8_t *block_start, Bitu block_size);
 #endif
 
-static constexpr size_t cache_code_size = CACHE_TOTAL + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+static size_t cache_code_size()
+{
+	return cache_total_size + CACHE_MAXSIZE + host_pagesize - 1 + host_pagesize;
+}
+
 constexpr bool is_64bit_platform = sizeof(void *) == 8;
 
 static inline void dyn_mem_adjust(void *&ptr, size_t &size)
@@ -961,9 +1101,12 @@ static void cache_init(bool enable) {
 			return;
 		}
 		cache_initialized = true;
+		if (cache_code_start_ptr == nullptr)
+			cache_blocks = std::vector<CacheBlock>(cache_num_blocks());
 		cache.block.free = &cache_blocks[0];
+		cache_free_blocks = cache_blocks.size();
 		// initialize the cache blocks
-		for (int i=0;i<CACHE_BLOCKS-1;i++) {
+		for (size_t i = 0; i < cache_blocks.size() - 1; i++) {
 			cache_blocks[i].link[0].to = (CacheBlock *)1;
 			cache_blocks[i].link[1].to = (CacheBlock *)1;
 			cache_blocks[i].cache.next = &cache_blocks[i + 1];
@@ -973,11 +1116,11 @@ static void cache_init(bool enable) {
 #if defined (WIN32)
 			LPVOID lp_vmem = nullptr;
 			if (CPU_UseRwxMemProtect) {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
+				lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
 				                       MEM_COMMIT,
 				                       PAGE_EXECUTE_READWRITE); // all operations allowed
 			} else {
-				lp_vmem = VirtualAlloc(nullptr, cache_code_size,
+				lp_vmem = VirtualAlloc(nullptr, cache_code_size(),
 				                       MEM_COMMIT | MEM_RESERVE,
 				                       PAGE_READWRITE); // needs on-going management
 			}
@@ -989,12 +1132,12 @@ static void cache_init(bool enable) {
 #if defined(HAVE_MAP_JIT)
 			map_flags |= MAP_JIT;
 #endif
-			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size, prot_flags, map_flags, -1, 0));
+			cache_code_start_ptr=static_cast<uint8_t *>(mmap(nullptr, cache_code_size(), prot_flags, map_flags, -1, 0));
 			if (cache_code_start_ptr == MAP_FAILED) {
 				E_Exit("DYNCACHE: Failed memory-mapping cache memory because: %s", strerror(errno));
 			}
 #else
-			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size));
+			cache_code_start_ptr=static_cast<uint8_t *>(malloc(cache_code_size()));
 			if (!cache_code_start_ptr) {
 				E_Exit("DYNCACHE: Failed allocating cache memory because: %s", strerror(errno));
 			}
@@ -1010,7 +1153,7 @@ static void cache_init(bool enable) {
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_total_size;
 			block->cache.next = nullptr; // last block in the list
 		}
 
@@ -1060,7 +1203,7 @@ static void cache_init(bool enable) {
 		cache.last_page=nullptr;
 		cache.used_pages=nullptr;
 		// setup the code pages
-		for (int i=0;i<CACHE_PAGES;i++) {
+		for (size_t i = 0; i < cache_num_pages(); i++) {
 			auto newpage = new (std::nothrow) CodePageHandler();
 			if (GCC_UNLIKELY(!newpage)) {
 				E_Exit("DYN_CACHE: Failed to allocate code-page handler");
@@ -1071,7 +1214,66 @@ static void cache_init(bool enable) {
 	}
 }
 
+// Drops the dynamic code of a physical page and puts its original handler
+// back, so another handler can be placed in front of it
+static void cache_release_page(Bitu phys_page) {
+	PageHandler *handler = MEM_GetPageHandler(phys_page);
+	if (handler->flags & PFLAG_HASCODE)
+		static_cast<CodePageHandler *>(handler)->ClearRelease();
+}
+
+// Drops all dynamic code, so everything is translated again when run next
+static void cache_release_all() {
+	while (cache.used_pages)
+		cache.used_pages->ClearRelease();
+}
+
+// Drops all dynamic code and joins the whole cache into a single block again,
+// for when it got split into too many small blocks
+static void cache_flush() {
+	cache_release_all();
+	cache.block.running = nullptr;
+	cache.block.free = nullptr;
+	cache_free_blocks = 0;
+	for (auto &block : cache_blocks) {
+		block.crossblock = nullptr;
+		block.page.handler = nullptr;
+		block.trace = {};
+		cache_add_unused_block(&block);
+	}
+	CacheBlock *block = cache_getblock();
+	cache.block.first=block;
+	cache.block.active=block;
+	block->cache.start=&cache_code[0];
+	block->cache.size=cache_total_size;
+	block->cache.next = nullptr; // last block in the list
+	++cache_stats.flushes;
+}
+
+// Only takes effect if the cache wasn't set up yet
+static void cache_set_size(const size_t size) {
+	if (!cache_code_start_ptr)
+		cache_total_size = size;
+}
+
+static DynamicCacheStats cache_get_stats() {
+	DynamicCacheStats stats = cache_stats;
+	stats.cache_bytes = cache_total_size;
+	return stats;
+}
+
 static void cache_close(void) {
+	if (cache_stats.translations)
+		LOG_MSG("DYNCACHE: Translated %" PRIu64 " blocks, %" PRIu64
+		        " of them again; evicted %" PRIu64 " blocks and %" PRIu64
+		        " pages, flushed %" PRIu64 " times",
+		        cache_stats.translations, cache_stats.retranslations,
+		        cache_stats.evicted_blocks, cache_stats.evicted_pages,
+		        cache_stats.flushes);
+	if (cache_stats.translations)
+		LOG_MSG("DYNCACHE: Spent %" PRId64 " ms translating blocks as they were "
+		        "reached, %" PRIu64 " blocks were translated ahead",
+		        cache_stats.translate_us / 1000, cache_stats.warmed_blocks);
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
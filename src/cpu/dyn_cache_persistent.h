@@ -0,0 +1,312 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DYN_CACHE_PERSISTENT_H
+#define DOSBOX_DYN_CACHE_PERSISTENT_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#define XXH_INLINE_ALL 1
+#define XXH_NO_INLINE_HINTS 1
+#define XXH_STATIC_LINKING_ONLY 1
+#include "decoders/xxhash.h"
+
+#include "timer.h"
+
+/*  Persistent translation cache
+ *  ----------------------------
+ *  Remembers across runs where the dynamic core started its blocks, keyed by
+ *  a hash of the guest code page contents as they were when the page was
+ *  first run. When a page with the same contents is run again in a later
+ *  session, its known blocks are queued, and translated whenever the host
+ *  has time to spare between two emulated ticks instead of as execution
+ *  reaches them. Blocks execution reaches first are still translated on the
+ *  spot, so warming up never delays the guest.
+ *
+ *  Only the block starts and the CPU mode they were translated in are kept,
+ *  not the host code itself: translated code refers to the emulator's data
+ *  and functions by their absolute host addresses, which differ from run to
+ *  run. Blocks that cross into the next page aren't kept either, as the hash
+ *  only covers a single page.
+ *
+ *  The file is a PersistentCacheHeader followed by one record per page: the
+ *  64-bit hash, a 32-bit block count and that many 32-bit block entries, all
+ *  in host byte order.
+ */
+
+struct PersistentCacheHeader {
+	char magic[8]    = {'D', 'B', 'D', 'Y', 'N', 'P', 'C', 0};
+	uint32_t version = 1;
+	uint32_t reserved = 0;
+};
+
+struct PersistentCachePendingPage {
+	CodePageHandler *handler = nullptr;
+	Bitu phys_page  = 0;
+	PhysPt lin_page = 0;
+	uint64_t hash   = 0;
+	size_t next     = 0; // the next of the page's entries to translate
+};
+
+static struct {
+	bool enabled = false;
+	std::string filename = {};
+
+	// block entries by page contents; an entry is the offset in the page
+	// in the low 16 bits and the CPU mode above that
+	std::unordered_map<uint64_t, std::vector<uint32_t>> pages = {};
+	// the pages that were run in this session, which are kept first
+	std::unordered_set<uint64_t> pages_seen = {};
+	// the contents hash of each page holding dynamic code
+	std::unordered_map<Bitu, uint64_t> page_hashes = {};
+
+	// pages set up with known blocks, still to be warmed up; the newest
+	// are warmed first
+	std::vector<PersistentCachePendingPage> pending = {};
+	bool warming = false;
+} persistent_cache = {};
+
+// keeps the file from growing without bound when many programs are run
+constexpr size_t persistent_cache_max_pages = 64 * 1024;
+
+// more pages than the cache holds at a time are of no use
+constexpr size_t persistent_cache_max_pending = 1024;
+
+// the longest an x86 instruction can be
+constexpr Bitu persistent_cache_max_instruction_bytes = 15;
+
+// everything the dynamic core's translation depends on besides the code
+static uint32_t persistent_cache_mode()
+{
+	return (cpu.code.big ? 1 : 0) | (cpu.pmode ? 2 : 0) |
+	       ((reg_flags & FLAG_VM) ? 4 : 0) | (cpu.cpl << 3);
+}
+
+static void persistent_cache_load(const std::string &filename)
+{
+	// the CPU section may be set up again, but the file is only read once
+	if (persistent_cache.enabled)
+		return;
+	persistent_cache.enabled  = true;
+	persistent_cache.filename = filename;
+
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return;
+
+	const PersistentCacheHeader expected = {};
+	PersistentCacheHeader header         = {};
+	if (fread(&header, sizeof(header), 1, f) != 1 ||
+	    memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+	    header.version != expected.version) {
+		LOG_MSG("DYNCACHE: Ignoring persistent cache '%s' of another version",
+		        filename.c_str());
+		fclose(f);
+		return;
+	}
+
+	uint64_t hash = 0;
+	uint32_t num_entries = 0;
+	while (fread(&hash, sizeof(hash), 1, f) == 1 &&
+	       fread(&num_entries, sizeof(num_entries), 1, f) == 1) {
+		// a page has at most one block per byte
+		if (num_entries > 4096)
+			break;
+		auto &entries = persistent_cache.pages[hash];
+		entries.resize(num_entries);
+		if (fread(entries.data(), sizeof(uint32_t), num_entries, f) != num_entries) {
+			persistent_cache.pages.erase(hash);
+			break;
+		}
+	}
+	fclose(f);
+	LOG_MSG("DYNCACHE: Loaded %u pages from the persistent cache",
+	        static_cast<uint32_t>(persistent_cache.pages.size()));
+}
+
+static void persistent_cache_save()
+{
+	// the code pages are about to go away with the cache
+	persistent_cache.pending.clear();
+
+	if (!persistent_cache.enabled || persistent_cache.pages_seen.empty())
+		return;
+
+	FILE *f = fopen(persistent_cache.filename.c_str(), "wb");
+	if (!f) {
+		LOG_WARNING("DYNCACHE: Can't write the persistent cache to '%s'",
+		            persistent_cache.filename.c_str());
+		return;
+	}
+	const PersistentCacheHeader header = {};
+	fwrite(&header, sizeof(header), 1, f);
+
+	size_t num_pages = 0;
+	auto write_page  = [&](const uint64_t hash, const std::vector<uint32_t> &entries) {
+		const auto num_entries = static_cast<uint32_t>(entries.size());
+		fwrite(&hash, sizeof(hash), 1, f);
+		fwrite(&num_entries, sizeof(num_entries), 1, f);
+		fwrite(entries.data(), sizeof(uint32_t), num_entries, f);
+		++num_pages;
+	};
+	for (const auto &page : persistent_cache.pages)
+		if (persistent_cache.pages_seen.count(page.first) &&
+		    num_pages < persistent_cache_max_pages)
+			write_page(page.first, page.second);
+	for (const auto &page : persistent_cache.pages)
+		if (!persistent_cache.pages_seen.count(page.first) &&
+		    num_pages < persistent_cache_max_pages)
+			write_page(page.first, page.second);
+	fclose(f);
+}
+
+// Called when a page gets its CodePageHandler
+static void persistent_cache_add_page(CodePageHandler *handler,
+                                      const Bitu phys_page, const Bitu lin_page)
+{
+	if (!persistent_cache.enabled || !(handler->flags & PFLAG_READABLE))
+		return;
+	const HostPt hostmem = handler->GetHostReadPt(phys_page);
+	if (!hostmem)
+		return;
+	const uint64_t hash = XXH3_64bits(hostmem, 4096);
+	persistent_cache.page_hashes[phys_page] = hash;
+	persistent_cache.pages_seen.insert(hash);
+
+	auto &pending = persistent_cache.pending;
+	if (persistent_cache.warming || !persistent_cache.pages.count(hash) ||
+	    pending.size() >= persistent_cache_max_pending)
+		return;
+	pending.push_back({handler, phys_page, static_cast<PhysPt>(lin_page << 12), hash, 0});
+}
+
+// Called for each translated block
+static void persistent_cache_add_block(const CacheBlock *block)
+{
+	if (!persistent_cache.enabled || block->crossblock)
+		return;
+	const auto it = persistent_cache.page_hashes.find(
+	        block->page.handler->GetPhysPage());
+	if (it == persistent_cache.page_hashes.end())
+		return;
+
+	// once code in the page has been overwritten its blocks no longer
+	// belong to the contents the page was hashed with, so they're kept
+	// under the hash of what the page holds now
+	const auto handler = block->page.handler;
+	if (handler->invalidation_map && !persistent_cache.warming) {
+		const HostPt hostmem = handler->GetHostReadPt(handler->GetPhysPage());
+		if (!hostmem)
+			return;
+		it->second = XXH3_64bits(hostmem, 4096);
+		persistent_cache.pages_seen.insert(it->second);
+	}
+
+	const uint32_t entry = block->page.start | (persistent_cache_mode() << 16);
+	auto &entries = persistent_cache.pages[it->second];
+	if (std::find(entries.begin(), entries.end(), entry) == entries.end())
+		entries.push_back(entry);
+}
+
+// Blocks translated ahead of time end before an instruction that could reach
+// into the next page, as that page may not even be present; faulting on it
+// would raise an exception the guest never caused
+static bool persistent_cache_stop_decoding(const Bitu page_index)
+{
+	return persistent_cache.warming &&
+	       page_index > 4096 - persistent_cache_max_instruction_bytes;
+}
+
+// provided by the decoder of each dynamic core
+static CacheBlock *CreateCacheBlock(CodePageHandler *codepage, PhysPt start,
+                                    Bitu max_opcodes);
+
+// Whether the page still has its code page handler and is still mapped where
+// it was run. Translating may evict pages, so this is checked for each block.
+static bool persistent_cache_is_mapped(const PersistentCachePendingPage &page)
+{
+	// compared before anything is read through the handler, which may
+	// have been handed out for another page since
+	return MEM_GetPageHandler(page.phys_page) == page.handler &&
+	       get_tlb_readhandler(page.lin_page) == page.handler;
+}
+
+// Translates the blocks known from earlier sessions of the pages set up
+// lately, for as long as there's time before the deadline (in the same
+// microseconds as GetTicksUs). Blocks are only translated for the CPU mode
+// the guest is in now, and only while their page still holds the code it
+// was hashed with.
+static void persistent_cache_warm(const int64_t deadline_us)
+{
+	auto &pending = persistent_cache.pending;
+	if (pending.empty())
+		return;
+
+	const uint32_t mode = persistent_cache_mode();
+	bool is_verified    = false;
+
+	persistent_cache.warming = true;
+	while (!pending.empty() && GetTicksUs() < deadline_us) {
+		auto &page = pending.back();
+		if (!persistent_cache_is_mapped(page)) {
+			pending.pop_back();
+			is_verified = false;
+			continue;
+		}
+		// the guest may have changed the code since the page was set up
+		if (!is_verified) {
+			const HostPt hostmem = page.handler->GetHostReadPt(page.phys_page);
+			if (!hostmem || XXH3_64bits(hostmem, 4096) != page.hash) {
+				pending.pop_back();
+				continue;
+			}
+			is_verified = true;
+		}
+		const auto entries = persistent_cache.pages.find(page.hash);
+		if (entries == persistent_cache.pages.end() ||
+		    page.next >= entries->second.size()) {
+			pending.pop_back();
+			is_verified = false;
+			continue;
+		}
+		// translating needs a few spare blocks; rather than start
+		// afresh, leave the rest to be translated when it's run
+		if (cache_free_blocks < cache_min_free_blocks) {
+			pending.clear();
+			break;
+		}
+		const uint32_t entry = entries->second[page.next++];
+		const Bitu offset    = entry & 0xffff;
+		if ((entry >> 16) != mode || page.handler->FindCacheBlock(offset) ||
+		    persistent_cache_stop_decoding(offset))
+			continue;
+		CreateCacheBlock(page.handler, page.lin_page + offset, 32);
+		++cache_stats.warmed_blocks;
+	}
+	persistent_cache.warming = false;
+}
+
+#endif
@@ -19,10 +19,18 @@
 
 #include "paging.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <utility>
+#include <vector>
+
+#define XXH_INLINE_ALL 1
+#define XXH_NO_INLINE_HINTS 1
+#define XXH_STATIC_LINKING_ONLY 1
+#include "decoders/xxhash.h"
 
 #include "mem.h"
 #include "regs.h"
@@ -42,13 +50,8 @@ bool mouseBreakpoint;
 bool mouseBreakpointHit;
 bool outsideStackWriteBreakpoint;
 bool outsideStackWriteBreakpointHit;
-PhysPt memReadWatch1 = 0xDEADBEEF;
-PhysPt memReadWatch2 = 0xDEADBEEF;
-bool memReadWatchHit1 = false;
-bool memReadWatchHit2  = false;
 PhysPt memReadOverride = 0xFFFFFFFF;
 uint32_t memReadOverrideValue;
-std::vector<memwrite_entry> memwrites;
 
 
 uint8_t PageHandler::readb(PhysPt addr)
@@ -731,6 +734,16 @@ bool PAGING_ForcePageInit(Bitu lin_addr) {
 	return false;
 }
 
+// A linked TLB entry, as kept for the address spaces that aren't current
+struct tlb_link {
+	uint32_t lin_page;
+	uint32_t phys_page;
+	HostPt read;
+	HostPt write;
+	PageHandler* readhandler;
+	PageHandler* writehandler;
+};
+
 #if defined(USE_FULL_TLB)
 void PAGING_InitTLB()
 {
@@ -743,7 +756,7 @@ void PAGING_InitTLB()
 	paging.links.used=0;
 }
 
-void PAGING_ClearTLB()
+static void ClearTLBLinks()
 {
 	uint32_t * entries=&paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
@@ -754,6 +767,28 @@ void PAGING_ClearTLB()
 		paging.tlb.writehandler[page]=&init_page_handler;
 	}
 	paging.links.used=0;
+#if C_HEAVY_DEBUG
+	memwatch_stale = true;
+#endif
+}
+
+static tlb_link GetTLBLink(const uint32_t lin_page)
+{
+	return {lin_page,
+	        paging.tlb.phys_page[lin_page],
+	        paging.tlb.read[lin_page],
+	        paging.tlb.write[lin_page],
+	        paging.tlb.readhandler[lin_page],
+	        paging.tlb.writehandler[lin_page]};
+}
+
+static void SetTLBLink(const tlb_link& link)
+{
+	paging.tlb.phys_page[link.lin_page]    = link.phys_page;
+	paging.tlb.read[link.lin_page]         = link.read;
+	paging.tlb.write[link.lin_page]        = link.write;
+	paging.tlb.readhandler[link.lin_page]  = link.readhandler;
+	paging.tlb.writehandler[link.lin_page] = link.writehandler;
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
@@ -846,7 +881,7 @@ void PAGING_InitTLB()
 	paging.links.used=0;
 }
 
-void PAGING_ClearTLB()
+static void ClearTLBLinks()
 {
 	uint32_t* entries = &paging.links.entries[0];
 	for (;paging.links.used>0;paging.links.used--) {
@@ -858,6 +893,30 @@ void PAGING_ClearTLB()
 		entry->writehandler=&init_page_handler;
 	}
 	paging.links.used=0;
+#if C_HEAVY_DEBUG
+	memwatch_stale = true;
+#endif
+}
+
+static tlb_link GetTLBLink(const uint32_t lin_page)
+{
+	const tlb_entry* entry = get_tlb_entry(lin_page << 12);
+	return {lin_page,
+	        entry->phys_page,
+	        entry->read,
+	        entry->write,
+	        entry->readhandler,
+	        entry->writehandler};
+}
+
+static void SetTLBLink(const tlb_link& link)
+{
+	tlb_entry* entry    = get_tlb_entry(link.lin_page << 12);
+	entry->phys_page    = link.phys_page;
+	entry->read         = link.read;
+	entry->write        = link.write;
+	entry->readhandler  = link.readhandler;
+	entry->writehandler = link.writehandler;
 }
 
 void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
@@ -933,15 +992,188 @@ void PAGING_LinkPage_ReadOnly(uint32_t lin_page, uint32_t phys_page)
 #endif
 
 
+/*  Tagged TLB
+ *  ----------
+ *  Loading CR3 throws away every linked page, so multitasking extenders
+ *  and Windows had to fault each page in again after every task switch.
+ *  The links of the last few address spaces are now kept when switching
+ *  away from them, tagged by their CR3, and put back when the guest
+ *  switches to one of them again.
+ *
+ *  The guest may change the page tables of an address space while it isn't
+ *  current, and expects the reload of CR3 to flush what it changed. So the
+ *  page directory and the page tables the links came from are hashed when
+ *  the links are kept, and the links are only put back if none of them
+ *  changed. A physical page that gets a different handler in the meantime
+ *  drops just the kept links to it, so setting up dynamic code for a page
+ *  leaves the rest alone. Anything that flushes the whole TLB drops the kept
+ *  links as well.
+ */
+
+constexpr int num_address_spaces = 4;
+
+struct AddressSpace {
+	uint32_t cr3                = 0;
+	bool valid                  = false;
+	uint64_t last_used          = 0;
+	uint64_t dir_hash           = 0;
+	// physical page and hash of each page table used by the links
+	std::vector<std::pair<uint32_t, uint64_t>> tables = {};
+	// sorted by physical page
+	std::vector<tlb_link> links = {};
+};
+
+static AddressSpace address_spaces[num_address_spaces] = {};
+static uint64_t address_space_clock = 0;
+
+static void DropAddressSpaces()
+{
+	for (auto& space : address_spaces)
+		space.valid = false;
+}
+
+static bool HashPhysPage(const uint32_t phys_page, uint64_t& hash)
+{
+	if (phys_page >= MEM_TotalPages())
+		return false;
+	hash = XXH3_64bits(MemBase + (static_cast<size_t>(phys_page) << 12),
+	                   MEM_PAGE_SIZE);
+	return true;
+}
+
+static bool IsAddressSpaceUnchanged(const AddressSpace& space)
+{
+	uint64_t hash = 0;
+	if (!HashPhysPage(paging.base.page, hash) || hash != space.dir_hash)
+		return false;
+	for (const auto& [table_page, table_hash] : space.tables)
+		if (!HashPhysPage(table_page, hash) || hash != table_hash)
+			return false;
+	return true;
+}
+
+// Keeps the links of the current address space before CR3 changes
+static void SaveAddressSpace()
+{
+	if (!paging.links.used)
+		return;
+
+	auto space = std::min_element(std::begin(address_spaces),
+	                              std::end(address_spaces),
+	                              [](const AddressSpace& a, const AddressSpace& b) {
+		                              return a.last_used < b.last_used;
+	                              });
+	space->valid = false;
+	space->links.clear();
+	space->tables.clear();
+	if (!HashPhysPage(paging.base.page, space->dir_hash))
+		return;
+
+	for (uint32_t i = 0; i < paging.links.used; ++i) {
+		const auto link = GetTLBLink(paging.links.entries[i]);
+		if (link.readhandler == &init_page_handler)
+			continue; // unlinked since
+
+		// Only keep the links that still match the page tables, just
+		// like reloading CR3 would have refreshed any others. They were
+		// all accessed, and the fully linked ones were written to.
+		X86PageEntry table;
+		table.set(phys_readd(paging.base.addr + (link.lin_page >> 10) * 4));
+		if (!table.p || !table.a || table.base >= MEM_TotalPages())
+			continue;
+		X86PageEntry entry;
+		entry.set(phys_readd((table.base << 12) + (link.lin_page & 0x3ff) * 4));
+		if (!entry.p || !entry.a || entry.base != link.phys_page)
+			continue;
+		if (link.writehandler != &init_page_handler_userro && !entry.d)
+			continue;
+
+		space->links.push_back(link);
+		space->tables.emplace_back(static_cast<uint32_t>(table.base), 0);
+	}
+
+	std::sort(space->links.begin(), space->links.end(),
+	          [](const tlb_link& a, const tlb_link& b) {
+		          return a.phys_page < b.phys_page;
+	          });
+
+	auto& tables = space->tables;
+	std::sort(tables.begin(), tables.end());
+	tables.erase(std::unique(tables.begin(), tables.end()), tables.end());
+	for (auto& [table_page, table_hash] : tables)
+		if (!HashPhysPage(table_page, table_hash))
+			return;
+
+	space->cr3       = paging.cr3;
+	space->last_used = ++address_space_clock;
+	space->valid     = true;
+}
+
+// Puts back the links kept for the address space CR3 now points to
+static void RestoreAddressSpace()
+{
+	for (auto& space : address_spaces) {
+		if (!space.valid || space.cr3 != paging.cr3)
+			continue;
+
+		// they'll be kept again when switching away
+		space.valid = false;
+		if (!IsAddressSpaceUnchanged(space))
+			return;
+
+		assert(paging.links.used + space.links.size() <= PAGING_LINKS);
+		for (const auto& link : space.links) {
+			SetTLBLink(link);
+			paging.links.entries[paging.links.used++] = link.lin_page;
+		}
+		return;
+	}
+}
+
+void PAGING_ForgetPhysPages(const Bitu phys_page, const Bitu pages)
+{
+	const auto by_phys_page = [](const tlb_link& link, const Bitu page) {
+		return link.phys_page < page;
+	};
+	for (auto& space : address_spaces) {
+		if (!space.valid)
+			continue;
+		auto& links      = space.links;
+		const auto first = std::lower_bound(links.begin(), links.end(),
+		                                    phys_page, by_phys_page);
+		const auto last  = std::lower_bound(first, links.end(),
+		                                    phys_page + pages, by_phys_page);
+		links.erase(first, last);
+	}
+}
+
+void PAGING_ClearTLB()
+{
+	ClearTLBLinks();
+	DropAddressSpaces();
+}
+
+void PAGING_ClearCurrentTLB()
+{
+	ClearTLBLinks();
+}
+
 void PAGING_SetDirBase(Bitu cr3) {
 	assert(cr3 <= UINT32_MAX);
+	// reloading the same CR3 is how the guest flushes the TLB
+	const bool switching = paging.enabled && (paging.cr3 != cr3);
+	if (switching)
+		SaveAddressSpace();
+
 	paging.cr3=static_cast<uint32_t>(cr3);
 	
 	paging.base.page=static_cast<uint32_t>(cr3 >> 12);
 	paging.base.addr=static_cast<PhysPt>(cr3 & ~4095);
 //	LOG(LOG_PAGING,LOG_NORMAL)("CR3:%X Base %X",cr3,paging.base.page);
 	if (paging.enabled) {
-		PAGING_ClearTLB();
+		ClearTLBLinks();
+		if (switching)
+			RestoreAddressSpace();
 	}
 }
 
@@ -0,0 +1,167 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "channel_trace.h"
+
+#include <cassert>
+#include <cstdio>
+
+#include "pic.h"
+
+#if C_DEBUG
+
+int ChannelTrace::Register(const std::string& name)
+{
+	if (const auto existing = Find(name))
+		return *existing;
+
+	assert(channels.size() < trace_max_channels);
+	channels.push_back({name});
+	return NumChannels() - 1;
+}
+
+std::optional<int> ChannelTrace::Find(const std::string& name) const
+{
+	for (int i = 0; i < NumChannels(); ++i)
+		if (channels[i].name == name)
+			return i;
+	return {};
+}
+
+const std::string& ChannelTrace::Name(const int channel) const
+{
+	assert(channel >= 0 && channel < NumChannels());
+	return channels[channel].name;
+}
+
+void ChannelTrace::SetLogged(const int channel, const bool enabled)
+{
+	assert(channel >= 0 && channel < NumChannels());
+	if (enabled)
+		logged_mask |= 1u << channel;
+	else
+		logged_mask &= ~(1u << channel);
+}
+
+void ChannelTrace::SetTraced(const int channel, const bool enabled)
+{
+	assert(channel >= 0 && channel < NumChannels());
+	auto& ring = channels[channel].ring;
+	if (enabled && ring.empty())
+		ring.resize(default_capacity);
+
+	if (enabled)
+		traced_mask |= 1u << channel;
+	else
+		traced_mask &= ~(1u << channel);
+}
+
+size_t ChannelTrace::NumEvents(const int channel) const
+{
+	return channels[channel].num_entries;
+}
+
+uint64_t ChannelTrace::NumOverwritten(const int channel) const
+{
+	return channels[channel].num_overwritten;
+}
+
+void ChannelTrace::Clear()
+{
+	for (auto& channel : channels) {
+		channel.next_index      = 0;
+		channel.num_entries     = 0;
+		channel.num_overwritten = 0;
+	}
+}
+
+void ChannelTrace::Push(const int channel, TraceEvent event)
+{
+	auto& c = channels[channel];
+
+	event.timestamp      = PIC_FullIndex();
+	c.ring[c.next_index] = event;
+	if (++c.next_index == c.ring.size())
+		c.next_index = 0;
+	if (c.num_entries < c.ring.size())
+		++c.num_entries;
+	else
+		++c.num_overwritten;
+}
+
+static void write_json_event(FILE* out, const int tid, const char* cat,
+                             const TraceEvent& event)
+{
+	const auto& type = *event.type;
+
+	// Timestamps are in microseconds
+	fprintf(out, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+	        type.name, cat, type.phase, event.timestamp * 1000.0, tid);
+	if (type.phase == 'i')
+		fputs(",\"s\":\"t\"", out);
+
+	fputs(",\"args\":{", out);
+	bool first = true;
+	for (int i = 0; i < trace_max_args; ++i) {
+		if (!type.arg_names[i])
+			continue;
+		// As strings, so they show up in hex like everywhere else in
+		// the debugger
+		fprintf(out, "%s\"%s\":\"%x\"", first ? "" : ",",
+		        type.arg_names[i], event.args[i]);
+		first = false;
+	}
+	fputs("}}", out);
+}
+
+bool ChannelTrace::SaveJson(const char* filename) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+
+	// Names are registered by the debugger itself and need no escaping
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", f);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"DOSBox\"}}", f);
+
+	for (int i = 0; i < NumChannels(); ++i) {
+		const auto& c = channels[i];
+		if (!c.num_entries)
+			continue;
+
+		const int tid = i + 1;
+		fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+		        tid, c.name.c_str());
+
+		// The oldest event is the one that will be overwritten next
+		const size_t first = c.num_entries < c.ring.size() ? 0 : c.next_index;
+		for (size_t n = 0; n < c.num_entries; ++n) {
+			const size_t index = (first + n) % c.ring.size();
+			write_json_event(f, tid, c.name.c_str(), c.ring[index]);
+		}
+	}
+
+	fputs("\n]}\n", f);
+	const bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+#endif
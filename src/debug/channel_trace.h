@@ -0,0 +1,128 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CHANNEL_TRACE_H
+#define DOSBOX_CHANNEL_TRACE_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+/*  Channel event trace
+ *  -------------------
+ *  Debug output is grouped into named channels, each of which can be
+ *  logged as text, traced, or both. Channels are given a bit when they are
+ *  registered, so checking whether one is wanted is a single test of a mask
+ *  rather than a lookup by name.
+ *
+ *  Traced channels record fixed-size binary events, timestamped with the
+ *  emulated time, into a ring per channel that overwrites its oldest
+ *  events. Nothing is formatted while emulating; the rings are only turned
+ *  into Chrome trace-event JSON when saved, which chrome://tracing and
+ *  Perfetto show on a timeline with one track per channel.
+ */
+
+constexpr int trace_max_channels = 32;
+constexpr int trace_max_args     = 4;
+
+// Describes one kind of event. Instances are expected to live as long as
+// the trace, normally as static constants next to the code recording them.
+struct TraceEventType {
+	const char* name;
+	char phase; // Chrome trace-event phase: 'B'egin, 'E'nd or 'i'nstant
+	const char* arg_names[trace_max_args];
+};
+
+struct TraceEvent {
+	double timestamp; // PIC_FullIndex(), in milliseconds
+	const TraceEventType* type;
+	uint32_t args[trace_max_args];
+};
+
+class ChannelTrace {
+public:
+	static constexpr size_t default_capacity = 64 * 1024; // events per channel
+
+	// Returns the channel's index, which is also its bit in the masks, or
+	// the existing index if the name is already registered
+	int Register(const std::string& name);
+	std::optional<int> Find(const std::string& name) const;
+
+	int NumChannels() const
+	{
+		return static_cast<int>(channels.size());
+	}
+	const std::string& Name(int channel) const;
+
+	bool IsLogged(const int channel) const
+	{
+		return logged_mask & (1u << channel);
+	}
+	void SetLogged(int channel, bool enabled);
+
+	bool IsTraced(const int channel) const
+	{
+		return traced_mask & (1u << channel);
+	}
+	void SetTraced(int channel, bool enabled);
+
+	// Logged or traced
+	bool IsWanted(const int channel) const
+	{
+		return (logged_mask | traced_mask) & (1u << channel);
+	}
+
+	void Record(const int channel, const TraceEventType& type,
+	            const uint32_t arg0 = 0, const uint32_t arg1 = 0,
+	            const uint32_t arg2 = 0, const uint32_t arg3 = 0)
+	{
+		if (IsTraced(channel))
+			Push(channel, {0.0, &type, {arg0, arg1, arg2, arg3}});
+	}
+
+	size_t NumEvents(int channel) const;
+	uint64_t NumOverwritten(int channel) const;
+
+	// Drops the recorded events of all channels
+	void Clear();
+
+	// Writes the recorded events of all channels as Chrome trace-event JSON
+	bool SaveJson(const char* filename) const;
+
+private:
+	struct Channel {
+		std::string name             = {};
+		std::vector<TraceEvent> ring = {}; // allocated when first traced
+		size_t next_index            = 0;
+		size_t num_entries           = 0;
+		uint64_t num_overwritten     = 0;
+	};
+
+	void Push(int channel, TraceEvent event);
+
+	std::vector<Channel> channels = {};
+	uint32_t logged_mask          = 0;
+	uint32_t traced_mask          = 0;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "cpu_trace.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "debug_inc.h"
+#include "regs.h"
+
+void CPUTRACE_WriteText(FILE* out, const CpuTraceRecord& rec,
+                        const CpuTraceFormat format)
+{
+	assert(out);
+
+	char dline[200];
+	const auto size = DasmI386(dline, rec.code, rec.code_len, rec.eip,
+	                           rec.code_big != 0);
+	const auto flag = [&rec](const uint32_t mask) {
+		return (rec.flags & mask) ? 1 : 0;
+	};
+
+	if (format == CpuTraceFormat::Short) {
+		fprintf(out, "%04X:%04X  %-30.30s", rec.cs, rec.eip, dline);
+	} else {
+		fprintf(out, "%04X:%08X  %-30.30s", rec.cs, rec.eip, dline);
+	}
+
+	if (format == CpuTraceFormat::Long) {
+		char ibytes[3 * cpu_trace_max_code_len + 1] = "";
+		const auto num_bytes = std::min(static_cast<Bitu>(rec.code_len), size);
+		for (Bitu i = 0; i < num_bytes; ++i)
+			sprintf(ibytes + 3 * i, "%02X ", rec.code[i]);
+		for (Bitu i = num_bytes; i < size && i < cpu_trace_max_code_len; ++i)
+			sprintf(ibytes + 3 * i, "?? ");
+		fprintf(out, "  %-21s", ibytes);
+	}
+
+	fprintf(out,
+	        " EAX:%08X EBX:%08X ECX:%08X EDX:%08X ESI:%08X EDI:%08X"
+	        " EBP:%08X ESP:%08X DS:%04X ES:%04X",
+	        rec.eax, rec.ebx, rec.ecx, rec.edx, rec.esi, rec.edi, rec.ebp,
+	        rec.esp, rec.ds, rec.es);
+
+	if (format == CpuTraceFormat::Short) {
+		fprintf(out, " SS:%04X C%d Z%d S%d O%d I%d", rec.ss,
+		        flag(FLAG_CF), flag(FLAG_ZF), flag(FLAG_SF),
+		        flag(FLAG_OF), flag(FLAG_IF));
+	} else {
+		fprintf(out,
+		        " FS:%04X GS:%04X SS:%04X CF:%d ZF:%d SF:%d OF:%d AF:%d"
+		        " PF:%d IF:%d",
+		        rec.fs, rec.gs, rec.ss, flag(FLAG_CF), flag(FLAG_ZF),
+		        flag(FLAG_SF), flag(FLAG_OF), flag(FLAG_AF),
+		        flag(FLAG_PF), flag(FLAG_IF));
+	}
+
+	if (format == CpuTraceFormat::Long) {
+		fprintf(out, " TF:%d VM:%d FLG:%08X CR0:%08X", flag(FLAG_TF),
+		        flag(FLAG_VM), rec.flags, rec.cr0);
+	}
+	fputc('\n', out);
+}
@@ -0,0 +1,88 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_CPU_TRACE_H
+#define DOSBOX_CPU_TRACE_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <cstdio>
+
+#include "trace_writer.h"
+
+/*  Binary CPU trace
+ *  ----------------
+ *  The emulation thread only snapshots the registers and the raw instruction
+ *  bytes into a fixed-size record; disassembly and text rendering are left
+ *  to whoever reads the trace back, which is either the HEAVYLOG dump or the
+ *  standalone cpu_trace_decode tool.
+ *
+ *  A trace file is a CpuTraceFileHeader followed by back-to-back records in
+ *  host byte order.
+ */
+
+constexpr int cpu_trace_max_code_len = 15; // longest x86 instruction
+
+struct CpuTraceRecord {
+	uint32_t eip;
+	uint32_t eax;
+	uint32_t ebx;
+	uint32_t ecx;
+	uint32_t edx;
+	uint32_t esi;
+	uint32_t edi;
+	uint32_t ebp;
+	uint32_t esp;
+	uint32_t flags; // with the lazy flags resolved
+	uint32_t cr0;
+	uint16_t cs;
+	uint16_t ds;
+	uint16_t es;
+	uint16_t fs;
+	uint16_t gs;
+	uint16_t ss;
+	uint8_t code_big;
+	uint8_t code_len; // bytes captured, not the instruction length
+	uint8_t code[cpu_trace_max_code_len];
+	uint8_t reserved[7];
+};
+static_assert(sizeof(CpuTraceRecord) == 80, "the trace format is fixed");
+
+struct CpuTraceFileHeader {
+	char magic[8]        = {'D', 'B', 'C', 'P', 'U', 'T', 'R', 0};
+	uint32_t version     = 1;
+	uint32_t record_size = sizeof(CpuTraceRecord);
+};
+
+enum class CpuTraceFormat {
+	Short, // like LOGS
+	Normal, // like LOG
+	Long, // like LOGL, with instruction bytes, TF, VM, flags and CR0
+};
+
+// Disassembles the record and writes it as a single line of text
+void CPUTRACE_WriteText(FILE* out, const CpuTraceRecord& rec,
+                        CpuTraceFormat format);
+
+// Drains records to a binary trace file on a background thread
+using CpuTraceWriter = TraceWriter<CpuTraceRecord>;
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*  Offline decoder for the debugger's binary cpu traces (LOGB)
+ *
+ *  Usage: cpu_trace_decode [-s|-l] <trace file> [text file]
+ *
+ *  Renders every record the same way the LOG command does; -s and -l select
+ *  the LOGS and LOGL layouts. Output goes to stdout if no text file is given.
+ */
+
+#include "cpu_trace.h"
+
+#include <cstring>
+#include <vector>
+
+#include "mem.h"
+
+// The disassembler is only ever handed the bytes stored in the records, so
+// there's no guest memory to read.
+uint8_t mem_readb(PhysPt)
+{
+	return 0;
+}
+
+static int usage(const char* name)
+{
+	fprintf(stderr, "Usage: %s [-s|-l] <trace file> [text file]\n", name);
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	auto format = CpuTraceFormat::Normal;
+	int arg     = 1;
+	if (arg < argc && strcmp(argv[arg], "-s") == 0) {
+		format = CpuTraceFormat::Short;
+		++arg;
+	} else if (arg < argc && strcmp(argv[arg], "-l") == 0) {
+		format = CpuTraceFormat::Long;
+		++arg;
+	}
+	if (arg >= argc || argc - arg > 2)
+		return usage(argv[0]);
+
+	FILE* in = fopen(argv[arg], "rb");
+	if (!in) {
+		fprintf(stderr, "Can't open '%s'\n", argv[arg]);
+		return 1;
+	}
+
+	CpuTraceFileHeader header = {};
+	const CpuTraceFileHeader expected = {};
+	if (fread(&header, sizeof(header), 1, in) != 1 ||
+	    memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+	    header.version != expected.version ||
+	    header.record_size != expected.record_size) {
+		fprintf(stderr, "'%s' is not a supported cpu trace\n", argv[arg]);
+		fclose(in);
+		return 1;
+	}
+
+	FILE* out = stdout;
+	if (++arg < argc) {
+		out = fopen(argv[arg], "w");
+		if (!out) {
+			fprintf(stderr, "Can't create '%s'\n", argv[arg]);
+			fclose(in);
+			return 1;
+		}
+	}
+
+	std::vector<CpuTraceRecord> batch(4096);
+	size_t n = 0;
+	while ((n = fread(batch.data(), sizeof(CpuTraceRecord), batch.size(), in)) > 0)
+		for (size_t i = 0; i < n; ++i)
+			CPUTRACE_WriteText(out, batch[i], format);
+
+	fclose(in);
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -34,6 +34,7 @@
 #include <chrono>
 #include <iostream>
 #include <cstdio>
+#include <cassert>
 using namespace std;
 
 #include "debug.h"
@@ -64,7 +65,17 @@ using namespace std;
 #include "SIS_OpcodeID/sis_opcode.h"
 
 #include <map>
-
+#include <bitset>
+#include <optional>
+#include <unordered_map>
+
+#include "cpu_trace.h"
+#include "debug_hooks.h"
+#include "debug_regex_cache.h"
+#include "debug_watch.h"
+#include "guest_profiler.h"
+#include "memwrite_trace.h"
+#include "reverse_log.h"
 #include "debug_sis.h"
 
 SDL_Window *GFX_GetSDLWindow(void);
@@ -73,6 +84,9 @@ int old_cursor_state;
 
 // Forwards
 static void DrawCode(void);
+#if C_HEAVY_DEBUG
+static void DEBUG_RegisterHooks();
+#endif
 static void DEBUG_RaiseTimerIrq(void);
 static void SaveMemory(uint16_t seg, uint32_t ofs1, uint32_t num);
 static void SaveMemoryBin(uint16_t seg, uint32_t ofs1, uint32_t num);
@@ -86,28 +100,10 @@ static void LogCPUInfo(void);
 static void OutputVecTable(char* filename);
 static void DrawVariables(void);
 static void SaveCalltrace(char* filename);
-static void SaveMemWrites(char* filename);
 
 char* AnalyzeInstruction(char* inst, bool saveSelector);
 uint32_t GetHexValue(char* str, char*& hex);
 
-#if 0
-class DebugPageHandler final : public PageHandler {
-public:
-	Bitu readb(PhysPt /*addr*/) {
-	}
-	Bitu readw(PhysPt /*addr*/) {
-	}
-	Bitu readd(PhysPt /*addr*/) {
-	}
-	void writeb(PhysPt /*addr*/,Bitu /*val*/) {
-	}
-	void writew(PhysPt /*addr*/,Bitu /*val*/) {
-	}
-	void writed(PhysPt /*addr*/,Bitu /*val*/) {
-	}
-};
-#endif
 
 
 class DEBUG;
@@ -118,6 +114,7 @@ bool	exitLoop	= false;
 std::regex* self_regex = nullptr;
 // Saves the last address at which a regex breakpoint was triggered, for figuring out if we should skip the breakpoint
 PhysPt regex_bp_addr = 0xFFFFFFFF;
+static RegexMatchCache regex_cache;
 
 
 // Heavy Debugging Vars for logging
@@ -126,6 +123,8 @@ static ofstream 	cpuLogFile;
 static bool		cpuLog			= false;
 static int		cpuLogCounter	= 0;
 static int		cpuLogType		= 1;	// log detail
+static CpuTraceWriter	cpuTraceWriter;
+static int		cpuTraceCounter	= 0;
 static bool zeroProtect = false;
 bool	logHeavy	= false;
 #endif
@@ -162,6 +161,12 @@ uint16_t script_off_skip_end = 0xFFFF;
 
 static bool debugging = false;
 
+#if C_HEAVY_DEBUG
+// Page handlers behind the memory breakpoints and read watches
+static MemoryWatchpoints mem_watches(debugging);
+static std::optional<PhysPt> mem_read_watches[2] = {};
+#endif
+
 static void SetColor(Bitu test) {
 	if (test) {
 		if (has_colors()) { wattrset(dbg.win_reg,COLOR_PAIR(PAIR_BYELLOW_BLACK));}
@@ -455,6 +460,11 @@ void CBreakpoint::Activate(bool _active)
 			}
 		}
 	}
+#endif
+#if C_HEAVY_DEBUG
+	if (active != _active && (type == BKPNT_MEMORY || type == BKPNT_MEMORY_PROT ||
+	                          type == BKPNT_MEMORY_LINEAR))
+		memwatch_stale = true;
 #endif
 	active = _active;
 }
@@ -474,6 +484,113 @@ bool CBreakpoint::IsConditionFulfilled(uint8_t _value) noexcept
 // Statics
 static std::list<CBreakpoint *> BPoints = {};
 
+// Per-type views of BPoints, so the checks that run for every instruction
+// only look at breakpoints that can trigger there. BPoints stays the master
+// list (it defines the numbering for BPLIST/BPDEL); the index is rebuilt
+// whenever BPoints changes, which only happens on user commands and hits.
+static struct {
+	std::unordered_multimap<PhysPt, CBreakpoint *> exec = {};
+	std::unordered_multimap<uint8_t, CBreakpoint *> interrupt = {};
+	std::vector<CBreakpoint *> memory = {};
+	std::bitset<256> script_opcodes = {};
+	std::vector<CBreakpoint *> ebp_watches = {};
+	int num_return = 0;
+} bp_index;
+
+static void RebuildBreakpointIndex()
+{
+	bp_index.exec.clear();
+	bp_index.interrupt.clear();
+	bp_index.memory.clear();
+	bp_index.script_opcodes.reset();
+	bp_index.ebp_watches.clear();
+	bp_index.num_return = 0;
+
+	for (auto bp : BPoints) {
+		switch (bp->GetType()) {
+		case BKPNT_PHYSICAL:
+			bp_index.exec.emplace(bp->GetLocation(), bp);
+			break;
+		case BKPNT_INTERRUPT:
+			bp_index.interrupt.emplace(bp->GetIntNr(), bp);
+			break;
+		case BKPNT_MEMORY:
+		case BKPNT_MEMORY_PROT:
+		case BKPNT_MEMORY_LINEAR:
+			bp_index.memory.push_back(bp);
+			break;
+		case BKPNT_REG:
+			if (bp->GetReg() == REGI_BP)
+				bp_index.ebp_watches.push_back(bp);
+			break;
+		case BKPNT_RETURN:
+			bp_index.num_return++;
+			break;
+		case BKPNT_SO:
+			bp_index.script_opcodes.set(bp->GetReg());
+			break;
+		case BKPNT_UNKNOWN:
+			break;
+		}
+	}
+#if C_HEAVY_DEBUG
+	memwatch_stale = true;
+#endif
+}
+
+static void InsertBreakpoint(CBreakpoint *bp)
+{
+	BPoints.push_front(bp);
+	RebuildBreakpointIndex();
+}
+
+static void RemoveBreakpoint(CBreakpoint *bp)
+{
+	BPoints.remove(bp);
+	RebuildBreakpointIndex();
+	delete bp;
+}
+
+#if C_HEAVY_DEBUG
+// Returns false while a protected mode breakpoint's segment isn't usable
+static bool GetMemBreakpointAddress(const CBreakpoint *bp, PhysPt &address)
+{
+	if (bp->GetType() == BKPNT_MEMORY_PROT) {
+		// Watch protected mode memory only in pmode
+		if (!cpu.pmode)
+			return false;
+		// Check if descriptor is valid
+		Descriptor desc;
+		if (!cpu.gdt.GetDescriptor(bp->GetSegment(), desc))
+			return false;
+		if (desc.GetLimit() == 0)
+			return false;
+	}
+	if (bp->GetType() == BKPNT_MEMORY_LINEAR)
+		address = bp->GetOffset();
+	else
+		address = GetAddress(bp->GetSegment(), bp->GetOffset());
+	return true;
+}
+
+// Puts the watch page handlers on the pages the active memory breakpoints
+// and read watches currently map to. Runs before the next instruction
+// whenever they or the page mappings may have changed.
+static void ArmMemoryWatches()
+{
+	mem_watches.Begin();
+	for (auto bp : bp_index.memory) {
+		PhysPt address;
+		if (bp->IsActive() && GetMemBreakpointAddress(bp, address))
+			mem_watches.Watch(address, watch_write);
+	}
+	for (const auto &address : mem_read_watches)
+		if (address)
+			mem_watches.Watch(*address, watch_read);
+	mem_watches.Commit();
+}
+#endif
+
 // TODO: Why does it work like this (reminder about declaring/defining static variables)
 static bool breakOnReturn = true;
 
@@ -484,7 +601,7 @@ CBreakpoint* CBreakpoint::AddBreakpoint(uint16_t seg, uint32_t off, bool once)
 	auto bp = new CBreakpoint();
 	bp->SetAddress		(seg,off);
 	bp->SetOnce			(once);
-	BPoints.push_front	(bp);
+	InsertBreakpoint(bp);
 	return bp;
 }
 
@@ -493,7 +610,7 @@ CBreakpoint* CBreakpoint::AddIntBreakpoint(uint8_t intNum, uint16_t ah, uint16_t
 	auto bp = new CBreakpoint();
 	bp->SetInt			(intNum,ah,al);
 	bp->SetOnce			(once);
-	BPoints.push_front	(bp);
+	InsertBreakpoint(bp);
 	return bp;
 }
 
@@ -503,7 +620,7 @@ CBreakpoint* CBreakpoint::AddMemBreakpoint(uint16_t seg, uint32_t off)
 	bp->SetAddress		(seg,off);
 	bp->SetOnce			(false);
 	bp->SetType			(BKPNT_MEMORY);
-	BPoints.push_front	(bp);
+	InsertBreakpoint(bp);
 	return bp;
 }
 
@@ -519,7 +636,7 @@ CBreakpoint* CBreakpoint::AddReturnBreakpoint()
 	auto bp = new CBreakpoint();
 	bp->SetOnce(false);
 	bp->SetType(BKPNT_RETURN);
-	BPoints.push_front(bp);
+	InsertBreakpoint(bp);
 	// TODO: Handle as a singleton or in a different way
 	return bp;
 }
@@ -529,7 +646,7 @@ CBreakpoint* CBreakpoint::AddRegBreakpoint(uint8_t reg)
 {
 	auto bp = new CBreakpoint();
 	bp->SetRegister(reg);
-	BPoints.push_front(bp);
+	InsertBreakpoint(bp);
 	return bp;
 }
 
@@ -560,7 +677,7 @@ CBreakpoint* CBreakpoint::AddScriptOpcodeBreakpoint(uint8_t opcode)
 	bp->SetRegister(opcode);
 	bp->SetType(BKPNT_SO);
 	bp->SetOnce(false);
-	BPoints.push_front(bp);
+	InsertBreakpoint(bp);
 	return bp;
 }
 
@@ -597,13 +714,7 @@ void CBreakpoint::ActivateBreakpointsExceptAt(PhysPt adr)
 }
 
 bool CBreakpoint::CheckReturnBreakpoint() {
-	std::list<CBreakpoint*>::iterator i;
-	for (auto& bp : BPoints) {
-		// Do not activate breakpoints at adr
-		if (bp->GetType() == BKPNT_RETURN)
-			return true;
-	}
-	return false;
+	return bp_index.num_return > 0;
 }
 
 // Checks if breakpoint is valid and should stop execution
@@ -619,107 +730,93 @@ bool CBreakpoint::CheckBreakpoint(Bitu seg, Bitu off)
 	if (BPoints.empty()) return false;
 
 	// Search matching breakpoint
-	for (auto i = BPoints.begin(); i != BPoints.end(); ++i) {
-		auto bp = (*i);
-
-		if ((bp->GetType() == BKPNT_PHYSICAL) && bp->IsActive() &&
-		    (bp->GetLocation() == GetAddress(seg, off))) {
+	if (!bp_index.exec.empty()) {
+		const auto range = bp_index.exec.equal_range(GetAddress(seg, off));
+		for (auto i = range.first; i != range.second; ++i) {
+			auto bp = i->second;
+			if (!bp->IsActive())
+				continue;
 			// Found
 			if (bp->GetOnce()) {
 				// delete it, if it should only be used once
-				BPoints.erase(i);
 				bp->Activate(false);
-				delete bp;
+				RemoveBreakpoint(bp);
 			} else {
 				// Also look for once-only breakpoints at this address
 				bp = FindPhysBreakpoint(seg, off, true);
 				if (bp) {
-					BPoints.remove(bp);
 					bp->Activate(false);
-					delete bp;
+					RemoveBreakpoint(bp);
 				}
 			}
 			return true;
 		}
+	}
 #if C_HEAVY_DEBUG
-		// Memory breakpoint support
-		else if (bp->IsActive()) {
-			if ((bp->GetType()==BKPNT_MEMORY) || (bp->GetType()==BKPNT_MEMORY_PROT) || (bp->GetType()==BKPNT_MEMORY_LINEAR)) {
-				// Watch Protected Mode Memoryonly in pmode
-				if (bp->GetType()==BKPNT_MEMORY_PROT) {
-					// Check if pmode is active
-					if (!cpu.pmode) return false;
-					// Check if descriptor is valid
-					Descriptor desc;
-					if (!cpu.gdt.GetDescriptor(bp->GetSegment(),desc)) return false;
-					if (desc.GetLimit()==0) return false;
+	// Memory breakpoint support; the values only need a look after a write
+	// to one of the watched bytes
+	if (mem_watches.HasHits(watch_write)) {
+		bool keep_hits = false;
+		for (auto bp : bp_index.memory) {
+			if (!bp->IsActive())
+				continue;
+			PhysPt address;
+			if (!GetMemBreakpointAddress(bp, address))
+				continue;
+			uint8_t value = 0;
+			if (mem_readb_checked(address, &value))
+				continue;
+			if (bp->IsConditionFulfilled(value)) {
+				// TODO: Hardcoded check - make sure we are in game code
+				uint16_t bpSeg = SegValue(cs);
+				if (!(bpSeg == 0x01F7 || bpSeg == 0x01E7 ||
+				      bpSeg == 0x01D7 || bpSeg == 0x0217)) {
+					// Look again once we're back in game code
+					keep_hits = true;
+					continue;
 				}
 
-				Bitu address; 
-				if (bp->GetType()==BKPNT_MEMORY_LINEAR) address = bp->GetOffset();
-				else address = GetAddress(bp->GetSegment(),bp->GetOffset());
-				uint8_t value=0;
-				if (mem_readb_checked(address,&value)) return false;
-				if (bp->IsConditionFulfilled(value)) {
-					// TODO: Hardcoded check - make sure we are in game code
-					uint16_t bpSeg = SegValue(cs);
-					if (!(bpSeg == 0x01F7 || bpSeg == 0x01E7 || bpSeg == 0x01D7 || bpSeg == 0x0217)) {
-						return false;
-					}
-				
-						// Yup, memory value changed
-						DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",
-						              (bp->GetType() ==
-						               BKPNT_MEMORY_PROT)
-						                      ? "(Prot)"
-						                      : "",
-						              bp->GetSegment(),
-						              bp->GetOffset(),
-						              bp->GetValue(),
-						              value);
-							// TODO: Duplicated, as we need to change the value in any case. There should be a better place to put this update.
-					        bp->SetValue(value);
-						return true;
-				}
+				// Yup, memory value changed
+				DEBUG_ShowMsg("DEBUG: Memory breakpoint %s: %04X:%04X - %02X -> %02X\n",
+				              (bp->GetType() == BKPNT_MEMORY_PROT) ? "(Prot)" : "",
+				              bp->GetSegment(),
+				              bp->GetOffset(),
+				              bp->GetValue(),
+				              value);
 				bp->SetValue(value);
+				mem_watches.ClearHits(watch_write);
+				return true;
 			}
+			bp->SetValue(value);
 		}
+		if (!keep_hits)
+			mem_watches.ClearHits(watch_write);
+	}
 #endif
-		if (bp->GetType() == BKPNT_SO) {
-			if (seg == 0x01E7 && off == 0xDB8E) {
-				if (bp->GetReg() == reg_al) {
-					uint16_t script_offset;
-					uint16_t script_seg;
-					uint16_t script_off;
-					SIS_GetScriptInfos(script_offset,
-					                   script_seg,
-					                   script_off);
-					DEBUG_ShowMsg("DEBUG: Script opcode breakpoint %.2x at offset %.4x (%.4x:%.4x)\n",
-					              reg_al,
-					              script_offset,
-					              script_seg,
-					              script_off);
-					return true;
-				}
-			}
-		}
+	if (seg == 0x01E7 && off == 0xDB8E && bp_index.script_opcodes.test(reg_al)) {
+		uint16_t script_offset;
+		uint16_t script_seg;
+		uint16_t script_off;
+		SIS_GetScriptInfos(script_offset,
+		                   script_seg,
+		                   script_off);
+		DEBUG_ShowMsg("DEBUG: Script opcode breakpoint %.2x at offset %.4x (%.4x:%.4x)\n",
+		              reg_al,
+		              script_offset,
+		              script_seg,
+		              script_off);
+		return true;
 	}
 	return false;
 }
 
 bool CBreakpoint::CheckRegBreakpoint() {
-	if (BPoints.empty())
+	// BP is the only register that can be watched so far
+	if (oldregs.ebp == reg_ebp)
 		return false;
-
-	for (auto i = BPoints.begin(); i != BPoints.end(); ++i) {
-		auto bp = (*i);
-		if ((bp->GetType() == BKPNT_REG) && bp->IsActive()) {
-			if (bp->GetReg() == REGI_BP) {
-				if (oldregs.ebp != reg_ebp) {
-					return true;
-				}
-			}
-		}
+	for (auto bp : bp_index.ebp_watches) {
+		if (bp->IsActive())
+			return true;
 	}
 	return false;
 }
@@ -727,13 +824,11 @@ bool CBreakpoint::CheckRegBreakpoint() {
 bool CBreakpoint::CheckIntBreakpoint([[maybe_unused]] PhysPt adr, uint8_t intNr, uint16_t ahValue, uint16_t alValue)
 // Checks if interrupt breakpoint is valid and should stop execution
 {
-	if (BPoints.empty()) return false;
-
 	// Search matching breakpoint
-	for (auto i = BPoints.begin(); i != BPoints.end(); ++i) {
-		auto bp = (*i);
-		if ((bp->GetType() == BKPNT_INTERRUPT) && bp->IsActive() &&
-		    (bp->GetIntNr() == intNr)) {
+	const auto range = bp_index.interrupt.equal_range(intNr);
+	for (auto i = range.first; i != range.second; ++i) {
+		auto bp = i->second;
+		if (bp->IsActive()) {
 			if (((bp->GetValue() == BPINT_ALL) ||
 			     (bp->GetValue() == ahValue)) &&
 			    ((bp->GetOther() == BPINT_ALL) ||
@@ -742,9 +837,8 @@ bool CBreakpoint::CheckIntBreakpoint([[maybe_unused]] PhysPt adr, uint8_t intNr,
 				// Found
 				if (bp->GetOnce()) {
 					// delete it, if it should only be used once
-					BPoints.erase(i);
 					bp->Activate(false);
-					delete bp;
+					RemoveBreakpoint(bp);
 				}
 				return true;
 			}
@@ -760,6 +854,7 @@ void CBreakpoint::DeleteAll()
 		delete bp;
 	}
 	BPoints.clear();
+	RebuildBreakpointIndex();
 }
 
 bool CBreakpoint::DeleteByIndex(uint16_t index)
@@ -772,20 +867,20 @@ bool CBreakpoint::DeleteByIndex(uint16_t index)
 	std::advance(it, index);
 	auto bp = *it;
 
-	BPoints.erase(it);
 	bp->Activate(false);
-	delete bp;
+	RemoveBreakpoint(bp);
 	return true;
 }
 
 CBreakpoint* CBreakpoint::FindPhysBreakpoint(uint16_t seg, uint32_t off, bool once)
 {
-	if (BPoints.empty()) return nullptr;
+	if (bp_index.exec.empty()) return nullptr;
 #if !C_HEAVY_DEBUG
 	PhysPt adr = GetAddress(seg, off);
 #endif
 	// Search for matching breakpoint
-	for (auto &bp : BPoints) {
+	for (auto &entry : bp_index.exec) {
+		auto bp = entry.second;
 #	if C_HEAVY_DEBUG
 		// Heavy debugging breakpoints are triggered by matching seg:off
 		bool atLocation = bp->GetSegment() == seg && bp->GetOffset() == off;
@@ -794,7 +889,7 @@ CBreakpoint* CBreakpoint::FindPhysBreakpoint(uint16_t seg, uint32_t off, bool on
 		bool atLocation = bp->GetLocation() == adr;
 #endif
 
-		if (bp->GetType() == BKPNT_PHYSICAL && atLocation && bp->GetOnce() == once)
+		if (atLocation && bp->GetOnce() == once)
 			return bp;
 	}
 
@@ -803,9 +898,10 @@ CBreakpoint* CBreakpoint::FindPhysBreakpoint(uint16_t seg, uint32_t off, bool on
 
 CBreakpoint* CBreakpoint::FindOtherActiveBreakpoint(PhysPt adr, CBreakpoint* skip)
 {
-	for (auto &bp : BPoints)
-		if (bp != skip && bp->GetType() == BKPNT_PHYSICAL && bp->GetLocation() == adr && bp->IsActive())
-			return bp;
+	const auto range = bp_index.exec.equal_range(adr);
+	for (auto i = range.first; i != range.second; ++i)
+		if (i->second != skip && i->second->IsActive())
+			return i->second;
 	return nullptr;
 }
 
@@ -819,8 +915,7 @@ bool CBreakpoint::DeleteBreakpoint(uint16_t seg, uint32_t off)
 {
 	CBreakpoint* bp = FindPhysBreakpoint(seg, off, false);
 	if (bp) {
-		BPoints.remove(bp);
-		delete bp;
+		RemoveBreakpoint(bp);
 		return true;
 	}
 
@@ -1231,14 +1326,9 @@ extern bool mouseBreakpoint;
 extern bool mouseBreakpointHit;
 extern bool outsideStackWriteBreakpoint;
 extern bool outsideStackWriteBreakpointHit;
-extern PhysPt memReadWatch1;
-extern PhysPt memReadWatch2;
-extern bool memReadWatchHit1;
-extern bool memReadWatchHit2;
 extern PhysPt memReadOverride;
 extern uint32_t memReadOverrideValue;
-std::map<std::string, SIS_ChannelID> channelIDNames;
-std::map<SIS_ChannelID, bool> debugLogEnabledID;
+ChannelTrace sis_channels;
 
 void DrawBackBuffer(uint16_t source_segment, uint16_t target_offset, uint16_t length) {
 	constexpr auto palette_map = vga.dac.palette_map;
@@ -1452,11 +1542,10 @@ bool ParseCommand(char* str) {
 		}
 		source[50] = 0;
 
-		if (source[0] == 0) {
-			delete self_regex;
-			self_regex = nullptr;
-		}
-		else {
+		regex_cache.Clear();
+		delete self_regex;
+		self_regex = nullptr;
+		if (source[0] != 0) {
 			self_regex = new std::regex(source, std::regex_constants::ECMAScript | std::regex_constants::icase);
 		}
 		return true;
@@ -1467,7 +1556,8 @@ bool ParseCommand(char* str) {
 		found++; // skip ":"
 		uint32_t ofs = GetHexValue(found, found);
 
-		memReadWatch1 = GetAddress(seg, ofs);
+		mem_read_watches[0] = GetAddress(seg, ofs);
+		memwatch_stale      = true;
 		DEBUG_ShowMsg("DEBUG: Set memory read watch address 1 to %04X:%04X\n",
 		              seg,
 		              ofs);
@@ -1478,7 +1568,8 @@ bool ParseCommand(char* str) {
 		found++; // skip ":"
 		uint32_t ofs = GetHexValue(found, found);
 
-		memReadWatch2 = GetAddress(seg, ofs);
+		mem_read_watches[1] = GetAddress(seg, ofs);
+		memwatch_stale      = true;
 		DEBUG_ShowMsg("DEBUG: Set memory read watch address 2 to %04X:%04X\n",
 		              seg,
 		              ofs);
@@ -1511,12 +1602,12 @@ bool ParseCommand(char* str) {
 		}
 		
 
-		if (channelIDNames.count(found) == 1) {
-			SIS_ChannelID foundID     = channelIDNames[found];
-			debugLogEnabledID[foundID] = !debugLogEnabledID[foundID];
+		if (const auto channel = sis_channels.Find(found)) {
+			const bool enable = !sis_channels.IsLogged(*channel);
+			sis_channels.SetLogged(*channel, enable);
 			DEBUG_ShowMsg("DEBUG: Setting debug channel %s to %u\n",
 			              found,
-			              debugLogEnabledID[foundID]);
+			              enable);
 		} else {
 			DEBUG_ShowMsg("Unknown debug log channel %s\n", found);
 		}
@@ -1524,14 +1615,49 @@ bool ParseCommand(char* str) {
 	}
 
 	if (command == "CHANNELLIST") {
-		DEBUG_ShowMsg("DEBUG: Log channels:\n");
-		for (auto it = channelIDNames.begin(); it != channelIDNames.end(); it++) {
-			std::string currentName = it->first;
-			SIS_ChannelID currentID = it->second;
-			DEBUG_ShowMsg("%s: %u\n",
-			              currentName.c_str(),
-			              debugLogEnabledID[currentID]);
+		DEBUG_ShowMsg("DEBUG: Log channels (logged, traced, events):\n");
+		for (int i = 0; i < sis_channels.NumChannels(); ++i) {
+			DEBUG_ShowMsg("%s: %u %u %u\n",
+			              sis_channels.Name(i).c_str(),
+			              sis_channels.IsLogged(i),
+			              sis_channels.IsTraced(i),
+			              static_cast<unsigned>(sis_channels.NumEvents(i)));
+		}
+		return true;
+	}
+
+	if (command == "CHTRACE") { // Toggle event tracing of a channel
+		while (*found == ' ') {
+			found++;
+		}
+		if (const auto channel = sis_channels.Find(found)) {
+			const bool enable = !sis_channels.IsTraced(*channel);
+			sis_channels.SetTraced(*channel, enable);
+			DEBUG_ShowMsg("DEBUG: Tracing of channel %s %s.\n",
+			              found,
+			              enable ? "enabled" : "disabled");
+		} else {
+			DEBUG_ShowMsg("Unknown debug log channel %s\n", found);
+		}
+		return true;
+	}
+
+	if (command == "CHTRACESAVE") { // Write the traced events as JSON
+		while (*found == ' ') {
+			found++;
 		}
+		const char* filename = *found ? found : "channeltrace.json";
+		if (sis_channels.SaveJson(filename))
+			DEBUG_ShowMsg("DEBUG: Channel trace written to %s.\n", filename);
+		else
+			DEBUG_ShowMsg("DEBUG: Failed to write channel trace to %s.\n",
+			              filename);
+		return true;
+	}
+
+	if (command == "CHTRACECLEAR") {
+		sis_channels.Clear();
+		DEBUG_ShowMsg("DEBUG: Channel trace cleared.\n");
 		return true;
 	}
 
@@ -1631,7 +1757,120 @@ bool ParseCommand(char* str) {
 	if (command == "BPMW") { // Set a breakpoint on memory writes outside of the stack
 		outsideStackWriteBreakpoint = !outsideStackWriteBreakpoint;
 		outsideStackWriteBreakpointHit = false;
-		memwrites.clear();
+		// Records the writes for DUMPMW as well, starting afresh unless
+		// they're already being traced with MWT
+		if (outsideStackWriteBreakpoint) {
+			memwrite_trace.Allocate();
+			if (!memwrite_trace.IsRecording())
+				memwrite_trace.Clear();
+		}
+		MEMTRACE_UpdateActive();
+		return true;
+	}
+
+	if (command == "MWT") { // Toggle memory write tracing
+		const uint32_t capacity = GetHexValue(found, found);
+		if (!memwrite_trace.IsRecording() && capacity)
+			memwrite_trace.Resize(capacity);
+		memwrite_trace.SetRecording(!memwrite_trace.IsRecording());
+		DEBUG_ShowMsg("DEBUG: Memory write trace %s, %u writes recorded, %" PRIu64 " overwritten.\n",
+		              memwrite_trace.IsRecording() ? "on" : "off",
+		              static_cast<uint32_t>(memwrite_trace.Size()),
+		              memwrite_trace.NumOverwritten());
+		return true;
+	}
+
+	if (command == "REV") { // Toggle recording for reverse stepping
+		const uint32_t num_instructions = GetHexValue(found, found);
+		if (reverse_log.IsRecording()) {
+			reverse_log.SetRecording(false);
+		} else {
+			reverse_log.SetRecording(true, num_instructions
+			                                       ? num_instructions
+			                                       : ReverseLog::default_instructions);
+		}
+		DEBUG_ShowMsg("DEBUG: Reverse execution log %s.\n",
+		              reverse_log.IsRecording() ? "on" : "off");
+		return true;
+	}
+
+	if (command == "SB") { // Step back
+		uint32_t count = GetHexValue(found, found);
+		if (!count)
+			count = 1;
+		const auto undone = reverse_log.StepBack(count);
+		DEBUG_ShowMsg("DEBUG: Stepped back %u instructions, %u more in the log, %" PRIu64 " writes lost.\n",
+		              static_cast<uint32_t>(undone),
+		              static_cast<uint32_t>(reverse_log.NumInstructions()),
+		              reverse_log.NumLostWrites());
+		SetCodeWinStart();
+		return true;
+	}
+
+	if (command == "SBW") { // Step back to the last write of an address
+		const uint16_t seg = (uint16_t)GetHexValue(found, found); found++;
+		const uint32_t ofs = GetHexValue(found, found);
+		const auto undone = reverse_log.StepBackToWrite(GetAddress(seg, ofs));
+		if (undone)
+			DEBUG_ShowMsg("DEBUG: Stepped back %u instructions to the last write of %04X:%04X.\n",
+			              static_cast<uint32_t>(undone), seg, ofs);
+		else
+			DEBUG_ShowMsg("DEBUG: No write of %04X:%04X in the reverse execution log.\n",
+			              seg, ofs);
+		SetCodeWinStart();
+		return true;
+	}
+
+	if (command == "MWTA") { // Limit memory write tracing to an address range
+		while (found[0] == ' ') found++;
+		if (found[0] == 0) {
+			memwrite_trace.ClearAddressFilter();
+			DEBUG_ShowMsg("DEBUG: Memory write trace address filter cleared.\n");
+			return true;
+		}
+		const uint16_t seg = (uint16_t)GetHexValue(found, found); found++;
+		const uint32_t ofs = GetHexValue(found, found);
+		const uint32_t len = GetHexValue(found, found);
+		const PhysPt first = GetAddress(seg, ofs);
+		memwrite_trace.SetAddressFilter(first, first + (len ? len - 1 : 0));
+		DEBUG_ShowMsg("DEBUG: Tracing memory writes to %04X:%04X, %X bytes.\n", seg, ofs, len ? len : 1);
+		return true;
+	}
+
+	if (command == "MWTCS") { // Limit memory write tracing to a code segment
+		while (found[0] == ' ') found++;
+		if (found[0] == 0) {
+			memwrite_trace.ClearCsFilter();
+			DEBUG_ShowMsg("DEBUG: Memory write trace CS filter cleared.\n");
+			return true;
+		}
+		const uint16_t seg = (uint16_t)GetHexValue(found, found);
+		memwrite_trace.SetCsFilter(seg);
+		DEBUG_ShowMsg("DEBUG: Tracing memory writes from code in %04X.\n", seg);
+		return true;
+	}
+
+	if (command == "MWTS") { // Stream traced memory writes to a file
+		char name[13];
+		for (int i = 0; i < 12; i++) {
+			if (found[i] && (found[i] != ' '))
+				name[i] = found[i];
+			else {
+				name[i] = 0;
+				break;
+			}
+		}
+		name[12] = 0;
+		if (!name[0]) {
+			memwrite_trace.StopStreaming();
+			DEBUG_ShowMsg("DEBUG: Memory write streaming stopped.\n");
+			return true;
+		}
+		if (!memwrite_trace.StartStreaming(name)) {
+			DEBUG_ShowMsg("DEBUG: Streaming memory writes failed!\n");
+			return false;
+		}
+		DEBUG_ShowMsg("DEBUG: Streaming memory writes to %s.\n", name);
 		return true;
 	}
 
@@ -1649,9 +1888,10 @@ bool ParseCommand(char* str) {
 		if (!name[0])
 			return false;
 
-		SaveMemWrites(name);
-
-		// Write the file
+		if (memwrite_trace.Save(name))
+			DEBUG_ShowMsg("DEBUG: Save mem writes complete.\n");
+		else
+			DEBUG_ShowMsg("DEBUG: Write mem writes failed!\n");
 		return true;
 	}
 
@@ -1870,6 +2110,25 @@ bool ParseCommand(char* str) {
 		return true;
 	}
 
+	if (command == "LOGB") { // Create binary cpu trace
+		const std_fs::path log_cpu_bin = "LOGCPU.BIN";
+		const CpuTraceFileHeader header = {};
+		// Finish a trace that is still being written before reopening
+		cpuTraceWriter.Stop();
+		if (!cpuTraceWriter.Start(log_cpu_bin.string().c_str(), &header, sizeof(header))) {
+			DEBUG_ShowMsg("DEBUG: Tracefile couldn't be created.\n");
+			return false;
+		}
+		DEBUG_ShowMsg("DEBUG: Tracefile '%s' created.\n",
+		              std_fs::absolute(log_cpu_bin).string().c_str());
+		cpuTraceCounter = GetHexValue(found,found);
+
+		debugging = false;
+		CBreakpoint::ActivateBreakpointsExceptAt(SegPhys(cs)+reg_eip);
+		DOSBOX_SetNormalLoop();
+		return true;
+	}
+
 #endif
 
 	if (command == "INTT") { //trace int.
@@ -1945,6 +2204,92 @@ bool ParseCommand(char* str) {
 		return true;
 	}
 
+	if (command == "PROF" || command == "PROFNEAR") { // Toggle the profiler
+		const uint32_t interval_us = GetHexValue(found, found);
+		if (guest_profiler.IsRunning()) {
+			guest_profiler.Stop();
+			DEBUG_ShowMsg("DEBUG: Profiler off, %" PRIu64 " samples in %u stacks.\n",
+			              guest_profiler.NumSamples(),
+			              static_cast<uint32_t>(guest_profiler.NumStacks()));
+		} else {
+			const double interval_ms = interval_us
+			                                 ? interval_us / 1000.0
+			                                 : GuestProfiler::default_interval_ms;
+			guest_profiler.Start(interval_ms, command == "PROFNEAR");
+			DEBUG_ShowMsg("DEBUG: Profiler on, sampling every %.3f ms.\n",
+			              interval_ms);
+		}
+		return true;
+	}
+
+	if (command == "PROFSAVE") { // Write the profile as folded stacks
+		while (*found == ' ') {
+			found++;
+		}
+		const char* filename = *found ? found : "profile.folded";
+		if (guest_profiler.SaveFolded(filename))
+			DEBUG_ShowMsg("DEBUG: Profile written to %s.\n", filename);
+		else
+			DEBUG_ShowMsg("DEBUG: Failed to write profile to %s.\n", filename);
+		return true;
+	}
+
+	if (command == "PROFCLEAR") {
+		guest_profiler.Clear();
+		DEBUG_ShowMsg("DEBUG: Profile cleared.\n");
+		return true;
+	}
+
+	if (command == "DYNPROF") { // Toggle the dynrec block counters
+		const bool enable = !CPU_IsDynrecBlockProfiling();
+		if (CPU_SetDynrecBlockProfiling(enable))
+			DEBUG_ShowMsg("DEBUG: Dynamic core block profiling %s.\n",
+			              enable ? "on" : "off");
+		else
+			DEBUG_ShowMsg("DEBUG: Block profiling needs the dynrec core.\n");
+		return true;
+	}
+
+	if (command == "HOTBLOCKS") { // Show the hottest translated blocks
+		uint32_t num_blocks = GetHexValue(found, found);
+		if (!num_blocks)
+			num_blocks = 0x10;
+		if (!CPU_IsDynrecBlockProfiling())
+			DEBUG_ShowMsg("DEBUG: Block profiling is off, enable it with DYNPROF.\n");
+		DEBUG_ShowMsg("Guest code (phys)   Entries   Cycles    Host bytes\n");
+		for (const auto& block : CPU_GetDynrecHotBlocks(num_blocks))
+			DEBUG_ShowMsg("%08X-%08X %08X  %08X  %X\n",
+			              block.first_byte,
+			              block.last_byte,
+			              block.entries,
+			              block.cycles,
+			              static_cast<uint32_t>(block.host_bytes));
+		return true;
+	}
+
+	if (command == "DYNCACHE") { // Show the translation cache counters
+		DynamicCacheStats stats = {};
+		if (!CPU_GetDynamicCacheStats(stats)) {
+			DEBUG_ShowMsg("DEBUG: There's no dynamic core.\n");
+			return true;
+		}
+		DEBUG_ShowMsg("DEBUG: Dynamic core cache of %u MB\n",
+		              static_cast<uint32_t>(stats.cache_bytes / (1024 * 1024)));
+		DEBUG_ShowMsg("Translations:   %" PRIu64 " (%" PRIu64 " again)\n",
+		              stats.translations, stats.retranslations);
+		DEBUG_ShowMsg("Evicted blocks: %" PRIu64 " (%" PRIu64 " spared)\n",
+		              stats.evicted_blocks, stats.spared_blocks);
+		DEBUG_ShowMsg("Evicted pages:  %" PRIu64 "\n", stats.evicted_pages);
+		DEBUG_ShowMsg("Wraps:          %" PRIu64 "\n", stats.wraps);
+		DEBUG_ShowMsg("Flushes:        %" PRIu64 "\n", stats.flushes);
+		DEBUG_ShowMsg("Dead flag ops:  %" PRIu64 "\n", stats.dead_flag_ops);
+		DEBUG_ShowMsg("Traces:         %" PRIu64 "\n", stats.traces);
+		DEBUG_ShowMsg("Trace cuts:     %" PRIu64 "\n", stats.trace_cuts);
+		DEBUG_ShowMsg("Warmed blocks:  %" PRIu64 "\n", stats.warmed_blocks);
+		DEBUG_ShowMsg("Translate time: %" PRId64 " ms\n", stats.translate_us / 1000);
+		return true;
+	}
+
 
 #if C_HEAVY_DEBUG
 	if (command == "HEAVYLOG") { // Create Cpu log file
@@ -1980,8 +2325,20 @@ bool ParseCommand(char* str) {
 #if C_HEAVY_DEBUG
 		DEBUG_ShowMsg("LOG [num]                 - Write cpu log file.\n");
 		DEBUG_ShowMsg("LOGS/LOGL/LOGC [num]      - Write short/long/cs:ip-only cpu log file.\n");
+		DEBUG_ShowMsg("LOGB [num]                - Write binary cpu trace, see cpu_trace_decode.\n");
 		DEBUG_ShowMsg("HEAVYLOG                  - Enable/Disable automatic cpu log when DOSBox exits.\n");
 		DEBUG_ShowMsg("ZEROPROTECT               - Enable/Disable zero code execution detection.\n");
+		DEBUG_ShowMsg("MWT [size]                - Enable/Disable memory write trace, keeping the last size writes.\n");
+		DEBUG_ShowMsg("MWTA [seg]:[off] [len]    - Only trace writes to this range, none to clear.\n");
+		DEBUG_ShowMsg("MWTCS [seg]               - Only trace writes by code in this segment, none to clear.\n");
+		DEBUG_ShowMsg("MWTS [filename]           - Stream traced writes to file, none to stop.\n");
+		DEBUG_ShowMsg("DUMPMW [filename]         - Write the traced memory writes to file.\n");
+		DEBUG_ShowMsg("REV [num]                 - Enable/Disable reverse execution log for the last num instructions.\n");
+		DEBUG_ShowMsg("SB [count]                - Step back count instructions, needs REV.\n");
+		DEBUG_ShowMsg("SBW [seg]:[off]           - Step back to the last write of this address, needs REV.\n");
+		DEBUG_ShowMsg("CHTRACE [channel]         - Enable/Disable event tracing of a debug channel.\n");
+		DEBUG_ShowMsg("CHTRACESAVE [filename]    - Write the traced events as Chrome trace JSON.\n");
+		DEBUG_ShowMsg("CHTRACECLEAR              - Drop the traced events.\n");
 #endif
 		DEBUG_ShowMsg("SR [reg] [value]          - Set register value.\n");
 		DEBUG_ShowMsg("SM [seg]:[off] [val] [.]..- Set memory with following values.\n");
@@ -2006,6 +2363,13 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("PAGING [page]             - Display content of page table.\n");
 		DEBUG_ShowMsg("EXTEND                    - Toggle additional info.\n");
 		DEBUG_ShowMsg("TIMERIRQ                  - Run the system timer.\n");
+		DEBUG_ShowMsg("PROF [interval]           - Enable/Disable the profiler, sampling every interval us.\n");
+		DEBUG_ShowMsg("PROFNEAR [interval]       - Same, for 16-bit code using near calls.\n");
+		DEBUG_ShowMsg("PROFSAVE [filename]       - Write the profile as folded stacks for flamegraphs.\n");
+		DEBUG_ShowMsg("PROFCLEAR                 - Drop the profiler samples.\n");
+		DEBUG_ShowMsg("DYNPROF                   - Enable/Disable dynrec block counters, retranslating all code.\n");
+		DEBUG_ShowMsg("HOTBLOCKS [num]           - Show the num dynrec blocks that used the most cycles.\n");
+		DEBUG_ShowMsg("DYNCACHE                  - Show translations and evictions of the dynamic core.\n");
 
 		DEBUG_ShowMsg("HELP                      - Help\n");
 		DEBUG_ShowMsg("Keys------------------------------------------------\n");
@@ -2938,6 +3302,9 @@ void DEBUG_Init(Section* sec) {
 	
 
 	SIS_Init();
+#if C_HEAVY_DEBUG
+	DEBUG_RegisterHooks();
+#endif
 }
 
 // DEBUGGING VAR STUFF
@@ -3158,40 +3525,6 @@ static void SaveCalltrace(char* filename)
 	DEBUG_ShowMsg("DEBUG: Save calltrace complete.\n");
 }
 
-static void SaveMemWrites(char* filename) {
-	// Save the file
-	FILE* f = fopen(filename, "wb");
-	if (!f) {
-		DEBUG_ShowMsg("DEBUG: Write mem writes failed!\n");
-		return;
-	}
-
-
-	for (auto& current : memwrites) {
-		fprintf(f,
-		        "%04X:%04X %01X %02X %04X\n",
-		        current.caller_seg,
-		        current.caller_off,
-		        current.size,
-		        current.value,
-				current.address);
-		/* current
-		
-		if (current.is_call) {
-			fprintf(f, "CALL: ");
-		} else {
-			fprintf(f, "RET:  ");
-		}
-		fprintf(f,
-		        "%04X:%04X --> %04X:%04X\n",
-		        current.caller_seg,
-		        current.caller_off,
-		        current.callee_seg,
-		        current.callee_off); */
-	}
-	fclose(f);
-	DEBUG_ShowMsg("DEBUG: Save mem writes complete.\n");
-}
 
 
 
@@ -3267,81 +3600,52 @@ const uint32_t LOGCPUMAX = 20000;
 
 static uint32_t logCount = 0;
 
-struct TLogInst {
-	uint16_t s_cs;
-	uint32_t eip;
-	uint32_t eax;
-	uint32_t ebx;
-	uint32_t ecx;
-	uint32_t edx;
-	uint32_t esi;
-	uint32_t edi;
-	uint32_t ebp;
-	uint32_t esp;
-	uint16_t s_ds;
-	uint16_t s_es;
-	uint16_t s_fs;
-	uint16_t s_gs;
-	uint16_t s_ss;
-	bool c;
-	bool z;
-	bool s;
-	bool o;
-	bool a;
-	bool p;
-	bool i;
-	char dline[31];
-	char res[23];
-};
-
-TLogInst logInst[LOGCPUMAX];
+static CpuTraceRecord logInst[LOGCPUMAX];
 
-void DEBUG_HeavyLogInstruction()
+// Snapshots the state needed to reproduce the LOG output later, without
+// disassembling anything.
+static void CaptureTraceRecord(CpuTraceRecord &rec)
 {
-	static char empty[23] = { 32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,32,0 };
-
-	PhysPt start = GetAddress(SegValue(cs),reg_eip);
-	char dline[200];
-	DasmI386(dline, start, reg_eip, cpu.code.big);
-	char* res = empty;
-	if (showExtend) {
-		res = AnalyzeInstruction(dline,false);
-		if (!res || !(*res)) res = empty;
-		Bitu reslen = strlen(res);
-		if (reslen < 22) memset(res + reslen, ' ',22 - reslen);
-		res[22] = 0;
+	rec.eip   = reg_eip;
+	rec.eax   = reg_eax;
+	rec.ebx   = reg_ebx;
+	rec.ecx   = reg_ecx;
+	rec.edx   = reg_edx;
+	rec.esi   = reg_esi;
+	rec.edi   = reg_edi;
+	rec.ebp   = reg_ebp;
+	rec.esp   = reg_esp;
+	rec.flags = (reg_flags & ~FMASK_TEST) |
+	            (get_CF() ? FLAG_CF : 0) | (get_PF() ? FLAG_PF : 0) |
+	            (get_AF() ? FLAG_AF : 0) | (get_ZF() ? FLAG_ZF : 0) |
+	            (get_SF() ? FLAG_SF : 0) | (get_OF() ? FLAG_OF : 0);
+	rec.cr0   = static_cast<uint32_t>(cpu.cr0);
+	rec.cs    = SegValue(cs);
+	rec.ds    = SegValue(ds);
+	rec.es    = SegValue(es);
+	rec.fs    = SegValue(fs);
+	rec.gs    = SegValue(gs);
+	rec.ss    = SegValue(ss);
+	rec.code_big = cpu.code.big ? 1 : 0;
+
+	// Grab the instruction bytes straight from the TLB when they don't
+	// cross into the next page, which is nearly always.
+	const PhysPt start = SegPhys(cs) + reg_eip;
+	const HostPt tlb_addr = get_tlb_read(start);
+	if (tlb_addr && (start & (MEM_PAGE_SIZE - 1)) <= MEM_PAGE_SIZE - cpu_trace_max_code_len) {
+		memcpy(rec.code, tlb_addr + start, cpu_trace_max_code_len);
+		rec.code_len = cpu_trace_max_code_len;
+		return;
 	}
+	uint8_t len = 0;
+	while (len < cpu_trace_max_code_len && !mem_readb_checked(start + len, &rec.code[len]))
+		++len;
+	rec.code_len = len;
+}
 
-	Bitu len = safe_strlen(dline);
-	if (len < 30) memset(dline + len,' ',30 - len);
-	dline[30] = 0;
-
-	TLogInst & inst = logInst[logCount];
-	strcpy(inst.dline,dline);
-	inst.s_cs = SegValue(cs);
-	inst.eip  = reg_eip;
-	strcpy(inst.res,res);
-	inst.eax  = reg_eax;
-	inst.ebx  = reg_ebx;
-	inst.ecx  = reg_ecx;
-	inst.edx  = reg_edx;
-	inst.esi  = reg_esi;
-	inst.edi  = reg_edi;
-	inst.ebp  = reg_ebp;
-	inst.esp  = reg_esp;
-	inst.s_ds = SegValue(ds);
-	inst.s_es = SegValue(es);
-	inst.s_fs = SegValue(fs);
-	inst.s_gs = SegValue(gs);
-	inst.s_ss = SegValue(ss);
-	inst.c    = get_CF()>0;
-	inst.z    = get_ZF()>0;
-	inst.s    = get_SF()>0;
-	inst.o    = get_OF()>0;
-	inst.a    = get_AF()>0;
-	inst.p    = get_PF()>0;
-	inst.i    = GETFLAGBOOL(IF);
-
+void DEBUG_HeavyLogInstruction()
+{
+	CaptureTraceRecord(logInst[logCount]);
 	if (++logCount >= LOGCPUMAX) logCount = 0;
 }
 
@@ -3352,36 +3656,18 @@ void DEBUG_HeavyWriteLogInstruction()
 
 	DEBUG_ShowMsg("DEBUG: Creating cpu log LOGCPU_INT_CD.TXT\n");
 
-	ofstream out("LOGCPU_INT_CD.TXT");
-	if (!out.is_open()) {
+	FILE *out = fopen("LOGCPU_INT_CD.TXT", "w");
+	if (!out) {
 		DEBUG_ShowMsg("DEBUG: Failed.\n");
 		return;
 	}
-	out << hex << noshowbase << setfill('0') << uppercase;
 	uint32_t startLog = logCount;
 	do {
-		// Write Instructions
-		TLogInst & inst = logInst[startLog];
-		out << setw(4) << inst.s_cs << ":" << setw(8) << inst.eip << "  "
-		    << inst.dline << "  " << inst.res << " EAX:" << setw(8)<< inst.eax
-		    << " EBX:" << setw(8) << inst.ebx << " ECX:" << setw(8) << inst.ecx
-		    << " EDX:" << setw(8) << inst.edx << " ESI:" << setw(8) << inst.esi
-		    << " EDI:" << setw(8) << inst.edi << " EBP:" << setw(8) << inst.ebp
-		    << " ESP:" << setw(8) << inst.esp << " DS:"  << setw(4) << inst.s_ds
-		    << " ES:"  << setw(4) << inst.s_es<< " FS:"  << setw(4) << inst.s_fs
-		    << " GS:"  << setw(4) << inst.s_gs<< " SS:"  << setw(4) << inst.s_ss
-		    << " CF:"  << inst.c  << " ZF:"   << inst.z  << " SF:"  << inst.s
-		    << " OF:"  << inst.o  << " AF:"   << inst.a  << " PF:"  << inst.p
-		    << " IF:"  << inst.i  << endl;
-
-/*		fprintf(f,"%04X:%08X   %s  %s  EAX:%08X EBX:%08X ECX:%08X EDX:%08X ESI:%08X EDI:%08X EBP:%08X ESP:%08X DS:%04X ES:%04X FS:%04X GS:%04X SS:%04X CF:%01X ZF:%01X SF:%01X OF:%01X AF:%01X PF:%01X IF:%01X\n",
-			logInst[startLog].s_cs,logInst[startLog].eip,logInst[startLog].dline,logInst[startLog].res,logInst[startLog].eax,logInst[startLog].ebx,logInst[startLog].ecx,logInst[startLog].edx,logInst[startLog].esi,logInst[startLog].edi,logInst[startLog].ebp,logInst[startLog].esp,
-		        logInst[startLog].s_ds,logInst[startLog].s_es,logInst[startLog].s_fs,logInst[startLog].s_gs,logInst[startLog].s_ss,
-		        logInst[startLog].c,logInst[startLog].z,logInst[startLog].s,logInst[startLog].o,logInst[startLog].a,logInst[startLog].p,logInst[startLog].i);*/
+		CPUTRACE_WriteText(out, logInst[startLog], CpuTraceFormat::Normal);
 		if (++startLog >= LOGCPUMAX) startLog = 0;
 	} while (startLog != logCount);
 
-	out.close();
+	fclose(out);
 	DEBUG_ShowMsg("DEBUG: Done.\n");
 }
 
@@ -3410,14 +3696,22 @@ void DEBUG_HandleBackbufferBlit(Bitu seg, Bitu off) {
 		return;
 	}
 
+	// We use this so that we skip repeats, we need to see a different location first.
+	// As we only get called at our own call sites, a gap in the instruction count
+	// since our last visit means some other instruction ran in between.
+	static bool shouldTrigger = true;
+	static Bitu lastVisitCycle = 0;
+	if (cycle_count != lastVisitCycle + 1) {
+		shouldTrigger = true;
+	}
+
 	if (seg == 0x01F7 && off == 0x1708) {
 		uint32_t ret_seg = mem_readw_inline(GetAddress(SegValue(ss), reg_bp + 0x04));
 		uint32_t ret_off = mem_readw_inline(GetAddress(SegValue(ss), reg_bp + 0x02));
 		fprintf(stdout, "16E7: Results of 1480 call: %.4x %.4x - caller %.4x:%.4x\n", reg_ax, reg_dx, ret_seg, ret_off);
 	}
-	// We use this so that we skip repeats, we need to see a different location first.
-	static bool shouldTrigger = true;
 	if (seg == 0x01F7 && off == 0x040F) {
+		lastVisitCycle = cycle_count;
 		if (shouldTrigger) {
 			// This is the rep movsb
 			// Check if we are copying into the front buffer
@@ -3440,6 +3734,7 @@ void DEBUG_HandleBackbufferBlit(Bitu seg, Bitu off) {
 		}
 	}
 	else if (seg == 0x01F7 && (off == 0x0E74 || off == 0x0E75)) {
+		lastVisitCycle = cycle_count;
 		if (shouldTrigger) {
 			uint32_t param1 = mem_readw_inline(GetAddress(SegValue(ss), reg_bp + 0x0A));
 			uint32_t param2 = mem_readw_inline(GetAddress(SegValue(ss), reg_bp + 0x06));
@@ -3453,9 +3748,6 @@ void DEBUG_HandleBackbufferBlit(Bitu seg, Bitu off) {
 			shouldTrigger = false;
 		}
 	}
-	else {
-		shouldTrigger = true;
-	}
 }
 
 void DEBUG_HandleFileAccess(Bitu seg, Bitu off) {
@@ -3538,14 +3830,28 @@ void DEBUG_HandleFileAccess(Bitu seg, Bitu off) {
 		positions[entry] = ((uint64_t)msb << 16) + lsb;
 	}
 }
+// Script events, traced on the script channel
+static constexpr TraceEventType trace_script_object = {"object", 'i', {"object"}};
+static constexpr TraceEventType trace_mouse_press = {"mouse press", 'i', {}};
+static constexpr TraceEventType trace_script_begin = {"script", 'B', {"scene", "1012", "1014"}};
+static constexpr TraceEventType trace_script_end = {"script", 'E', {}};
+static constexpr TraceEventType trace_script_read = {"read", 'i', {"value", "offset"}};
+static constexpr TraceEventType trace_script_opcode = {"opcode", 'i', {"opcode"}};
+static constexpr TraceEventType trace_script_opcode2 = {"opcode", 'i', {"opcode", "opcode2"}};
+static constexpr TraceEventType trace_helper_opcode = {"helper opcode", 'i', {"opcode", "value"}};
+static constexpr TraceEventType trace_helper_result = {"helper result", 'i', {"ax", "dx"}};
+static constexpr TraceEventType trace_skip_begin = {"skip", 'B', {}};
+static constexpr TraceEventType trace_skip_end = {"skip", 'E', {}};
+
 void DEBUG_HandleScript(Bitu seg, Bitu off)
 {
-	if (!isScriptChannelActive()) {
+	if (!isScriptChannelActive() && !isChannelTraced(SIS_ChannelID::Script)) {
 		return;
 	}
 
 	if (seg == 0x01E7 && off == 0xE4BF) {
 		uint16_t objectIndex = mem_readw_inline(GetAddress(0x0227, 0x0F92));
+		SIS_Trace(SIS_ChannelID::Script, trace_script_object, objectIndex);
 		SIS_DebugScript(
 		        "----- Switching execution to script for object: %.4x\n",
 		        objectIndex);
@@ -3553,6 +3859,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 	}
 
 	if (seg == 0x01D7 && off == 0x082A) {
+		SIS_Trace(SIS_ChannelID::Script, trace_mouse_press);
 		SIS_DebugScript("*** Mouse press ***\n");
 		return;
 	}
@@ -3573,6 +3880,8 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		uint16_t currentSceneID = mem_readw_inline(GetAddress(0x0227, 0x077C));
 		uint16_t global1012 = mem_readw_inline(GetAddress(0x0227, 0x1012));
 		uint16_t global1014 = mem_readw_inline(GetAddress(0x0227, 0x1014));
+		SIS_Trace(SIS_ChannelID::Script, trace_script_begin,
+		          currentSceneID, global1012, global1014);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript("----- Scripting function entered - scene: %.2x 1012: %.2x 1014: %.2x (%u ms since last leave)\n",
 			        currentSceneID, global1012, global1014, milliseconds);
@@ -3608,12 +3917,14 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		SIS_BeginBuffering();
 		SIS_LastOpcodeTriggeredSkip = false;
 	} else if (off == 0xE3E5) {
+		SIS_Trace(SIS_ChannelID::Script, trace_script_end);
 		SIS_DebugScript("----- Scripting function left\n");
 		script_last_leave = std::chrono::system_clock::now();
 	} else if (off == 0x9F17) {
 		// This is the case where we read a byte from the file
 		uint32_t script_offset = mem_readw_inline(
 		        GetAddress(SegValue(ds), 0x0F8A));
+		SIS_Trace(SIS_ChannelID::Script, trace_script_read, reg_al, script_offset);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript(
 			        "Script read (byte): %.2x at location %.4x:%.4x | %.4x (%.4x:%.4x)\n",
@@ -3647,6 +3958,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		// Second stage of a script read for a pointed to value
 		uint32_t script_offset = mem_readw_inline(
 		        GetAddress(SegValue(ds), 0x0F8A));
+		SIS_Trace(SIS_ChannelID::Script, trace_script_read, reg_ax, script_offset);
 
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript(
@@ -3664,7 +3976,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 			        script_offset);
 		}
 		if (script_read_off - script_last_read_off > 2) {
-			if (isChannelActive(SIS_Script_Verbose)) {
+			if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 				SIS_DebugScript(
 				        "-- Gap of %u bytes\n",
 				        script_read_off - script_last_read_off);
@@ -3673,6 +3985,10 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		script_last_read_off = script_read_off + 2;
 	} else if (off == 0xDB8E) {
 		SIS_currentOpcode1 = reg_al;
+		SIS_Trace(SIS_ChannelID::Script, trace_script_opcode, reg_al);
+		if (!isScriptChannelActive()) {
+			return;
+		}
 		std::string opcodeInfo;
 		if (reg_al != 5) {
 			opcodeInfo = SIS_IdentifyScriptOpcode(reg_al, 0);
@@ -3681,6 +3997,11 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		        reg_al,
 		        opcodeInfo.c_str());
 	} else if (off == 0xDC6B) {
+		SIS_Trace(SIS_ChannelID::Script, trace_script_opcode2,
+		          SIS_currentOpcode1, reg_al);
+		if (!isScriptChannelActive()) {
+			return;
+		}
 		std::string opcodeInfo = SIS_IdentifyScriptOpcode(SIS_currentOpcode1,
 		                                                  reg_al);
 		SIS_DebugScript("- Second block opcode: %.2x %s\n",
@@ -3689,6 +4010,10 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 	} else if (off == 0x9F5E) {
 		uint8_t opcode = SIS_GetLocalByte(-0x5);
 		uint16_t value = reg_ax;
+		SIS_Trace(SIS_ChannelID::Script, trace_helper_opcode, opcode, value);
+		if (!isScriptChannelActive()) {
+			return;
+		}
 		std::string opcodeInfo = SIS_IdentifyHelperOpcode(opcode, value);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript("- 9F4D opcode: %.2x %.4x %s (%.4x:%.4x)\n",
@@ -3704,6 +4029,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 			        opcodeInfo.c_str());
 		}
 	} else if (off == 0xA332) {
+		SIS_Trace(SIS_ChannelID::Script, trace_helper_result, reg_ax, reg_dx);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript("- 9F4D results: %.4x %.4x (%.4x:%.4x)\n",
 			        reg_ax,
@@ -3716,6 +4042,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 	} else if (off == 0xA3D2) {
 		SIS_ScriptIsSkipping = true;
 		SIS_LastOpcodeTriggeredSkip = true;
+		SIS_Trace(SIS_ChannelID::Script, trace_skip_begin);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript("-- Entering A3D2\n");
 		} else {
@@ -3744,6 +4071,7 @@ void DEBUG_HandleScript(Bitu seg, Bitu off)
 		}*/
 	} else if (off == 0xA437) {
 		SIS_ScriptIsSkipping = false;
+		SIS_Trace(SIS_ChannelID::Script, trace_skip_end);
 		if (isChannelActive(SIS_ChannelID::Script_Verbose)) {
 			SIS_DebugScript("-- Leaving A3D2\n");
 		}
@@ -3811,24 +4139,69 @@ bool DEBUG_HandleRegexpBreakpoint(Bitu seg, Bitu off) {
 	if (start == regex_bp_addr) {
 		return false;
 	}
-	char dline[200]; Bitu size;
-	size = DasmI386(dline, start, reg_eip, cpu.code.big);
+	bool match = false;
+	switch (regex_cache.Lookup(start, reg_eip, cpu.code.big)) {
+	case RegexMatchCache::Result::Match: match = true; break;
+	case RegexMatchCache::Result::NoMatch: match = false; break;
+	case RegexMatchCache::Result::Unknown: {
+		char dline[200];
+		const Bitu size = DasmI386(dline, start, reg_eip, cpu.code.big);
+		match = std::regex_search(dline, *self_regex);
+		regex_cache.Store(start, reg_eip, cpu.code.big, size, match);
+		break;
+	}
+	}
 
-	
-	if (std::regex_search(string(dline), *self_regex)) {
+	if (match) {
 		regex_bp_addr = start;
 		return true;
 	}
-	
-
 	return false;
 }
 
+static void DEBUG_RegisterHooks()
+{
+	debug_hooks.Clear();
+
+	SIS_RegisterHooks(debug_hooks);
+
+	debug_hooks.Add(0x01E7, 0x01D9, action_hook<DEBUG_HandleSpecial>);
+	debug_hooks.Add(0x01E7, 0x1BAA, action_hook<DEBUG_HandleSpecial>);
+
+	debug_hooks.Add(0x01E7, 0xE4BF, action_hook<DEBUG_HandleScript>);
+	debug_hooks.Add(0x01D7, 0x082A, action_hook<DEBUG_HandleScript>);
+	for (const uint16_t off : {0x9F17, 0x9F34, 0x9F40, 0x9F5E, 0xA332, 0xA3D2,
+	                           0xA417, 0xA437, 0xDB56, 0xDB89, 0xDB8E, 0xDC6B,
+	                           0xE3BA, 0xE3E5}) {
+		debug_hooks.Add(0x01E7, off, action_hook<DEBUG_HandleScript>);
+	}
+
+	debug_hooks.Add(0x01E7, 0x068B, action_hook<DEBUG_HandleFileAccess>);
+	for (const uint16_t off : {0x0B8F, 0x0BEC, 0x0BEE}) {
+		debug_hooks.Add(0x0217, off, action_hook<DEBUG_HandleFileAccess>);
+	}
+
+	for (const uint16_t off : {0x040F, 0x0E74, 0x0E75, 0x1708}) {
+		debug_hooks.Add(0x01F7, off, action_hook<DEBUG_HandleBackbufferBlit>);
+	}
+
+	// The trace point only observes, it never breaks
+	debug_hooks.Add(static_cast<uint16_t>(tracePointSeg),
+	                static_cast<uint16_t>(tracePointOff),
+	                [](Bitu seg, Bitu off) {
+		                DEBUG_HandleTracePoint(seg, off);
+		                return false;
+	                });
+}
+
 bool lastMouseTest = false;
 
 bool DEBUG_HeavyIsBreakpoint(void) {
 	static Bitu zero_count = 0;
 
+	if (reverse_log.IsRecording())
+		reverse_log.RecordInstruction();
+
 	/* if ((SegValue(cs) == 0x01D7) && reg_eip == 0x081A && lastMouseTest == false) {
 		if (reg_ax == 0x2) {
 			lastMouseTest = true;
@@ -3839,17 +4212,26 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 		lastMouseTest = false;
 	} */
 
-	SIS_HandleSIS(SegValue(cs), reg_eip);
-	if (SIS_IsBreakpoint(SegValue(cs), reg_eip)) {
+	// Call-site specific handlers, see DEBUG_RegisterHooks()
+	const PhysPt hook_addr = SegPhys(cs) + reg_eip;
+	if (debug_hooks.IsHooked(hook_addr) &&
+	    debug_hooks.Run(hook_addr, SegValue(cs), reg_eip)) {
 		return true;
 	}
 
-	DEBUG_HandleSpecial(SegValue(cs), reg_eip);
-	DEBUG_HandleScript(SegValue(cs), reg_eip);
-	DEBUG_HandleFileAccess(SegValue(cs), reg_eip);
-	DEBUG_HandleBackbufferBlit(SegValue(cs), reg_eip);
+	if (GCC_UNLIKELY(memwatch_stale))
+		ArmMemoryWatches();
+
+	if (mem_watches.HasHits(watch_read)) {
+		if (SIS_IsMemReadWatchBreakpoint(SegValue(cs), reg_eip)) {
+			return true;
+		}
+	} else {
+		// TODO: Check with full debug if there is a better alternative for this gating
+		SIS_MemReadWatchSeg = 0x0000;
+		SIS_MemReadWatchOff = 0x0000;
+	}
 
-	DEBUG_HandleTracePoint(SegValue(cs), reg_eip);
 	if (DEBUG_HandleRegexpBreakpoint(SegValue(cs), reg_eip)) {
 		return true;
 	}
@@ -3885,6 +4267,21 @@ bool DEBUG_HeavyIsBreakpoint(void) {
 			return true;
 		}
 	}
+	if (cpuTraceWriter.IsRunning()) {
+		if (cpuTraceCounter>0) {
+			CpuTraceRecord rec = {};
+			CaptureTraceRecord(rec);
+			cpuTraceWriter.Push(rec);
+			cpuTraceCounter--;
+		}
+		if (cpuTraceCounter<=0) {
+			cpuTraceWriter.Stop();
+			DEBUG_ShowMsg("DEBUG: cpu trace LOGCPU.BIN created, %" PRIu64 " records, writer stalled %" PRIu64 " times\n",
+			              cpuTraceWriter.NumRecords(), cpuTraceWriter.NumStalls());
+			DEBUG_EnableDebugger();
+			return true;
+		}
+	}
 	// LogInstruction
 	if (logHeavy) DEBUG_HeavyLogInstruction();
 	if (zeroProtect) {
@@ -3938,20 +4335,23 @@ void SIS_DrawString(const std::string& s, uint16_t x, uint16_t y) {
 
 void SIS_Init()
 {
-	channelIDNames = std::map<std::string, SIS_ChannelID>{
-	        {SIS_AnimFrame, SIS_ChannelID::AnimFrame},
-	        {SIS_OPL, SIS_ChannelID::OPL},
-	        {SIS_Palette, SIS_ChannelID::Palette},
-	        {SIS_Script, SIS_ChannelID::Script},
-	        {SIS_Script_Verbose, SIS_ChannelID::Script_Verbose},
-	        {SIS_Script_Minimal, SIS_ChannelID::Script_Minimal},
-	        {SIS_Pathfinding, SIS_ChannelID::Pathfinding},
-	        {SIS_Scaling, SIS_ChannelID::Scaling},
-	        {SIS_RLE, SIS_ChannelID::RLE},
-	        {SIS_Special, SIS_ChannelID::Special},
-	        {SIS_Fileread, SIS_ChannelID::Fileread},
-	        {SIS_FrameUpdate, SIS_ChannelID::FrameUpdate}
-			};
+	// Same order as SIS_ChannelID, so the IDs double as channel indices
+	for (const auto& name : {SIS_AnimFrame,
+	                         SIS_OPL,
+	                         SIS_Palette,
+	                         SIS_Script,
+	                         SIS_Script_Verbose,
+	                         SIS_Script_Minimal,
+	                         SIS_Pathfinding,
+	                         SIS_Scaling,
+	                         SIS_RLE,
+	                         SIS_Special,
+	                         SIS_Fileread,
+	                         SIS_FrameUpdate}) {
+		sis_channels.Register(name);
+	}
+	assert(sis_channels.NumChannels() ==
+	       static_cast<int>(SIS_ChannelID::FrameUpdate) + 1);
 }
 
 void SIS_PushWord(uint16_t value)
@@ -4007,6 +4407,23 @@ void SIS_HandleGameLoad(Bitu seg, Bitu off)
 	
 }
 
+bool SIS_IsMemReadWatchBreakpoint(Bitu seg, Bitu off)
+{
+	// Only called while a read watch hit is pending, the read happened in
+	// the previous instruction
+	if (SIS_MemReadWatchSeg != seg && SIS_MemReadWatchOff != off) {
+		DEBUG_ShowMsg("DEBUG: Memory read breakpoint hit.\n",
+		              SIS_filterSegment);
+#if C_HEAVY_DEBUG
+		mem_watches.ClearHits(watch_read);
+#endif
+		SIS_MemReadWatchSeg = seg;
+		SIS_MemReadWatchOff = off;
+		return true;
+	}
+	return false;
+}
+
 bool SIS_IsBreakpoint(Bitu seg, Bitu off)
 {
 
@@ -4017,24 +4434,6 @@ bool SIS_IsBreakpoint(Bitu seg, Bitu off)
 	        hitOnce = true;
 	        return true;
 	} */
-	static Bitu memReadWatchSeg = 0x0000;
-	static Bitu memReadWatchOff = 0x0000;
-	if (memReadWatchHit1 || memReadWatchHit2 ) {
-		if (memReadWatchSeg != seg && memReadWatchOff != off) {
-			DEBUG_ShowMsg("DEBUG: Memory read breakpoint hit.\n",
-			              SIS_filterSegment);
-			memReadWatchHit1 = false;
-			memReadWatchHit2 = false;
-			memReadWatchSeg  = seg;
-			memReadWatchOff  = off;
-			return true;
-		}
-	}
-	else {
-		// TODO: Check with full debug if there is a better alternative for this gating
-		memReadWatchSeg = 0x0000;
-		memReadWatchOff = 0x0000;
-	}
 	static bool hitOnce = false;
 	if (seg == 0x01E7 && off == 0x747E && !hitOnce) {
 		hitOnce = true;
@@ -4296,6 +4695,9 @@ static void SIS_PrintSegReads(Bitu*& reads, int numSegs, const char* name)
 }
 
 
+static constexpr TraceEventType trace_paint_begin = {"paint frame", 'B', {"ds"}};
+static constexpr TraceEventType trace_paint_end = {"paint frame", 'E', {}};
+
 void SIS_HandleAnimFramePainting(Bitu seg, Bitu off)
 {
 	static bool entered = false;
@@ -4318,7 +4720,7 @@ void SIS_HandleAnimFramePainting(Bitu seg, Bitu off)
 
 
 
-	if (!isChannelActive(SIS_ChannelID::AnimFrame)) {
+	if (!isChannelWanted(SIS_ChannelID::AnimFrame)) {
 		return;
 	}
 	
@@ -4326,6 +4728,15 @@ void SIS_HandleAnimFramePainting(Bitu seg, Bitu off)
 		return;
 	}
 
+	if (off == 0x0ED1) {
+		SIS_Trace(SIS_ChannelID::AnimFrame, trace_paint_begin, SegValue(ds));
+	} else if (off == 0x1027) {
+		SIS_Trace(SIS_ChannelID::AnimFrame, trace_paint_end);
+	}
+	if (!isChannelActive(SIS_ChannelID::AnimFrame)) {
+		return;
+	}
+
 	if (off == 0x0ED1) {
 		/* fprintf(stdout,
 		        "0x0ED1: Entered\n"); */
@@ -4763,10 +5174,15 @@ l0017_27D3:
 	
 }
 
+static constexpr TraceEventType trace_palette_begin = {"palette", 'B', {}};
+static constexpr TraceEventType trace_palette_end = {"palette", 'E', {}};
+static constexpr TraceEventType trace_palette_write = {"dac write", 'i', {"value", "port", "caller seg", "caller off"}};
+
 void SIS_HandlePalette(Bitu seg, Bitu off) {
-	if (!isChannelActive(SIS_ChannelID::Palette)) {
+	if (!isChannelWanted(SIS_ChannelID::Palette)) {
 		return;
 	}
+	const bool log = isChannelActive(SIS_ChannelID::Palette);
 
 	/*
 	l00B7_0156:
@@ -4783,12 +5199,16 @@ l00B7_0160:
 	*/
 
 	if (seg == 0x01F7 && off == 0x012F) {
-		fprintf(stdout,
-		        "VGA: Function entered.\n");
+		SIS_Trace(SIS_ChannelID::Palette, trace_palette_begin);
+		if (log)
+			fprintf(stdout,
+			        "VGA: Function entered.\n");
 		return;
 	}
 	if (seg == 0x01F7 && off == 0x01A3) {
-		fprintf(stdout, "VGA: Function left.\n");
+		SIS_Trace(SIS_ChannelID::Palette, trace_palette_end);
+		if (log)
+			fprintf(stdout, "VGA: Function left.\n");
 		return;
 	}
 
@@ -4799,6 +5219,11 @@ l00B7_0160:
 	uint16_t ret_off;
 	SIS_GetCaller(ret_seg, ret_off);
 
+	SIS_Trace(SIS_ChannelID::Palette, trace_palette_write, reg_al, reg_dx,
+	          ret_seg, ret_off);
+	if (!log) {
+		return;
+	}
 	fprintf(stdout,
 	        "VGA: Write %.2x to port %.4x (caller: %.4x:%.4x - %.8x)\n",
 	        reg_al,
@@ -4820,58 +5245,78 @@ void SIS_HandleScaleChange(Bitu seg, Bitu off) {
 	}
 }
 
-void SIS_HandleSIS(Bitu seg, Bitu off)
+#if C_HEAVY_DEBUG
+void SIS_RegisterHooks(DebugHooks& hooks)
 {
-	// SIS_Temp_HandleSkipDrawObject(seg, off);
-	SIS_LogAnimFrame(seg, off);
-	SIS_HandleAnimFrame(seg, off);
-	SIS_HandleAnimFramePainting(seg, off);
-	// SIS_HandleGameLoad(seg, off);
-	SIS_HandleMouseCursor(seg, off);
-	SIS_HandlePalette(seg, off);
-	// SIS_HandleOPL(seg, off);
-	// SIS_HandlePathfinding(seg, off);
-	// SIS_HandlePathfinding2(seg, off);
-	// SIS_HandlePathfinding3(seg, off);
-	// SIS_HandleAnimatedPortraits(seg, off);
-	SIS_HandleScaling(seg, off);
-	// SIS_HandleScaleChange(seg, off);
-	SIS_HandleSkip(seg, off);
-	// SIS_HandleInventoryIcons(seg, off);
-	// SIS_HandleDrawingFunction(seg, off);
-	// SIS_HandleDataLoadvFunction(seg, off);
-	// SIS_HandleBlobLoading(seg, off);
-	// SIS_HandleBlobLoading2(seg, off);
-	// SIS_HandleRLEDecoding(seg, off);
-	// SIS_HandlePaletteChange(seg, off);
-	// SIS_HandleCharacterPos(seg, off);
-	SIS_HandleProtagonistDebugText(seg, off);
-	// SIS_HandleStopWalking(seg, off);
-	// SIS_HandleCharacterDrawing(seg, off);
-	SIS_Handle1480(seg, off);
-	// SIS_Handle1480Short(seg, off);
-	// SIS_HandleBGAnimDrawing(seg, off);
-	// SIS_HandleSkippedCode(seg, off);
-	SIS_HandleMovementSpeedMod(seg, off);
-	SIS_HandleFunctionInjection(seg, off);
-	SIS_HandleInitialSceneOverride(seg, off);
-	SIS_HandleFont(seg, off);
-	// HandleMovementSpeed(seg, off);
+	// Comment out a handler's registration to disable it. The call sites
+	// listed must match the ones the handler checks for.
+
+	// SIS_Temp_HandleSkipDrawObject
+	hooks.Add(0x01F7, 0x174A, action_hook<SIS_LogAnimFrame>);
+	hooks.Add(0x01E7, 0x95D2, action_hook<SIS_LogAnimFrame>);
+	hooks.Add(0x01F7, 0x1615, action_hook<SIS_HandleAnimFrame>);
+	for (const uint16_t off : {0x0ED1, 0x0F99, 0x0FA6, 0x0FC6, 0x1027}) {
+		hooks.Add(0x01F7, off, action_hook<SIS_HandleAnimFramePainting>);
+	}
+	// SIS_HandleGameLoad
+	hooks.Add(0x01E7, 0x90A2, action_hook<SIS_HandleMouseCursor>);
+	for (const uint16_t off : {0x012F, 0x0160, 0x01A3}) {
+		hooks.Add(0x01F7, off, action_hook<SIS_HandlePalette>);
+	}
+	// SIS_HandleOPL
+	// SIS_HandlePathfinding
+	// SIS_HandlePathfinding2
+	// SIS_HandlePathfinding3
+	// SIS_HandleAnimatedPortraits
+	for (const uint16_t off : {0x0FA6, 0x0FC9, 0x1027}) {
+		hooks.Add(0x01F7, off, action_hook<SIS_HandleScaling>);
+	}
+	// SIS_HandleScaleChange
+	hooks.Add(0x01E7, 0xDB9C, action_hook<SIS_HandleSkip>);
+	// SIS_HandleInventoryIcons
+	// SIS_HandleDrawingFunction
+	// SIS_HandleDataLoadvFunction
+	// SIS_HandleBlobLoading
+	// SIS_HandleBlobLoading2
+	// SIS_HandleRLEDecoding
+	// SIS_HandlePaletteChange
+	// SIS_HandleCharacterPos
+	hooks.Add(0x01E7, 0x953A, action_hook<SIS_HandleProtagonistDebugText>);
+	// SIS_HandleStopWalking
+	// SIS_HandleCharacterDrawing
+	hooks.Add(0x01E7, 0xCAE6, action_hook<SIS_Handle1480>);
+	hooks.Add(0x01E7, 0x9286, action_hook<SIS_Handle1480>);
+	hooks.AddRange(0x01F7, 0x1484, 0x1615, action_hook<SIS_Handle1480>);
+	// SIS_Handle1480Short
+	// SIS_HandleBGAnimDrawing
+	// SIS_HandleSkippedCode
+	hooks.Add(0x01E7, 0x1C1D, action_hook<SIS_HandleMovementSpeedMod>);
+	hooks.Add(0x01E7, 0x0363, action_hook<SIS_HandleFunctionInjection>);
+	hooks.Add(0x01E7, 0x3213, action_hook<SIS_HandleInitialSceneOverride>);
+	hooks.Add(0x01E7, 0x7686, action_hook<SIS_HandleInitialSceneOverride>);
+	hooks.Add(0x01E7, 0x3472, action_hook<SIS_HandleFont>);
+	// HandleMovementSpeed
 	
-	// SIS_HandleScalingCalculation(seg, off);
-	// SIS_HandleAdlibSeek(seg, off);
-	SIS_HandleAdlib(seg, off);
-	SIS_HandleAdlibSeekShort(seg, off);
-	SIS_HandleOPLWrite(seg, off);
-	SIS_HandleInventoryRedraw(seg, off);
-	// SIS_HandleAdlib(seg, off);
-	// SIS_HandleAdlibSeekShort(seg, off);
-	// SIS_HandleOPLWrite(seg, off);
-	// SIS_HandleUI(seg, off);
-	SIS_HandleInventoryScrolling(seg, off);
-	SIS_HandleStringDecoding(seg, off);
-	SIS_HandleMainMenuPosition(seg, off);
+	// SIS_HandleScalingCalculation
+	// SIS_HandleAdlibSeek
+	hooks.Add(0x01D7, 0x1A6E, action_hook<SIS_HandleAdlib>);
+	// OnTimer entry and the memory watches across its body
+	hooks.AddRange(0x01D7, 0x1AA7, 0x2442, action_hook<SIS_HandleAdlib>);
+	hooks.Add(0x01D7, 0x19FF, action_hook<SIS_HandleAdlibSeekShort>);
+	hooks.Add(0x01D7, 0x279C, action_hook<SIS_HandleOPLWrite>);
+	hooks.Add(0x01D7, 0x09BF, action_hook<SIS_HandleInventoryRedraw>);
+	// SIS_HandleUI
+	hooks.Add(0x01E7, 0x50C4, action_hook<SIS_HandleInventoryScrolling>);
+	for (const uint16_t off : {0xA48D, 0xA4BE, 0xA4DD, 0xA5D3}) {
+		hooks.Add(0x01E7, off, action_hook<SIS_HandleStringDecoding>);
+	}
+	hooks.Add(0x01E7, 0xF1B2, action_hook<SIS_HandleMainMenuPosition>);
+
+	// Hardcoded breakpoints
+	hooks.Add(0x01E7, 0x747E, SIS_IsBreakpoint);
+	hooks.Add(0x01D7, 0x1B1A, SIS_IsBreakpoint);
 }
+#endif
 
 void SIS_WipeMemory(Bitu seg, Bitu off, int length, uint8_t value) {
 	for (int i = 0; i < length; i++) {
@@ -6361,6 +6806,11 @@ void SIS_Debug(const char* format, ...) {
 
 void SIS_DebugScript(const char* format, ...)
 {
+	// The script handler also runs when the channel is only traced
+	if (!isScriptChannelActive()) {
+		return;
+	}
+
 	// Initialize a variable argument list
 	va_list args;
 	va_start(args, format);
@@ -6777,7 +7227,7 @@ bool SIS_ParseCommand(char* found, std::string command)
 }
 
 void SIS_Handle1480(Bitu seg, Bitu off) {
-	if (!isChannelActive(SIS_FrameUpdate)) {
+	if (!isChannelActive(SIS_ChannelID::FrameUpdate)) {
 		return;
 	}
 
@@ -7058,7 +7508,12 @@ void SIS_HandleProtagonistDebugText(Bitu seg, Bitu off) {
 	}	
 }
 
+static constexpr TraceEventType trace_opl_write = {"opl write", 'i', {"value", "register", "caller seg", "caller off"}};
+
 void SIS_HandleOPLWrite(Bitu seg, Bitu off) {
+	if (!isChannelWanted(SIS_ChannelID::OPL)) {
+		return;
+	}
 
 	if (seg == 0x01D7 && off == 0x279C) { // || off == 0x27C8)
 
@@ -7077,6 +7532,12 @@ void SIS_HandleOPLWrite(Bitu seg, Bitu off) {
 			return;
 		}
 
+		SIS_Trace(SIS_ChannelID::OPL, trace_opl_write, value,
+		          registerIndex, ret_seg, ret_off);
+		if (!isChannelActive(SIS_ChannelID::OPL)) {
+			return;
+		}
+
 		// Outs
 		fprintf(stdout,
 		        "OPL: Write %.2x to port %.2x (caller: %.4x:%.4x - %.8x) - %4.x:%.4x\n",
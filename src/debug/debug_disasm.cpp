@@ -468,7 +468,15 @@ static char *addr_to_hex(UINT32 addr, int splitup) {
 static PhysPt getbyte_mac;
 static PhysPt startPtr;
 
+/* when set, instruction bytes come from this buffer instead of guest memory */
+static const uint8_t *getbyte_buf = nullptr;
+static Bitu getbyte_buf_len = 0;
+
 static UINT8 getbyte(void) {
+	if (getbyte_buf) {
+		const Bitu i = getbyte_mac++ - startPtr;
+		return i < getbyte_buf_len ? getbyte_buf[i] : 0;
+	}
 	return mem_readb(getbyte_mac++);
 }
 
@@ -1116,6 +1124,15 @@ Bitu DasmI386(char* buffer, PhysPt pc, Bitu cur_ip, bool bit32)
 	return getbyte_mac-pc;
 }
 
+Bitu DasmI386(char* buffer, const uint8_t* code, Bitu code_len, Bitu cur_ip, bool bit32)
+{
+	getbyte_buf = code;
+	getbyte_buf_len = code_len;
+	const Bitu size = DasmI386(buffer, 0, cur_ip, bit32);
+	getbyte_buf = nullptr;
+	return size;
+}
+
 int DasmLastOperandSize()
 {
 	return opsize;
@@ -0,0 +1,84 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "debug_hooks.h"
+
+#include <algorithm>
+#include <cassert>
+
+DebugHooks debug_hooks;
+
+static PhysPt real_mode_address(const uint16_t seg, const uint16_t off)
+{
+	return (static_cast<PhysPt>(seg) << 4) + off;
+}
+
+void DebugHooks::AddAt(const PhysPt addr, debug_hook_f hook)
+{
+	assert(hook);
+
+	const uint32_t page = addr >> page_shift;
+	hooked_pages[page / 64] |= uint64_t(1) << (page % 64);
+
+	const uint32_t index = addr & (page_size - 1);
+	auto& bits = hooked_addrs[page];
+	bits[index / 64] |= uint64_t(1) << (index % 64);
+
+	hooks[addr].push_back(hook);
+
+	// The map may have gained the cached page's entry
+	cached_page = UINT32_MAX;
+	cached_bits = nullptr;
+}
+
+void DebugHooks::Add(const uint16_t seg, const uint16_t off, debug_hook_f hook)
+{
+	AddAt(real_mode_address(seg, off), hook);
+}
+
+void DebugHooks::AddRange(const uint16_t seg, const uint16_t first_off,
+                          const uint16_t last_off, debug_hook_f hook)
+{
+	assert(first_off <= last_off);
+	for (uint32_t off = first_off; off <= last_off; ++off)
+		AddAt(real_mode_address(seg, static_cast<uint16_t>(off)), hook);
+}
+
+void DebugHooks::Clear()
+{
+	std::fill(hooked_pages.begin(), hooked_pages.end(), 0);
+	hooked_addrs.clear();
+	hooks.clear();
+	cached_page = UINT32_MAX;
+	cached_bits = nullptr;
+}
+
+bool DebugHooks::Run(const PhysPt addr, const Bitu seg, const Bitu off)
+{
+	const auto it = hooks.find(addr);
+	if (it == hooks.end())
+		return false;
+
+	for (const auto hook : it->second)
+		if (hook(seg, off))
+			return true;
+
+	return false;
+}
@@ -0,0 +1,113 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DEBUG_HOOKS_H
+#define DOSBOX_DEBUG_HOOKS_H
+
+#include "dosbox.h"
+
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "mem.h"
+
+/*  Heavy debugger execution hooks
+ *  ------------------------------
+ *  Handlers that need to run when the guest executes a specific instruction
+ *  register themselves here instead of being called for every instruction
+ *  and comparing CS:IP against their own list of call sites.
+ *
+ *  Hooks are keyed by linear address. A page-level bitmap rejects the vast
+ *  majority of instructions with a single probe; only on hooked pages is the
+ *  per-address bitmap consulted, and only on hooked addresses are the
+ *  handlers looked up and run.
+ *
+ *  Handlers still receive CS and (E)IP and are free to re-check them, so
+ *  aliasing seg:off pairs that map to the same linear address are harmless.
+ */
+
+// Returns true if the debugger should break at this instruction
+using debug_hook_f = bool (*)(Bitu seg, Bitu off);
+
+// Adapts a plain handler that never requests a break into a debug_hook_f
+template <void (*handler)(Bitu, Bitu)>
+bool action_hook(Bitu seg, Bitu off)
+{
+	handler(seg, off);
+	return false;
+}
+
+class DebugHooks {
+public:
+	// Call sites are given as real-mode seg:off, the same way the handlers
+	// identify them.
+	void Add(uint16_t seg, uint16_t off, debug_hook_f hook);
+
+	// Registers the hook for every address in [first_off, last_off]
+	void AddRange(uint16_t seg, uint16_t first_off, uint16_t last_off,
+	              debug_hook_f hook);
+
+	void Clear();
+
+	bool IsEmpty() const noexcept
+	{
+		return hooks.empty();
+	}
+
+	bool IsHooked(const PhysPt addr) noexcept
+	{
+		const uint32_t page = addr >> page_shift;
+		if (!(hooked_pages[page / 64] & (uint64_t(1) << (page % 64))))
+			return false;
+
+		// Code tends to stay within a page, so remember the last one
+		if (page != cached_page) {
+			cached_bits = &hooked_addrs.find(page)->second;
+			cached_page = page;
+		}
+		const uint32_t index = addr & (page_size - 1);
+		return (*cached_bits)[index / 64] & (uint64_t(1) << (index % 64));
+	}
+
+	// Runs the hooks registered at addr in registration order, stopping at
+	// the first one that requests a break.
+	bool Run(PhysPt addr, Bitu seg, Bitu off);
+
+private:
+	static constexpr int page_shift     = 12;
+	static constexpr uint32_t page_size = 1 << page_shift;
+	static constexpr size_t num_pages   = size_t(1) << (32 - page_shift);
+	using page_bits_t = std::array<uint64_t, page_size / 64>;
+
+	void AddAt(PhysPt addr, debug_hook_f hook);
+
+	std::vector<uint64_t> hooked_pages = std::vector<uint64_t>(num_pages / 64);
+	std::unordered_map<uint32_t, page_bits_t> hooked_addrs = {};
+	std::unordered_map<PhysPt, std::vector<debug_hook_f>> hooks = {};
+
+	uint32_t cached_page            = UINT32_MAX;
+	const page_bits_t* cached_bits = nullptr;
+};
+
+extern DebugHooks debug_hooks;
+
+#endif
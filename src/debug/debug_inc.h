@@ -56,4 +56,5 @@ extern DBGBlock dbg;
 
 /* Local Debug Stuff */
 Bitu DasmI386(char* buffer, PhysPt pc, Bitu cur_ip, bool bit32);
+Bitu DasmI386(char* buffer, const uint8_t* code, Bitu code_len, Bitu cur_ip, bool bit32);
 int DasmLastOperandSize();
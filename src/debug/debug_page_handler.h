@@ -0,0 +1,191 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DEBUG_PAGE_HANDLER_H
+#define DOSBOX_DEBUG_PAGE_HANDLER_H
+
+#include "dosbox.h"
+
+#include "mem.h"
+#include "paging.h"
+
+/*  Forwarding page handler
+ *  -----------------------
+ *  Base for debugger page handlers that are put in front of a physical
+ *  page's original handler to see accesses to it. Plain RAM and ROM
+ *  handlers only give out host pointers and have no read or write functions
+ *  of their own, so accesses are made directly on the host memory whenever
+ *  the original handler allows it through the TLB, and passed on otherwise.
+ *
+ *  The derived handler decides which of PFLAG_READABLE and PFLAG_WRITEABLE
+ *  to take away, so that those accesses can't bypass it.
+ */
+
+class ForwardingPageHandler : public PageHandler {
+public:
+	ForwardingPageHandler(const Bitu _phys_page, PageHandler* _old_pagehandler)
+	        : phys_page(_phys_page),
+	          old_pagehandler(_old_pagehandler)
+	{
+		// Dynamic code pages are only ever looked at by the dynamic
+		// cores themselves, which cast them back to their own handler
+		flags = old_pagehandler->flags & ~PFLAG_HASCODE;
+	}
+
+	ForwardingPageHandler(const ForwardingPageHandler&)            = delete;
+	ForwardingPageHandler& operator=(const ForwardingPageHandler&) = delete;
+
+	uint8_t readb(PhysPt addr) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE)
+			return host_readb(HostReadPt(addr));
+		return old_pagehandler->readb(addr);
+	}
+	uint16_t readw(PhysPt addr) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE)
+			return host_readw(HostReadPt(addr));
+		return old_pagehandler->readw(addr);
+	}
+	uint32_t readd(PhysPt addr) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE)
+			return host_readd(HostReadPt(addr));
+		return old_pagehandler->readd(addr);
+	}
+	bool readb_checked(PhysPt addr, uint8_t* val) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE) {
+			*val = host_readb(HostReadPt(addr));
+			return false;
+		}
+		return old_pagehandler->readb_checked(addr, val);
+	}
+	bool readw_checked(PhysPt addr, uint16_t* val) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE) {
+			*val = host_readw(HostReadPt(addr));
+			return false;
+		}
+		return old_pagehandler->readw_checked(addr, val);
+	}
+	bool readd_checked(PhysPt addr, uint32_t* val) override
+	{
+		if (old_pagehandler->flags & PFLAG_READABLE) {
+			*val = host_readd(HostReadPt(addr));
+			return false;
+		}
+		return old_pagehandler->readd_checked(addr, val);
+	}
+
+	void writeb(PhysPt addr, uint8_t val) override
+	{
+		if (old_pagehandler->flags & PFLAG_WRITEABLE)
+			host_writeb(HostWritePt(addr), val);
+		else
+			old_pagehandler->writeb(addr, val);
+	}
+	void writew(PhysPt addr, uint16_t val) override
+	{
+		if (old_pagehandler->flags & PFLAG_WRITEABLE)
+			host_writew(HostWritePt(addr), val);
+		else
+			old_pagehandler->writew(addr, val);
+	}
+	void writed(PhysPt addr, uint32_t val) override
+	{
+		if (old_pagehandler->flags & PFLAG_WRITEABLE)
+			host_writed(HostWritePt(addr), val);
+		else
+			old_pagehandler->writed(addr, val);
+	}
+	bool writeb_checked(PhysPt addr, uint8_t val) override
+	{
+		if (!(old_pagehandler->flags & PFLAG_WRITEABLE))
+			return old_pagehandler->writeb_checked(addr, val);
+		host_writeb(HostWritePt(addr), val);
+		return false;
+	}
+	bool writew_checked(PhysPt addr, uint16_t val) override
+	{
+		if (!(old_pagehandler->flags & PFLAG_WRITEABLE))
+			return old_pagehandler->writew_checked(addr, val);
+		host_writew(HostWritePt(addr), val);
+		return false;
+	}
+	bool writed_checked(PhysPt addr, uint32_t val) override
+	{
+		if (!(old_pagehandler->flags & PFLAG_WRITEABLE))
+			return old_pagehandler->writed_checked(addr, val);
+		host_writed(HostWritePt(addr), val);
+		return false;
+	}
+
+	HostPt GetHostReadPt(Bitu page) override
+	{
+		return old_pagehandler->GetHostReadPt(page);
+	}
+	HostPt GetHostWritePt(Bitu page) override
+	{
+		return old_pagehandler->GetHostWritePt(page);
+	}
+
+	// Puts the original handler back. Returns false if the page has been
+	// given another handler since, which may still be forwarding to us.
+	bool Restore()
+	{
+		if (MEM_GetPageHandler(phys_page) != this)
+			return false;
+		MEM_SetPageHandler(phys_page, 1, old_pagehandler);
+		PAGING_ClearTLB();
+		return true;
+	}
+
+	// Installs the handler in front of the page's current handler. The
+	// page may be linked under more than one linear address, so the whole
+	// TLB is flushed to get every access to come through here.
+	void Install()
+	{
+		MEM_SetPageHandler(phys_page, 1, this);
+		PAGING_ClearTLB();
+	}
+
+	Bitu GetPhysPage() const
+	{
+		return phys_page;
+	}
+
+protected:
+	// Words and dwords never cross the page here; the unaligned access
+	// helpers split those up before they reach a handler
+	HostPt HostReadPt(const PhysPt addr)
+	{
+		return old_pagehandler->GetHostReadPt(phys_page) + (addr & 4095);
+	}
+	HostPt HostWritePt(const PhysPt addr)
+	{
+		return old_pagehandler->GetHostWritePt(phys_page) + (addr & 4095);
+	}
+
+	Bitu phys_page;
+	PageHandler* old_pagehandler;
+};
+
+#endif
@@ -0,0 +1,213 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "debug_regex_cache.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "debug_page_handler.h"
+#include "paging.h"
+
+// Sits in front of the page's original handler, like the dynamic core's
+// CodePageHandler, so writes can't bypass it through the TLB.
+class RegexCachePageHandler final : public ForwardingPageHandler {
+public:
+	RegexCachePageHandler(RegexMatchCache* _owner, Bitu _phys_page,
+	                      PageHandler* _old_pagehandler)
+	        : ForwardingPageHandler(_phys_page, _old_pagehandler),
+	          owner(_owner)
+	{
+		flags &= ~PFLAG_WRITEABLE;
+	}
+
+	void writeb(PhysPt addr, uint8_t val) override
+	{
+		ForwardingPageHandler::writeb(addr, val);
+		Invalidate(addr, 1);
+	}
+	void writew(PhysPt addr, uint16_t val) override
+	{
+		ForwardingPageHandler::writew(addr, val);
+		Invalidate(addr, 2);
+	}
+	void writed(PhysPt addr, uint32_t val) override
+	{
+		ForwardingPageHandler::writed(addr, val);
+		Invalidate(addr, 4);
+	}
+	bool writeb_checked(PhysPt addr, uint8_t val) override
+	{
+		if (ForwardingPageHandler::writeb_checked(addr, val))
+			return true;
+		Invalidate(addr, 1);
+		return false;
+	}
+	bool writew_checked(PhysPt addr, uint16_t val) override
+	{
+		if (ForwardingPageHandler::writew_checked(addr, val))
+			return true;
+		Invalidate(addr, 2);
+		return false;
+	}
+	bool writed_checked(PhysPt addr, uint32_t val) override
+	{
+		if (ForwardingPageHandler::writed_checked(addr, val))
+			return true;
+		Invalidate(addr, 4);
+		return false;
+	}
+
+	bool Release()
+	{
+		owner = nullptr;
+		return Restore();
+	}
+
+private:
+	void Invalidate(const PhysPt addr, const Bitu size)
+	{
+		if (!owner)
+			return;
+		const Bitu first = addr & 4095;
+		owner->Invalidate(phys_page, first, std::min<Bitu>(first + size - 1, 4095));
+	}
+
+	RegexMatchCache* owner;
+};
+
+RegexMatchCache::RegexMatchCache() = default;
+
+// Only frees memory; at shutdown the page handlers are gone already
+RegexMatchCache::~RegexMatchCache() = default;
+
+RegexMatchCache::Page* RegexMatchCache::FindPage(const Bitu phys_page)
+{
+	if (phys_page != cached_phys_page) {
+		const auto it = pages.find(phys_page);
+		cached_page = (it != pages.end()) ? it->second.get() : nullptr;
+		cached_phys_page = phys_page;
+	}
+	if (!cached_page)
+		return nullptr;
+
+	// Memory was remapped or reset, or the dynamic core took the page over
+	if (MEM_GetPageHandler(phys_page) != cached_page->handler.get()) {
+		if (!cached_page->handler->Release())
+			detached.push_back(std::move(cached_page->handler));
+		pages.erase(phys_page);
+		cached_page = nullptr;
+	}
+	return cached_page;
+}
+
+RegexMatchCache::Page* RegexMatchCache::WatchPage(const Bitu phys_page)
+{
+	PageHandler* old_handler = MEM_GetPageHandler(phys_page);
+
+	// Pages with dynamic code already have their writes watched by the
+	// CodePageHandler, which mustn't be wrapped; and only plain memory
+	// can hold code worth caching.
+	if (old_handler->flags & PFLAG_HASCODE)
+		return nullptr;
+	if (!(old_handler->flags & PFLAG_READABLE))
+		return nullptr;
+	// Other debugger handlers, like the memory watchpoints, are freed as
+	// soon as they've been replaced, so they mustn't be wrapped
+	if (dynamic_cast<ForwardingPageHandler*>(old_handler))
+		return nullptr;
+
+	auto page     = std::make_unique<Page>();
+	page->handler = std::make_unique<RegexCachePageHandler>(this, phys_page,
+	                                                        old_handler);
+	page->handler->Install();
+
+	cached_phys_page = phys_page;
+	cached_page      = page.get();
+	pages[phys_page] = std::move(page);
+	return cached_page;
+}
+
+RegexMatchCache::Result RegexMatchCache::Lookup(const PhysPt lin_addr,
+                                                const uint32_t eip, const bool big)
+{
+	// Only trust the physical page the TLB gives us once it's linked
+	if (!get_tlb_read(lin_addr))
+		return Result::Unknown;
+
+	const Bitu phys_page = PAGING_GetPhysicalPage(lin_addr) >> 12;
+	const Page* page     = FindPage(phys_page);
+	if (!page)
+		return Result::Unknown;
+
+	const auto& entry = page->entries[lin_addr & (page_size - 1)];
+	if (!(entry.state & state_valid) || entry.eip != eip ||
+	    ((entry.state & state_big) != 0) != big)
+		return Result::Unknown;
+
+	return (entry.state & state_match) ? Result::Match : Result::NoMatch;
+}
+
+void RegexMatchCache::Store(const PhysPt lin_addr, const uint32_t eip,
+                            const bool big, const Bitu size, const bool match)
+{
+	const Bitu offset = lin_addr & (page_size - 1);
+	if (offset + size > page_size)
+		return;
+	if (!get_tlb_read(lin_addr))
+		return;
+
+	const Bitu phys_page = PAGING_GetPhysicalPage(lin_addr) >> 12;
+	Page* page           = FindPage(phys_page);
+	if (!page)
+		page = WatchPage(phys_page);
+	if (!page)
+		return;
+
+	auto& entry = page->entries[offset];
+	entry.eip   = eip;
+	entry.state = state_valid | (match ? state_match : 0) | (big ? state_big : 0);
+}
+
+void RegexMatchCache::Invalidate(const Bitu phys_page, const Bitu first,
+                                 const Bitu last)
+{
+	assert(first <= last && last < page_size);
+
+	const auto it = pages.find(phys_page);
+	if (it == pages.end())
+		return;
+
+	// Any instruction starting up to 14 bytes earlier may cover the write
+	const Bitu start = first >= max_insn_bytes - 1 ? first - (max_insn_bytes - 1) : 0;
+	auto& entries = it->second->entries;
+	for (Bitu i = start; i <= last; ++i)
+		entries[i].state = 0;
+}
+
+void RegexMatchCache::Clear()
+{
+	for (auto& entry : pages)
+		if (!entry.second->handler->Release())
+			detached.push_back(std::move(entry.second->handler));
+	pages.clear();
+	cached_phys_page = ~Bitu(0);
+	cached_page      = nullptr;
+}
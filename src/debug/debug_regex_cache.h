@@ -0,0 +1,100 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DEBUG_REGEX_CACHE_H
+#define DOSBOX_DEBUG_REGEX_CACHE_H
+
+#include "dosbox.h"
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "mem.h"
+
+/*  Regex breakpoint match cache
+ *  ----------------------------
+ *  Remembers, per physical address, whether the disassembly of the
+ *  instruction there matched the regex breakpoint, so every distinct
+ *  instruction is only disassembled and matched once.
+ *
+ *  Stale results are dropped the same way the dynamic core notices
+ *  self-modifying code: every physical page holding cached results gets a
+ *  page handler that forwards all accesses to the original handler, but is
+ *  not directly writeable through the TLB, so every write to the page passes
+ *  through it and invalidates the results for the bytes it touches.
+ *
+ *  The disassembly also depends on EIP (relative branch targets) and the
+ *  code size, so those are kept with each result and a mismatch is treated
+ *  as a miss. Instructions that cross a page boundary are never cached.
+ */
+
+class RegexCachePageHandler;
+
+class RegexMatchCache {
+public:
+	enum class Result { Unknown, NoMatch, Match };
+
+	RegexMatchCache();
+	~RegexMatchCache();
+
+	Result Lookup(PhysPt lin_addr, uint32_t eip, bool big);
+	void Store(PhysPt lin_addr, uint32_t eip, bool big, Bitu size, bool match);
+
+	// Drops all results and gives the pages back to their original handlers
+	void Clear();
+
+	// Called by the page handlers for every write to a watched page
+	void Invalidate(Bitu phys_page, Bitu first, Bitu last);
+
+private:
+	static constexpr Bitu page_size      = 4096;
+	static constexpr Bitu max_insn_bytes = 15;
+
+	static constexpr uint8_t state_valid = 1 << 0;
+	static constexpr uint8_t state_match = 1 << 1;
+	static constexpr uint8_t state_big   = 1 << 2;
+
+	struct Entry {
+		uint32_t eip  = 0;
+		uint8_t state = 0; // state_* bits
+	};
+
+	struct Page {
+		std::unique_ptr<RegexCachePageHandler> handler;
+		std::array<Entry, page_size> entries = {};
+	};
+
+	Page* FindPage(Bitu phys_page);
+	Page* WatchPage(Bitu phys_page);
+
+	std::unordered_map<Bitu, std::unique_ptr<Page>> pages;
+
+	// Handlers that someone else had wrapped by the time they were to be
+	// released. They can still be reached through the wrapper, so they're
+	// kept alive and just pass accesses through.
+	std::vector<std::unique_ptr<RegexCachePageHandler>> detached;
+
+	Bitu cached_phys_page = ~Bitu(0);
+	Page* cached_page     = nullptr;
+};
+
+#endif
@@ -1,5 +1,7 @@
 #pragma once
 #include "debug.h"
+#include "channel_trace.h"
+#include "debug_hooks.h"
 
 enum class SIS_ChannelID {
 	AnimFrame,
@@ -30,8 +32,8 @@ const std::string SIS_RLE("rle");
 const std::string SIS_Fileread("fileread");
 const std::string SIS_FrameUpdate("frame_update");
 
-extern std::map<std::string, SIS_ChannelID> channelIDNames;
-extern std::map<SIS_ChannelID, bool> debugLogEnabledID;
+// Registered by SIS_Init in SIS_ChannelID order
+extern ChannelTrace sis_channels;
 
 // Addresses for the font
 uint16_t SIS_FontAddresses[0x502 / 2][2];
@@ -41,19 +43,31 @@ uint32_t SIS_FontAddressesASCII[0x502 / 2];
 
 void SIS_DrawString(const std::string& s, uint16_t x, uint16_t y);
 
-inline bool isChannelActive(const std::string& name)
+inline bool isChannelActive(SIS_ChannelID channelID)
 {
-	// TODO: Consider a safety mode
-	return debugLogEnabledID[channelIDNames[name]];
+	return sis_channels.IsLogged(static_cast<int>(channelID));
 }
 
-inline bool isChannelActive(SIS_ChannelID channelID)
+inline void setIsChannelActive(SIS_ChannelID channelID, bool active) {
+	sis_channels.SetLogged(static_cast<int>(channelID), active);
+}
+
+inline bool isChannelTraced(SIS_ChannelID channelID)
 {
-	return debugLogEnabledID[channelID];
+	return sis_channels.IsTraced(static_cast<int>(channelID));
 }
 
-inline void setIsChannelActive(SIS_ChannelID channelID, bool active) {
-	debugLogEnabledID[channelID] = active;
+// Logged or traced, handlers with nothing to do return early otherwise
+inline bool isChannelWanted(SIS_ChannelID channelID)
+{
+	return sis_channels.IsWanted(static_cast<int>(channelID));
+}
+
+inline void SIS_Trace(SIS_ChannelID channelID, const TraceEventType& type,
+                      uint32_t arg0 = 0, uint32_t arg1 = 0,
+                      uint32_t arg2 = 0, uint32_t arg3 = 0)
+{
+	sis_channels.Record(static_cast<int>(channelID), type, arg0, arg1, arg2, arg3);
 }
 
 class TraceHelper {
@@ -93,13 +107,20 @@ void SIS_Init();
 
 bool SIS_IsBreakpoint(Bitu seg, Bitu off);
 
+// Location of the last memory read breakpoint, so we don't hit it again
+Bitu SIS_MemReadWatchSeg = 0x0000;
+Bitu SIS_MemReadWatchOff = 0x0000;
+bool SIS_IsMemReadWatchBreakpoint(Bitu seg, Bitu off);
+
 void SIS_HandleAnimatedPortraits(Bitu seg, Bitu off);
 
 void SIS_HandleScaling(Bitu seg, Bitu off);
 
 void SIS_HandlePathfinding(Bitu seg, Bitu off);
 
-void SIS_HandleSIS(Bitu seg, Bitu off);
+#if C_HEAVY_DEBUG
+void SIS_RegisterHooks(DebugHooks& hooks);
+#endif
 
 bool SIS_ParseCommand(char* found, std::string command);
 
@@ -0,0 +1,229 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "debug_watch.h"
+
+#include "cpu.h"
+#include "debug_page_handler.h"
+#include "paging.h"
+
+#if C_HEAVY_DEBUG
+
+bool memwatch_stale = false;
+
+class WatchPageHandler final : public ForwardingPageHandler {
+public:
+	WatchPageHandler(MemoryWatchpoints* _owner, Bitu _phys_page,
+	                 PageHandler* _old_pagehandler, const MemoryWatchpoints::Masks& _masks)
+	        : ForwardingPageHandler(_phys_page, _old_pagehandler),
+	          owner(_owner),
+	          masks(_masks)
+	{
+		flags &= ~PFLAG_WRITEABLE;
+		if (WatchesReads())
+			flags &= ~PFLAG_READABLE;
+		flags |= PFLAG_NOCODE | PFLAG_DEBUGWATCH;
+	}
+
+	bool WatchesReads() const
+	{
+		return masks.read.any();
+	}
+
+	void SetMasks(const MemoryWatchpoints::Masks& _masks)
+	{
+		masks = _masks;
+	}
+
+	uint8_t readb(PhysPt addr) override
+	{
+		Check(masks.read, addr, 1, watch_read);
+		return ForwardingPageHandler::readb(addr);
+	}
+	uint16_t readw(PhysPt addr) override
+	{
+		Check(masks.read, addr, 2, watch_read);
+		return ForwardingPageHandler::readw(addr);
+	}
+	uint32_t readd(PhysPt addr) override
+	{
+		Check(masks.read, addr, 4, watch_read);
+		return ForwardingPageHandler::readd(addr);
+	}
+	bool readb_checked(PhysPt addr, uint8_t* val) override
+	{
+		Check(masks.read, addr, 1, watch_read);
+		return ForwardingPageHandler::readb_checked(addr, val);
+	}
+	bool readw_checked(PhysPt addr, uint16_t* val) override
+	{
+		Check(masks.read, addr, 2, watch_read);
+		return ForwardingPageHandler::readw_checked(addr, val);
+	}
+	bool readd_checked(PhysPt addr, uint32_t* val) override
+	{
+		Check(masks.read, addr, 4, watch_read);
+		return ForwardingPageHandler::readd_checked(addr, val);
+	}
+
+	void writeb(PhysPt addr, uint8_t val) override
+	{
+		ForwardingPageHandler::writeb(addr, val);
+		Check(masks.write, addr, 1, watch_write);
+	}
+	void writew(PhysPt addr, uint16_t val) override
+	{
+		ForwardingPageHandler::writew(addr, val);
+		Check(masks.write, addr, 2, watch_write);
+	}
+	void writed(PhysPt addr, uint32_t val) override
+	{
+		ForwardingPageHandler::writed(addr, val);
+		Check(masks.write, addr, 4, watch_write);
+	}
+	bool writeb_checked(PhysPt addr, uint8_t val) override
+	{
+		if (ForwardingPageHandler::writeb_checked(addr, val))
+			return true;
+		Check(masks.write, addr, 1, watch_write);
+		return false;
+	}
+	bool writew_checked(PhysPt addr, uint16_t val) override
+	{
+		if (ForwardingPageHandler::writew_checked(addr, val))
+			return true;
+		Check(masks.write, addr, 2, watch_write);
+		return false;
+	}
+	bool writed_checked(PhysPt addr, uint32_t val) override
+	{
+		if (ForwardingPageHandler::writed_checked(addr, val))
+			return true;
+		Check(masks.write, addr, 4, watch_write);
+		return false;
+	}
+
+private:
+	void Check(const std::bitset<MemoryWatchpoints::page_size>& mask,
+	           const PhysPt addr, const Bitu size, const uint8_t access)
+	{
+		// Accesses never cross the page, see ForwardingPageHandler
+		const Bitu first = addr & (MemoryWatchpoints::page_size - 1);
+		for (Bitu i = first; i < first + size; ++i)
+			if (mask.test(i)) {
+				if (!owner->paused)
+					owner->hits |= access;
+				return;
+			}
+	}
+
+	MemoryWatchpoints* owner;
+	MemoryWatchpoints::Masks masks;
+};
+
+MemoryWatchpoints::MemoryWatchpoints(const bool& _paused) : paused(_paused) {}
+
+// Only frees memory; at shutdown the page handlers are gone already
+MemoryWatchpoints::~MemoryWatchpoints() = default;
+
+void MemoryWatchpoints::Begin()
+{
+	pending.clear();
+}
+
+bool MemoryWatchpoints::Watch(const PhysPt lin_addr, const uint8_t access)
+{
+	Bitu phys_page = lin_addr >> 12;
+	if (!PAGING_MakePhysPage(phys_page))
+		return false;
+
+	// Only pages backed by memory have a handler of their own
+	if (phys_page >= MEM_TotalPages())
+		return false;
+
+	auto& masks        = pending[phys_page];
+	const Bitu offset = lin_addr & (page_size - 1);
+	if (access & watch_read)
+		masks.read.set(offset);
+	if (access & watch_write)
+		masks.write.set(offset);
+	return true;
+}
+
+void MemoryWatchpoints::DropPage(const Bitu phys_page,
+                                 std::unique_ptr<WatchPageHandler> handler)
+{
+	// Once replaced, nothing refers to the handler anymore: the regex
+	// cache doesn't wrap other debugger handlers, and the dynamic cores
+	// don't wrap PFLAG_NOCODE pages
+	if (MEM_GetPageHandler(phys_page) == handler.get())
+		handler->Restore();
+}
+
+void MemoryWatchpoints::Commit()
+{
+	bool changed = false;
+
+	for (auto it = pages.begin(); it != pages.end();) {
+		const Bitu phys_page = it->first;
+		auto& handler        = it->second;
+		const auto wanted    = pending.find(phys_page);
+
+		// Keep the handler if it's still in place and its flags fit
+		if (wanted != pending.end() &&
+		    MEM_GetPageHandler(phys_page) == handler.get() &&
+		    handler->WatchesReads() == wanted->second.read.any()) {
+			handler->SetMasks(wanted->second);
+			pending.erase(wanted);
+			++it;
+			continue;
+		}
+		DropPage(phys_page, std::move(handler));
+		it      = pages.erase(it);
+		changed = true;
+	}
+
+	for (const auto& [phys_page, masks] : pending) {
+		// Dynamic code pages have their own handler that the dynamic
+		// core casts back, so it goes first
+		CPU_ReleaseCodePage(phys_page);
+
+		auto handler = std::make_unique<WatchPageHandler>(
+		        this, phys_page, MEM_GetPageHandler(phys_page), masks);
+		MEM_SetPageHandler(phys_page, 1, handler.get());
+		pages[phys_page] = std::move(handler);
+		changed          = true;
+	}
+	pending.clear();
+
+	// The pages may be linked under more than one linear address
+	if (changed)
+		PAGING_ClearTLB();
+	memwatch_stale = false;
+}
+
+void MemoryWatchpoints::Clear()
+{
+	Begin();
+	Commit();
+	hits = 0;
+}
+
+#endif
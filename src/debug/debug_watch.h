@@ -0,0 +1,114 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_DEBUG_WATCH_H
+#define DOSBOX_DEBUG_WATCH_H
+
+#include "dosbox.h"
+
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include "mem.h"
+
+/*  Memory watchpoints
+ *  ------------------
+ *  Memory breakpoints and read watches are served by page handlers instead
+ *  of looking at the watched bytes before every instruction. Every physical
+ *  page holding a watched byte gets a handler in front of its original one
+ *  that takes direct TLB access away (writes always, reads only for read
+ *  watches), so only accesses to those pages take the detour. An access
+ *  that covers a watched byte is recorded as a hit, and the debugger only
+ *  evaluates its memory breakpoints while a hit is pending.
+ *
+ *  Watches are given as linear addresses and placed on the physical page
+ *  they map to at the time. Mappings and page handlers only change along
+ *  with a TLB flush, which sets memwatch_stale so the debugger places its
+ *  watches again before the next instruction.
+ *
+ *  Reads made by the debugger itself, for example to draw the data view,
+ *  are ignored while the debugger has the emulation stopped.
+ *
+ *  Watched pages are marked PFLAG_NOCODE, so the dynamic cores leave them to
+ *  the normal core and every access keeps going through the handler. They're
+ *  also marked PFLAG_DEBUGWATCH, so the cores don't complain about it.
+ *  Accesses that bypass the page handlers, such as DMA, aren't seen.
+ */
+
+constexpr uint8_t watch_read  = 1 << 0;
+constexpr uint8_t watch_write = 1 << 1;
+
+class WatchPageHandler;
+
+class MemoryWatchpoints {
+public:
+	// Accesses made while the flag is set are the debugger's own, and
+	// aren't counted as hits
+	explicit MemoryWatchpoints(const bool& _paused);
+	~MemoryWatchpoints();
+
+	// Watches are placed as a whole set: Begin(), Watch() for every byte,
+	// then Commit(). Pages left out of the new set get their original
+	// handlers back, pages that kept their handler are left alone.
+	void Begin();
+	bool Watch(PhysPt lin_addr, uint8_t access);
+	void Commit();
+
+	// Removes every watch and pending hit
+	void Clear();
+
+	// Whether an access of one of the watch_* kinds covered a watched byte
+	// since those hits were last cleared
+	bool HasHits(const uint8_t access) const
+	{
+		return (hits & access) != 0;
+	}
+	void ClearHits(const uint8_t access)
+	{
+		hits &= ~access;
+	}
+
+	size_t NumPages() const
+	{
+		return pages.size();
+	}
+
+private:
+	friend class WatchPageHandler;
+
+	static constexpr Bitu page_size = 4096;
+
+	struct Masks {
+		std::bitset<page_size> read  = {};
+		std::bitset<page_size> write = {};
+	};
+
+	void DropPage(Bitu phys_page, std::unique_ptr<WatchPageHandler> handler);
+
+	std::unordered_map<Bitu, std::unique_ptr<WatchPageHandler>> pages;
+	std::unordered_map<Bitu, Masks> pending;
+
+	const bool& paused;
+	uint8_t hits = 0;
+};
+
+#endif
@@ -0,0 +1,168 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "guest_profiler.h"
+
+#include <cstdio>
+
+#include "cpu.h"
+#include "mem.h"
+#include "paging.h"
+#include "pic.h"
+#include "regs.h"
+
+#if C_DEBUG
+
+GuestProfiler guest_profiler;
+
+// Only reads what the TLB already maps, so walking a bogus BP chain can
+// neither fault nor touch device memory
+template <typename T>
+static bool read_stack(const PhysPt address, T& val)
+{
+	if ((address & 4095) > 4096 - sizeof(T))
+		return false;
+	const HostPt tlb = get_tlb_read(address);
+	if (!tlb)
+		return false;
+	if constexpr (sizeof(T) == 2)
+		val = host_readw(tlb + address);
+	else
+		val = host_readd(tlb + address);
+	return true;
+}
+
+static uint64_t make_frame(const uint16_t seg, const uint32_t off)
+{
+	return (static_cast<uint64_t>(seg) << 32) | off;
+}
+
+size_t GuestProfiler::StackHash::operator()(const Stack& stack) const
+{
+	// FNV-1a over the frames
+	uint64_t hash = 14695981039346656037ull;
+	for (const auto frame : stack) {
+		hash ^= frame;
+		hash *= 1099511628211ull;
+	}
+	return static_cast<size_t>(hash);
+}
+
+void GuestProfiler::Start(const double interval_ms, const bool near_frames)
+{
+	Stop();
+	interval   = interval_ms;
+	near_calls = near_frames;
+	running    = true;
+	PIC_AddEvent(SampleEvent, interval);
+}
+
+void GuestProfiler::Stop()
+{
+	if (!running)
+		return;
+	PIC_RemoveEvents(SampleEvent);
+	running = false;
+}
+
+void GuestProfiler::Clear()
+{
+	stacks.clear();
+	num_samples = 0;
+}
+
+void GuestProfiler::SampleEvent(uint32_t /*val*/)
+{
+	guest_profiler.Sample();
+	PIC_AddEvent(SampleEvent, guest_profiler.interval);
+}
+
+void GuestProfiler::Sample()
+{
+	const uint16_t cs_value = SegValue(cs);
+	const bool big          = cpu.code.big;
+
+	scratch.clear();
+	scratch.push_back(make_frame(cs_value, reg_eip));
+
+	const PhysPt ss_base  = SegPhys(ss);
+	const uint32_t sp_min = reg_esp & cpu.stack.mask;
+	uint32_t bp           = reg_ebp & cpu.stack.mask;
+	uint16_t seg          = cs_value;
+
+	while (bp && scratch.size() < max_depth) {
+		// Callers' frames are always higher up the stack
+		if (bp < sp_min)
+			break;
+		const PhysPt frame = ss_base + bp;
+
+		uint32_t next_bp = 0;
+		uint32_t ret_off = 0;
+		if (big) {
+			if (!read_stack(frame, next_bp) || !read_stack(frame + 4, ret_off))
+				break;
+		} else {
+			uint16_t bp16 = 0, off16 = 0;
+			if (!read_stack(frame, bp16) || !read_stack(frame + 2, off16))
+				break;
+			next_bp = bp16;
+			ret_off = off16;
+			if (!near_calls && !read_stack(frame + 4, seg))
+				break;
+		}
+		scratch.push_back(make_frame(seg, ret_off));
+
+		next_bp &= cpu.stack.mask;
+		if (next_bp <= bp)
+			break;
+		bp = next_bp;
+	}
+
+	++num_samples;
+	const auto it = stacks.find(scratch);
+	if (it != stacks.end())
+		++it->second;
+	else
+		stacks.emplace(scratch, 1);
+}
+
+bool GuestProfiler::SaveFolded(const char* filename) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+
+	for (const auto& [stack, count] : stacks) {
+		// Outermost caller first
+		for (auto frame = stack.rbegin(); frame != stack.rend(); ++frame) {
+			const auto seg = static_cast<uint16_t>(*frame >> 32);
+			const auto off = static_cast<uint32_t>(*frame);
+			fprintf(f, off > 0xffff ? "%s%04X:%08X" : "%s%04X:%04X",
+			        frame == stack.rbegin() ? "" : ";", seg, off);
+		}
+		fprintf(f, " %llu\n", static_cast<unsigned long long>(count));
+	}
+
+	const bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+#endif
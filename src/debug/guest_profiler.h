@@ -0,0 +1,97 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_GUEST_PROFILER_H
+#define DOSBOX_GUEST_PROFILER_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*  Guest profiler
+ *  --------------
+ *  Samples where the guest is executing at a fixed interval of emulated
+ *  time, driven by a PIC event, so the sampling rate doesn't depend on the
+ *  host or on the cycles setting. Each sample is CS:EIP plus the call stack
+ *  reconstructed by walking the BP chain, which works for code built with
+ *  standard stack frames; functions that haven't set up their frame yet
+ *  are attributed to their caller's caller.
+ *
+ *  Identical stacks are counted in a hash map, and the result is written
+ *  as folded stacks, one "frame;frame;...;frame count" line per stack from
+ *  the outermost caller down, as read by flamegraph.pl, speedscope and
+ *  similar tools.
+ */
+
+class GuestProfiler {
+public:
+	static constexpr double default_interval_ms = 0.1;
+	static constexpr int max_depth              = 64;
+
+	// 16-bit code is assumed to use far calls, whose frames hold the
+	// return segment above the return offset, unless near_frames is set.
+	// 32-bit code always uses near frames.
+	void Start(double interval_ms, bool near_frames);
+	void Stop();
+	bool IsRunning() const
+	{
+		return running;
+	}
+
+	// Drops the collected samples
+	void Clear();
+
+	uint64_t NumSamples() const
+	{
+		return num_samples;
+	}
+	size_t NumStacks() const
+	{
+		return stacks.size();
+	}
+
+	bool SaveFolded(const char* filename) const;
+
+private:
+	// Frames are CS:EIP or return addresses, as (segment << 32) | offset,
+	// innermost first
+	using Stack = std::vector<uint64_t>;
+
+	struct StackHash {
+		size_t operator()(const Stack& stack) const;
+	};
+
+	static void SampleEvent(uint32_t val);
+	void Sample();
+
+	std::unordered_map<Stack, uint64_t, StackHash> stacks = {};
+
+	Stack scratch        = {}; // reused, so most samples don't allocate
+	uint64_t num_samples = 0;
+	double interval      = default_interval_ms;
+	bool near_calls      = false;
+	bool running         = false;
+};
+
+extern GuestProfiler guest_profiler;
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "memwrite_trace.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "debug.h"
+#include "paging.h"
+#include "regs.h"
+#include "reverse_log.h"
+
+#if C_HEAVY_DEBUG
+
+bool memwrite_trace_active = false;
+MemWriteTrace memwrite_trace;
+
+void MEMTRACE_UpdateActive()
+{
+	memwrite_trace_active = outsideStackWriteBreakpoint ||
+	                        memwrite_trace.IsRecording() ||
+	                        reverse_log.IsRecording();
+}
+
+void MEMTRACE_LogWrite(const PhysPt address, const uint16_t size, const uint32_t value)
+{
+	if (outsideStackWriteBreakpoint) {
+		// Check if we are writing outside of the stack (between SP and BP)
+		const auto ss_value = SegValue(ss);
+		const auto top_address    = GetAddress(ss_value, reg_sp);
+		const auto bottom_address = GetAddress(ss_value, reg_bp);
+
+		// Account for pushes - a push will decrease SP after the write.
+		// The most we might write is a word, so we ignore the 2 bytes
+		// below SP
+		const bool is_on_stack = top_address - 2 <= address &&
+		                         address <= bottom_address;
+		if (!is_on_stack)
+			outsideStackWriteBreakpointHit = true;
+
+		// TODO: Could be that some code plays around with BP, need to
+		// watch out for these cases
+	}
+
+	if (memwrite_trace.IsRecording() || outsideStackWriteBreakpoint)
+		memwrite_trace.Record(address, size, value);
+
+	if (reverse_log.IsRecording())
+		reverse_log.RecordWrite(address, size);
+}
+
+void MemWriteTrace::SetRecording(const bool enabled)
+{
+	if (enabled)
+		Allocate();
+	recording = enabled;
+	MEMTRACE_UpdateActive();
+}
+
+void MemWriteTrace::Allocate()
+{
+	if (ring.empty())
+		ring.resize(default_capacity);
+}
+
+void MemWriteTrace::Resize(const size_t capacity)
+{
+	assert(capacity > 0);
+	ring.assign(capacity, {});
+	Clear();
+}
+
+void MemWriteTrace::Clear()
+{
+	next_index      = 0;
+	num_entries     = 0;
+	num_overwritten = 0;
+}
+
+void MemWriteTrace::SetAddressFilter(const PhysPt first, const PhysPt last)
+{
+	filter_address = true;
+	first_addr     = first;
+	last_addr      = last;
+}
+
+void MemWriteTrace::ClearAddressFilter()
+{
+	filter_address = false;
+}
+
+void MemWriteTrace::SetCsFilter(const uint16_t cs_value)
+{
+	filter_cs = true;
+	cs_filter = cs_value;
+}
+
+void MemWriteTrace::ClearCsFilter()
+{
+	filter_cs = false;
+}
+
+void MemWriteTrace::Record(const PhysPt address, const uint16_t size,
+                           const uint32_t value)
+{
+	// Keep writes that touch the range anywhere, not only those that start
+	// inside it
+	const auto last_byte = address + size - 1;
+	if (filter_address && (last_byte < first_addr || address > last_addr))
+		return;
+	const auto caller_seg = SegValue(cs);
+	if (filter_cs && caller_seg != cs_filter)
+		return;
+
+	const memwrite_entry entry = {caller_seg, reg_eip, address, size, value};
+	ring[next_index] = entry;
+	if (++next_index == ring.size())
+		next_index = 0;
+	if (num_entries < ring.size())
+		++num_entries;
+	else
+		++num_overwritten;
+
+	if (stream.IsRunning())
+		stream.Push(entry);
+}
+
+void MemWriteTrace::WriteText(FILE* out, const memwrite_entry* entries,
+                              const size_t n)
+{
+	for (size_t i = 0; i < n; ++i)
+		fprintf(out, "%04X:%04X %01X %02X %04X\n", entries[i].caller_seg,
+		        entries[i].caller_off, entries[i].size,
+		        entries[i].value, entries[i].address);
+}
+
+bool MemWriteTrace::StartStreaming(const char* filename)
+{
+	StopStreaming();
+	return stream.Start(filename, nullptr, 0, WriteText);
+}
+
+void MemWriteTrace::StopStreaming()
+{
+	stream.Stop();
+}
+
+bool MemWriteTrace::Save(const char* filename) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+
+	// The oldest entry is the one that will be overwritten next
+	const size_t first = num_entries < ring.size() ? 0 : next_index;
+	const size_t run   = std::min(num_entries, ring.size() - first);
+	WriteText(f, ring.data() + first, run);
+	WriteText(f, ring.data(), num_entries - run);
+
+	fclose(f);
+	return true;
+}
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_MEMWRITE_TRACE_H
+#define DOSBOX_MEMWRITE_TRACE_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "mem.h"
+#include "trace_writer.h"
+
+/*  Memory write trace
+ *  ------------------
+ *  Records guest memory writes made through mem_write*_inline while
+ *  recording (MWT) or the BPMW breakpoint is on. The most recent writes are kept in a fixed-size ring
+ *  that overwrites the oldest entries, so long sessions don't grow memory;
+ *  if every write is needed, they can additionally be streamed to a file.
+ *
+ *  Writes can be narrowed down to an address range and to code running in
+ *  a single code segment before they are recorded.
+ *
+ *  The write path itself only tests memwrite_trace_active, which is kept
+ *  up to date by this class and the BPMW stack check.
+ */
+
+struct memwrite_entry {
+	uint16_t caller_seg;
+	uint32_t caller_off;
+	PhysPt address;
+	uint16_t size;
+	uint32_t value;
+};
+
+class MemWriteTrace {
+public:
+	static constexpr size_t default_capacity = 1024 * 1024;
+
+	bool IsRecording() const
+	{
+		return recording;
+	}
+	void SetRecording(bool enabled);
+
+	// Allocates the ring with the default capacity if it has none yet
+	void Allocate();
+
+	// Drops all recorded writes and changes the size of the ring
+	void Resize(size_t capacity);
+	void Clear();
+
+	// Only writes to [first, last] are recorded
+	void SetAddressFilter(PhysPt first, PhysPt last);
+	void ClearAddressFilter();
+
+	// Only writes made by code running in this code segment are recorded
+	void SetCsFilter(uint16_t cs);
+	void ClearCsFilter();
+
+	void Record(PhysPt address, uint16_t size, uint32_t value);
+
+	// Also writes every recorded entry to the file as text, without
+	// dropping any
+	bool StartStreaming(const char* filename);
+	void StopStreaming();
+	bool IsStreaming() const
+	{
+		return stream.IsRunning();
+	}
+
+	// Writes the writes still held in the ring, oldest first
+	bool Save(const char* filename) const;
+
+	size_t Size() const
+	{
+		return num_entries;
+	}
+	uint64_t NumOverwritten() const
+	{
+		return num_overwritten;
+	}
+
+	static void WriteText(FILE* out, const memwrite_entry* entries,
+	                      size_t num_entries);
+
+private:
+	std::vector<memwrite_entry> ring = {}; // allocated when first needed
+	size_t next_index                = 0;
+	size_t num_entries               = 0;
+	uint64_t num_overwritten         = 0;
+
+	bool recording = false;
+
+	bool filter_address = false;
+	PhysPt first_addr   = 0;
+	PhysPt last_addr    = 0;
+
+	bool filter_cs     = false;
+	uint16_t cs_filter = 0;
+
+	TraceWriter<memwrite_entry> stream = {};
+};
+
+extern MemWriteTrace memwrite_trace;
+
+// Recomputes memwrite_trace_active after the recording, BPMW or reverse log
+// state changed
+void MEMTRACE_UpdateActive();
+
+#endif
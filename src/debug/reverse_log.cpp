@@ -0,0 +1,277 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "reverse_log.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "cpu.h"
+#include "memwrite_trace.h"
+#include "paging.h"
+#include "regs.h"
+#include "../cpu/lazyflags.h"
+
+#if C_HEAVY_DEBUG
+
+ReverseLog reverse_log;
+
+struct ReverseLog::CpuState {
+	CPU_Regs regs      = {};
+	Segments segs      = {};
+	LazyFlags lflags   = {};
+	Bitu cpl           = 0;
+	Bitu mpl           = 0;
+	Bitu cr0           = 0;
+	Bitu cr3           = 0;
+	Bitu stack_mask    = 0;
+	Bitu stack_notmask = 0;
+	Bits direction     = 0;
+	bool pmode         = false;
+	bool stack_big     = false;
+	bool code_big      = false;
+
+	// Journal position when the instruction started
+	uint64_t write_pos = 0;
+
+	void Capture()
+	{
+		regs          = cpu_regs;
+		segs          = Segs;
+		lflags        = ::lflags;
+		cpl           = cpu.cpl;
+		mpl           = cpu.mpl;
+		cr0           = cpu.cr0;
+		cr3           = PAGING_GetDirBase();
+		stack_mask    = cpu.stack.mask;
+		stack_notmask = cpu.stack.notmask;
+		direction     = cpu.direction;
+		pmode         = cpu.pmode;
+		stack_big     = cpu.stack.big;
+		code_big      = cpu.code.big;
+	}
+
+	void Restore() const
+	{
+		cpu_regs          = regs;
+		Segs              = segs;
+		::lflags          = lflags;
+		cpu.cpl           = cpl;
+		cpu.mpl           = mpl;
+		cpu.stack.mask    = stack_mask;
+		cpu.stack.notmask = stack_notmask;
+		cpu.direction     = direction;
+		cpu.pmode         = pmode;
+		cpu.stack.big     = stack_big;
+		cpu.code.big      = code_big;
+	}
+
+	// Whether the CPU is still where this state was taken, which is the
+	// case for the instruction the debugger stopped at
+	bool IsCurrent(const uint64_t current_write_pos) const
+	{
+		return write_pos == current_write_pos &&
+		       memcmp(&regs, &cpu_regs, sizeof(regs)) == 0 &&
+		       memcmp(&segs, &Segs, sizeof(segs)) == 0;
+	}
+};
+
+ReverseLog::ReverseLog() = default;
+
+ReverseLog::~ReverseLog() = default;
+
+void ReverseLog::SetRecording(const bool enabled, const size_t num_instructions)
+{
+	state_first = state_end = 0;
+	write_first = write_end = 0;
+	num_lost_writes         = 0;
+
+	if (enabled) {
+		assert(num_instructions > 0);
+		states.assign(num_instructions, {});
+		writes.assign(num_instructions * writes_per_instruction, {});
+	} else {
+		// Whatever runs from here on isn't journalled, so the log
+		// can't be used anymore
+		states = {};
+		writes = {};
+	}
+	recording = enabled;
+	MEMTRACE_UpdateActive();
+}
+
+const ReverseLog::CpuState& ReverseLog::StateAt(const uint64_t pos) const
+{
+	assert(pos >= state_first && pos < state_end);
+	return states[pos % states.size()];
+}
+
+void ReverseLog::RecordInstruction()
+{
+	// The instruction the debugger stopped at is seen again once resumed
+	if (state_end != state_first && StateAt(state_end - 1).IsCurrent(write_end))
+		return;
+
+	if (state_end - state_first == states.size())
+		++state_first;
+	auto& state = states[state_end % states.size()];
+	state.Capture();
+	state.write_pos = write_end;
+	++state_end;
+}
+
+void ReverseLog::PushWrite(const PhysPt address, const uint16_t size,
+                           const uint32_t old_value)
+{
+	if (write_end - write_first == writes.size())
+		++write_first;
+	writes[write_end % writes.size()] = {address, old_value, size};
+	++write_end;
+}
+
+void ReverseLog::JournalBytes(const PhysPt address, const uint16_t size)
+{
+	// Only memory that reads back without side effects can be journalled;
+	// the TLB may not have the page linked yet, so fall back to its handler
+	HostPt host = nullptr;
+	if (const HostPt tlb_addr = get_tlb_read(address)) {
+		host = tlb_addr + address;
+	} else {
+		Bitu phys_page = address >> 12;
+		if (PAGING_MakePhysPage(phys_page) && phys_page < MEM_TotalPages()) {
+			PageHandler* handler = MEM_GetPageHandler(phys_page);
+			if (handler->flags & PFLAG_READABLE)
+				host = handler->GetHostReadPt(phys_page) +
+				       (address & 4095);
+		}
+	}
+	if (!host) {
+		++num_lost_writes;
+		return;
+	}
+
+	switch (size) {
+	case 1: PushWrite(address, size, host_readb(host)); break;
+	case 2: PushWrite(address, size, host_readw(host)); break;
+	default: PushWrite(address, size, host_readd(host)); break;
+	}
+}
+
+void ReverseLog::RecordWrite(const PhysPt address, const uint16_t size)
+{
+	// Writes that cross a page are journalled per byte, as the two pages
+	// needn't be next to each other in host memory
+	if ((address & 4095) + size > 4096) {
+		for (uint16_t i = 0; i < size; ++i)
+			JournalBytes(address + i, 1);
+		return;
+	}
+	JournalBytes(address, size);
+}
+
+void ReverseLog::DropCurrentState()
+{
+	if (state_end != state_first && StateAt(state_end - 1).IsCurrent(write_end))
+		--state_end;
+}
+
+size_t ReverseLog::NumInstructions() const
+{
+	// States whose writes have partly left the journal can't be restored
+	uint64_t pos = state_end;
+	while (pos > state_first && StateAt(pos - 1).write_pos >= write_first)
+		--pos;
+	size_t count = static_cast<size_t>(state_end - pos);
+	if (count && StateAt(state_end - 1).IsCurrent(write_end))
+		--count;
+	return count;
+}
+
+size_t ReverseLog::StepBackTo(const uint64_t target_pos)
+{
+	// The journal holds linear addresses, so stay within the paging setup
+	// that's current now
+	const Bitu cr0 = cpu.cr0;
+	const Bitu cr3 = PAGING_GetDirBase();
+
+	uint64_t pos = state_end;
+	while (pos > target_pos) {
+		const auto& state = StateAt(pos - 1);
+		if (state.cr0 != cr0 || state.cr3 != cr3 || state.write_pos < write_first)
+			break;
+		--pos;
+	}
+	if (pos == state_end)
+		return 0;
+
+	const auto& target = StateAt(pos);
+
+	// The checked writes bypass the journal, and still go through the
+	// page handlers so dynamic code and the debugger caches see them
+	while (write_end > target.write_pos) {
+		--write_end;
+		const auto& entry = writes[write_end % writes.size()];
+		switch (entry.size) {
+		case 1:
+			mem_writeb_checked(entry.address,
+			                   static_cast<uint8_t>(entry.old_value));
+			break;
+		case 2:
+			mem_writew_checked(entry.address,
+			                   static_cast<uint16_t>(entry.old_value));
+			break;
+		default: mem_writed_checked(entry.address, entry.old_value); break;
+		}
+	}
+	target.Restore();
+
+	const auto undone = static_cast<size_t>(state_end - pos);
+	state_end         = pos;
+	return undone;
+}
+
+size_t ReverseLog::StepBack(const size_t count)
+{
+	DropCurrentState();
+	const auto available = std::min<uint64_t>(count, state_end - state_first);
+	if (!available)
+		return 0;
+	return StepBackTo(state_end - available);
+}
+
+size_t ReverseLog::StepBackToWrite(const PhysPt address)
+{
+	DropCurrentState();
+	for (uint64_t pos = write_end; pos > write_first; --pos) {
+		const auto& entry = writes[(pos - 1) % writes.size()];
+		if (address < entry.address || address >= entry.address + entry.size)
+			continue;
+
+		// The write belongs to the newest instruction started before it
+		for (uint64_t state = state_end; state > state_first; --state)
+			if (StateAt(state - 1).write_pos <= pos - 1)
+				return StepBackTo(state - 1);
+		return 0;
+	}
+	return 0;
+}
+
+#endif
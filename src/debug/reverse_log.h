@@ -0,0 +1,122 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_REVERSE_LOG_H
+#define DOSBOX_REVERSE_LOG_H
+
+#include "dosbox.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "mem.h"
+
+/*  Reverse execution log
+ *  ---------------------
+ *  Lets the debugger step back through the most recently executed
+ *  instructions. While recording, the CPU state is checkpointed before every
+ *  instruction, and every guest memory write first journals the bytes it is
+ *  about to overwrite. Stepping back undoes the journalled writes newest
+ *  first, down to the chosen instruction, and then restores its CPU state.
+ *  Both logs are fixed-size rings, so only the last instructions can be
+ *  stepped back over.
+ *
+ *  Only the CPU and guest memory are rewound. Devices, timers and the FPU
+ *  keep their current state, and emulation simply continues from the
+ *  restored point once resumed. The journal sees the writes that go through
+ *  mem_write*_inline, which is every write made by the normal core and by
+ *  the DOS and BIOS emulation; writes from the dynamic cores, from DMA and
+ *  to memory that can't be read back without side effects, like VGA
+ *  memory, aren't journalled. Changes of CR0 or CR3 can't be stepped back
+ *  over.
+ */
+
+class ReverseLog {
+public:
+	static constexpr size_t default_instructions = 100 * 1000;
+
+	// Each instruction writes about this many times on average
+	static constexpr size_t writes_per_instruction = 4;
+
+	ReverseLog();
+	~ReverseLog();
+
+	bool IsRecording() const
+	{
+		return recording;
+	}
+	// Starting drops whatever was recorded before
+	void SetRecording(bool enabled, size_t num_instructions = default_instructions);
+
+	// Called before every instruction
+	void RecordInstruction();
+
+	// Called before every memory write
+	void RecordWrite(PhysPt address, uint16_t size);
+
+	// Instructions that can be stepped back over
+	size_t NumInstructions() const;
+
+	// Writes that couldn't be journalled since recording started
+	uint64_t NumLostWrites() const
+	{
+		return num_lost_writes;
+	}
+
+	// Steps back up to count instructions, returns how many were undone
+	size_t StepBack(size_t count);
+
+	// Steps back to just before the most recent journalled write that
+	// touched the linear address. Returns how many instructions were
+	// undone, or zero if there is no such write in the log.
+	size_t StepBackToWrite(PhysPt address);
+
+private:
+	struct CpuState;
+
+	struct WriteEntry {
+		PhysPt address     = 0;
+		uint32_t old_value = 0;
+		uint16_t size      = 0;
+	};
+
+	void PushWrite(PhysPt address, uint16_t size, uint32_t old_value);
+	void JournalBytes(PhysPt address, uint16_t size);
+	const CpuState& StateAt(uint64_t pos) const;
+	void DropCurrentState();
+	size_t StepBackTo(uint64_t target_pos);
+
+	// Both rings are addressed by the running count of entries ever
+	// recorded, the oldest entries still held start at *_first
+	std::vector<CpuState> states;
+	uint64_t state_first = 0;
+	uint64_t state_end   = 0;
+
+	std::vector<WriteEntry> writes;
+	uint64_t write_first = 0;
+	uint64_t write_end   = 0;
+
+	uint64_t num_lost_writes = 0;
+	bool recording           = false;
+};
+
+extern ReverseLog reverse_log;
+
+#endif
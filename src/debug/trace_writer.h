@@ -0,0 +1,153 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_TRACE_WRITER_H
+#define DOSBOX_TRACE_WRITER_H
+
+#include "dosbox.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "spsc_ring.h"
+
+/*  Trace writer
+ *  ------------
+ *  Streams fixed-size trace records from the emulation thread to a file.
+ *  The emulation thread only copies each record into a lock-free ring; a
+ *  background thread drains the ring and hands the records to a sink,
+ *  which by default writes them out verbatim.
+ */
+
+template <typename T>
+class TraceWriter {
+public:
+	using sink_f = void (*)(FILE* out, const T* records, size_t num_records);
+
+	static void WriteBinary(FILE* out, const T* records, const size_t num_records)
+	{
+		fwrite(records, sizeof(T), num_records, out);
+	}
+
+	TraceWriter() = default;
+	~TraceWriter()
+	{
+		Stop();
+	}
+
+	TraceWriter(const TraceWriter&)            = delete;
+	TraceWriter& operator=(const TraceWriter&) = delete;
+
+	// The optional header is written before any record. A writer that is
+	// still running is stopped first, so its file is flushed and closed.
+	bool Start(const char* filename, const void* header = nullptr,
+	           const size_t header_size = 0, sink_f _sink = WriteBinary)
+	{
+		Stop();
+
+		file = fopen(filename, _sink == WriteBinary ? "wb" : "w");
+		if (!file)
+			return false;
+		if (header_size)
+			fwrite(header, header_size, 1, file);
+
+		sink         = _sink;
+		num_records  = 0;
+		num_stalls   = 0;
+		keep_running = true;
+		thread       = std::thread(&TraceWriter::Drain, this);
+		return true;
+	}
+
+	// Flushes everything still queued and closes the file
+	void Stop()
+	{
+		if (!IsRunning())
+			return;
+
+		keep_running = false;
+		thread.join();
+		fclose(file);
+		file = nullptr;
+	}
+
+	bool IsRunning() const
+	{
+		return file != nullptr;
+	}
+
+	// Called from the emulation thread. Waits for the writer when the ring
+	// is full rather than dropping the record; those waits are counted.
+	void Push(const T& rec)
+	{
+		while (!ring.TryPush(rec)) {
+			++num_stalls;
+			std::this_thread::yield();
+		}
+		++num_records;
+	}
+
+	uint64_t NumRecords() const
+	{
+		return num_records;
+	}
+
+	uint64_t NumStalls() const
+	{
+		return num_stalls;
+	}
+
+private:
+	void Drain()
+	{
+		using namespace std::chrono_literals;
+
+		std::vector<T> batch(4096);
+		while (true) {
+			// Read the flag first so nothing pushed before Stop() is
+			// missed
+			const bool stopping = !keep_running;
+
+			const auto n = ring.PopBulk(batch.data(), batch.size());
+			if (n) {
+				sink(file, batch.data(), n);
+				continue;
+			}
+			if (stopping)
+				break;
+			std::this_thread::sleep_for(1ms);
+		}
+		fflush(file);
+	}
+
+	SpscRing<T> ring               = SpscRing<T>(64 * 1024);
+	FILE* file                     = nullptr;
+	sink_f sink                    = WriteBinary;
+	std::thread thread             = {};
+	std::atomic<bool> keep_running = false;
+	uint64_t num_records           = 0;
+	uint64_t num_stalls            = 0;
+};
+
+#endif
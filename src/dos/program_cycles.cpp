@@ -0,0 +1,88 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "program_cycles.h"
+
+#include <cmath>
+
+#include "cpu.h"
+#include "program_more_output.h"
+
+void CYCLES::Run(void)
+{
+	if (HelpRequested()) {
+		MoreOutputStrings output(*this);
+		output.AddString(MSG_Get("PROGRAM_CYCLES_HELP_LONG"));
+		output.Display();
+		return;
+	}
+
+	if (CPU_CycleAutoAdjust) {
+		WriteOut(MSG_Get("PROGRAM_CYCLES_AUTO"), CPU_CycleMax, CPU_CyclePercUsed);
+		if (CPU_CycleLimit > 0)
+			WriteOut(MSG_Get("PROGRAM_CYCLES_LIMIT"), CPU_CycleLimit);
+	} else {
+		WriteOut(MSG_Get("PROGRAM_CYCLES_FIXED"), CPU_CycleMax);
+	}
+
+	const auto& stats = CPU_AutoCyclesStats;
+	if (!stats.num_windows) {
+		WriteOut(MSG_Get("PROGRAM_CYCLES_NO_STATS"));
+		return;
+	}
+	WriteOut(MSG_Get("PROGRAM_CYCLES_STATS"),
+	         stats.achieved_cycles,
+	         static_cast<int>(std::lround(stats.host_utilization * 100.0)),
+	         static_cast<int>(stats.slept_us / 1000),
+	         stats.ns_per_cycle,
+	         static_cast<long long>(stats.overruns));
+}
+
+void CYCLES::AddMessages()
+{
+	MSG_Add("PROGRAM_CYCLES_HELP_LONG",
+	        "Displays the emulated CPU speed and how the host keeps up with it.\n"
+	        "\n"
+	        "Usage:\n"
+	        "  [color=light-green]cycles[reset]\n"
+	        "\n"
+	        "Where:\n"
+	        "  This command has no parameters.\n"
+	        "\n"
+	        "Notes:\n"
+	        "  With automatic cycles, the cycles are adjusted so that emulating the CPU\n"
+	        "  takes the configured share of the host's time. The figures shown are\n"
+	        "  measured over the last 50 milliseconds; overruns count how often the\n"
+	        "  emulation has fallen behind real time since start-up.\n"
+	        "\n"
+	        "Examples:\n"
+	        "  [color=light-green]cycles[reset]\n");
+	MSG_Add("PROGRAM_CYCLES_AUTO",
+	        "Cycles:           auto, %d per millisecond (max %d%% of the host)\n");
+	MSG_Add("PROGRAM_CYCLES_LIMIT", "Cycle limit:      %d\n");
+	MSG_Add("PROGRAM_CYCLES_FIXED", "Cycles:           fixed, %d per millisecond\n");
+	MSG_Add("PROGRAM_CYCLES_NO_STATS", "No measurements yet.\n");
+	MSG_Add("PROGRAM_CYCLES_STATS",
+	        "Achieved:         %d cycles per host millisecond\n"
+	        "Host utilization: %d%%\n"
+	        "Slept:            %d ms\n"
+	        "Cost per cycle:   %.2f ns\n"
+	        "Overruns:         %lld\n");
+}
@@ -21,7 +21,9 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
@@ -125,13 +127,18 @@ void INT10_Init(Section*);
 static LoopHandler * loop;
 
 static int64_t ticksRemain;
+static int64_t ticksRemainAdded;
 static int64_t ticksLast;
-static int64_t ticksAdded;
-int64_t ticksDone;
-int64_t ticksScheduled;
 bool ticksLocked;
 void increaseticks();
 
+// Where a headless run started, for the report on exit
+static struct {
+	int64_t start_us     = 0;
+	uint32_t start_ticks = 0;
+	int64_t start_cycles = 0;
+} headless_run = {};
+
 bool mono_cga=false;
 
 void Null_Init([[maybe_unused]] Section *sec) {
@@ -156,6 +163,7 @@ static Bitu Normal_Loop() {
 			if (!GFX_Events())
 				return 0;
 			if (ticksRemain > 0) {
+				CPU_IdleStats.total_cycles += CPU_CycleMax;
 				TIMER_AddTick();
 				ticksRemain--;
 			} else {increaseticks();return 0;}
@@ -163,149 +171,199 @@ static Bitu Normal_Loop() {
 	}
 }
 
+// Sleeps until the tick of the next scheduled event, or until there's input
+static void sleep_while_idle(const int64_t now_us)
+{
+	// Longer sleeps are caught up on in one go, so keep them short enough
+	// for the audio not to run dry
+	constexpr int64_t max_idle_ticks = 5;
+
+	int64_t ticks_to_sleep = max_idle_ticks;
+	const auto next_event  = PIC_GetNextEventIndex();
+	if (next_event >= 0.0)
+		ticks_to_sleep = std::clamp(static_cast<int64_t>(next_event),
+		                            static_cast<int64_t>(1), max_idle_ticks);
+
+	const auto wake_us = (ticksLast + ticks_to_sleep) * 1000;
+	const auto timeout_ms = static_cast<int>((wake_us - now_us + 999) / 1000);
+	if (timeout_ms > 0)
+		GFX_WaitForEvents(timeout_ms);
+}
+
+/*  Auto cycles governor
+ *  --------------------
+ *  With cycles=auto, the cycles per emulated millisecond are steered so
+ *  that emulating a millisecond takes the configured share of a host
+ *  millisecond, minus some headroom for rendering, audio and host jitter.
+ *
+ *  Over each measuring window, the host time spent emulating (everything
+ *  except the spare time between ticks, slept or spent warming up the
+ *  dynamic core's cache) is divided by the cycles that actually had to be
+ *  run, leaving out those skipped as IO delay or idle time. The smoothed host cost of a cycle then gives the cycles that fit
+ *  into the budget, and the current setting is moved part of the way
+ *  there, by at most a factor of two per window.
+ */
+
+AutoCyclesStats CPU_AutoCyclesStats = {};
+
+constexpr int64_t auto_cycles_window_us = 50'000;
+constexpr int64_t auto_cycles_stall_us  = 1'000'000; // host stalled us
+constexpr double auto_cycles_headroom   = 0.1;
+constexpr double auto_cycles_smoothing  = 0.25; // weight of a new sample
+constexpr double auto_cycles_gain       = 0.5;
+constexpr int32_t auto_cycles_max       = 2000000; // without a cycle limit
+
+static struct {
+	int64_t start_us    = 0;
+	int64_t last_us     = 0;
+	int64_t longest_gap = 0;
+	int64_t slept_us    = 0;
+	int64_t ticks       = 0;
+	// Smoothed host nanoseconds per cycle, or 0 without a sample yet
+	double ns_per_cycle = 0.0;
+} auto_cycles = {};
+
+static void start_auto_cycles_window(const int64_t now_us)
+{
+	auto_cycles.start_us    = now_us;
+	auto_cycles.last_us     = now_us;
+	auto_cycles.longest_gap = 0;
+	auto_cycles.slept_us    = 0;
+	auto_cycles.ticks       = 0;
+	CPU_IODelayRemoved      = 0;
+}
+
+void CPU_Reset_AutoAdjust()
+{
+	start_auto_cycles_window(GetTicksUs());
+}
+
+static void publish_auto_cycles_stats(const double achieved_cycles,
+                                      const double utilization,
+                                      const int64_t window_slept_us)
+{
+	auto& stats            = CPU_AutoCyclesStats;
+	stats.achieved_cycles  = static_cast<int32_t>(achieved_cycles);
+	stats.host_utilization = utilization;
+	stats.slept_us         = window_slept_us;
+	stats.ns_per_cycle     = auto_cycles.ns_per_cycle;
+	++stats.num_windows;
+
+	TracyPlot("Auto cycles: cycles", static_cast<int64_t>(CPU_CycleMax));
+	TracyPlot("Auto cycles: achieved", achieved_cycles);
+	TracyPlot("Auto cycles: host utilization", utilization * 100.0);
+	TracyPlot("Auto cycles: slept ms", static_cast<double>(window_slept_us) / 1000.0);
+	TracyPlot("Auto cycles: overruns", stats.overruns);
+}
+
+static void update_auto_cycles(const int64_t now_us)
+{
+	const auto wall_us = now_us - auto_cycles.start_us;
+	if (wall_us < auto_cycles_window_us)
+		return;
+
+	const auto slept_us = auto_cycles.slept_us;
+	const auto busy_us  = std::max(wall_us - slept_us, static_cast<int64_t>(1));
+	const auto scheduled_cycles = static_cast<double>(CPU_CycleMax) *
+	                              static_cast<double>(auto_cycles.ticks);
+	const auto removed_cycles = std::clamp(static_cast<double>(CPU_IODelayRemoved),
+	                                       0.0,
+	                                       scheduled_cycles);
+	const auto run_cycles = scheduled_cycles - removed_cycles;
+	const auto stalled = auto_cycles.longest_gap >= auto_cycles_stall_us;
+
+	publish_auto_cycles_stats(run_cycles * 1000.0 / static_cast<double>(wall_us),
+	                          static_cast<double>(busy_us) /
+	                                  static_cast<double>(wall_us),
+	                          slept_us);
+	start_auto_cycles_window(now_us);
+
+	// Without enough cycles run, such as while the guest idles, the cost
+	// can't be measured reliably; neither after the host stalled us
+	if (!CPU_CycleAutoAdjust || stalled || run_cycles < scheduled_cycles * 0.01 ||
+	    run_cycles < 1000.0)
+		return;
+
+	const auto sample = static_cast<double>(busy_us) * 1000.0 / run_cycles;
+	auto& ns_per_cycle = auto_cycles.ns_per_cycle;
+	ns_per_cycle = ns_per_cycle > 0.0
+	                     ? ns_per_cycle + auto_cycles_smoothing * (sample - ns_per_cycle)
+	                     : sample;
+
+	// Only the cycles that aren't skipped cost host time
+	const auto run_share = std::max(run_cycles / scheduled_cycles, 0.1);
+	const auto budget_ns = 1'000'000.0 * (1.0 - auto_cycles_headroom) *
+	                       CPU_CyclePercUsed / 100.0;
+	const auto target = budget_ns / (ns_per_cycle * run_share);
+
+	const auto current = static_cast<double>(CPU_CycleMax);
+	auto next = current + auto_cycles_gain * (target - current);
+	next = std::clamp(next, current / 2.0, current * 2.0);
+
+	const auto upper_limit = CPU_CycleLimit > 0 ? CPU_CycleLimit : auto_cycles_max;
+	CPU_CycleMax = std::clamp(static_cast<int32_t>(next),
+	                          static_cast<int32_t>(CPU_CYCLES_LOWER_LIMIT),
+	                          std::max(upper_limit,
+	                                   static_cast<int32_t>(CPU_CYCLES_LOWER_LIMIT)));
+}
+
 void increaseticks() { //Make it return ticksRemain and set it in the function above to remove the global variable.
 	ZoneScoped;
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
 		ticksLast = GetTicks();
-		ticksAdded = 0;
-		ticksDone = 0;
-		ticksScheduled = 0;
+		ticksRemainAdded = 0;
+		CPU_Reset_AutoAdjust();
 		return;
 	}
 
 	const auto ticksNewUs = GetTicksUs();
 	const auto ticksNew = ticksNewUs / 1000;
 
-	ticksScheduled += ticksAdded;
-	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
-		ticksAdded = 0;
-
-		static int64_t cumulativeTimeSlept = 0;
+	// The ticks handed out last time have been emulated by now
+	auto_cycles.ticks += ticksRemainAdded;
+	ticksRemainAdded = 0;
+	auto_cycles.longest_gap = std::max(auto_cycles.longest_gap,
+	                                   ticksNewUs - auto_cycles.last_us);
+	auto_cycles.last_us = ticksNewUs;
 
-		constexpr auto sleepDuration = std::chrono::microseconds(1000);
-		std::this_thread::sleep_for(sleepDuration);
-
-		const auto timeslept = GetTicksUsSince(ticksNewUs);
-
-		cumulativeTimeSlept += timeslept;
-
-		// Update ticksDone with the total time spent sleeping
-		if (cumulativeTimeSlept >= 1000) {
-			const auto cumulativeTicksSlept = cumulativeTimeSlept / 1000;
-			ticksDone -= cumulativeTicksSlept;
-			cumulativeTimeSlept %= 1000;
+	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
+		// Spend the time to spare translating code that earlier sessions
+		// ran, rather than when the guest first gets to it
+		const auto wake_us = (ticksLast + 1) * 1000;
+		CPU_WarmDynamicCache(wake_us);
+		const auto now_us = GetTicksUs();
+
+		if (CPU_IsIdle()) {
+			sleep_while_idle(now_us);
+		} else if (now_us < wake_us) {
+			// Sleep until the next tick is due
+			std::this_thread::sleep_for(
+			        std::chrono::microseconds(wake_us - now_us));
 		}
 
-		if (ticksDone < 0)
-			ticksDone = 0;
-		return; //0
-
-		// If we do work this tick and sleep till the next tick, then ticksDone is decreased,
-		// despite the fact that work was done as well in this tick. Maybe make it depend on an extra parameter.
-		// What do we know: ticksRemain = 0 (condition to enter this function)
-		// ticksNew = time before sleeping
-
-		// maybe keep track of sleeped time in this frame, and use sleeped and done as indicators. (and take care of the fact there
-		// are frames that have both.
+		// The time spent warming up was spare all the same, so to the
+		// auto cycles governor it counts as slept
+		const auto timeslept = GetTicksUsSince(now_us);
+		CPU_IdleStats.slept_us += timeslept;
+		auto_cycles.slept_us += timeslept + (now_us - ticksNewUs);
+		auto_cycles.last_us = GetTicksUs();
+		return;
 	}
 
 	//TicksNew > ticksLast
 	ticksRemain = GetTicksDiff(ticksNew, ticksLast);
 	ticksLast = ticksNew;
-	ticksDone += ticksRemain;
+	if (ticksRemain > 1)
+		++CPU_AutoCyclesStats.overruns;
 	if ( ticksRemain > 20 ) {
 //		LOG(LOG_MISC,LOG_ERROR)("large remain %d",ticksRemain);
 		ticksRemain = 20;
 	}
-	ticksAdded = ticksRemain;
-
-	// Is the system in auto cycle mode guessing ? If not just exit. (It can be temporary disabled)
-	if (!CPU_CycleAutoAdjust) return;
-
-	if (ticksScheduled >= 100 || ticksDone >= 100 || (ticksAdded > 15 && ticksScheduled >= 5) ) {
-		if(ticksDone < 1) ticksDone = 1; // Protect against div by zero
-		// Ratio we are aiming for is 100% usage
-		int32_t ratio = static_cast<int32_t>(
-		        (ticksScheduled * (CPU_CyclePercUsed * 1024 / 100)) /
-		        ticksDone);
-
-		int32_t new_cmax = CPU_CycleMax;
-		int64_t cproc = (int64_t)CPU_CycleMax * (int64_t)ticksScheduled;
-		double ratioremoved = 0.0; //increase scope for logging
-		if (cproc > 0) {
-			/* ignore the cycles added due to the IO delay code in order
-			   to have smoother auto cycle adjustments */
-			ratioremoved = (double) CPU_IODelayRemoved / (double) cproc;
-			if (ratioremoved < 1.0) {
-				double ratio_not_removed = 1 - ratioremoved;
-				ratio = (int32_t)((double)ratio * ratio_not_removed);
-
-				/* Don't allow very high ratio which can cause us to lock as we don't scale down
-				 * for very low ratios. High ratio might result because of timing resolution */
-				if (ticksScheduled >= 100 && ticksDone < 10 && ratio > 16384)
-					ratio = 16384;
-
-				// Limit the ratio even more when the cycles are already way above the realmode default.
-				if (ticksScheduled >= 100 && ticksDone < 10 && ratio > 5120 && CPU_CycleMax > 50000)
-					ratio = 5120;
-
-				// When downscaling multiple times in a row, ensure a minimum amount of downscaling
-				if (ticksAdded > 15 && ticksScheduled >= 5 && ticksScheduled <= 20 && ratio > 800)
-					ratio = 800;
-
-				if (ratio <= 1024) {
-					// ratio_not_removed = 1.0; //enabling this restores the old formula
-					double r = (1.0 + ratio_not_removed) /(ratio_not_removed + 1024.0/(static_cast<double>(ratio)));
-					new_cmax = 1 + static_cast<int32_t>(CPU_CycleMax * r);
-				} else {
-					int64_t ratio_with_removed = (int64_t) ((((double)ratio - 1024.0) * ratio_not_removed) + 1024.0);
-					int64_t cmax_scaled = (int64_t)CPU_CycleMax * ratio_with_removed;
-					new_cmax = (int32_t)(1 + (CPU_CycleMax >> 1) + cmax_scaled / (int64_t)2048);
-				}
-			}
-		}
-
-		if (new_cmax < CPU_CYCLES_LOWER_LIMIT)
-			new_cmax = CPU_CYCLES_LOWER_LIMIT;
-		/*
-		LOG_INFO("cyclelog: current %06d   cmax %06d   ratio  %05d  done %03d   sched %03d Add %d rr %4.2f",
-			CPU_CycleMax,
-			new_cmax,
-			ratio,
-			ticksDone,
-			ticksScheduled,
-			ticksAdded,
-			ratioremoved);
-		*/
-
-		/* ratios below 1% are considered to be dropouts due to
-		   temporary load imbalance, the cycles adjusting is skipped */
-		if (ratio > 10) {
-			/* ratios below 12% along with a large time since the last update
-			   has taken place are most likely caused by heavy load through a
-			   different application, the cycles adjusting is skipped as well */
-			if ((ratio > 120) || (ticksDone < 700)) {
-				CPU_CycleMax = new_cmax;
-				if (CPU_CycleLimit > 0) {
-					if (CPU_CycleMax > CPU_CycleLimit) CPU_CycleMax = CPU_CycleLimit;
-				} else if (CPU_CycleMax > 2000000) CPU_CycleMax = 2000000; //Hardcoded limit, if no limit was specified.
-			}
-		}
+	ticksRemainAdded = ticksRemain;
 
-		//Reset cycleguessing parameters.
-		CPU_IODelayRemoved = 0;
-		ticksDone = 0;
-		ticksScheduled = 0;
-	} else if (ticksAdded > 15) {
-		/* ticksAdded > 15 but ticksScheduled < 5, lower the cycles
-		   but do not reset the scheduled/done ticks to take them into
-		   account during the next auto cycle adjustment */
-		CPU_CycleMax /= 3;
-		if (CPU_CycleMax < CPU_CYCLES_LOWER_LIMIT)
-			CPU_CycleMax = CPU_CYCLES_LOWER_LIMIT;
-	} //if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) )
+	update_auto_cycles(ticksNewUs);
 }
 
 void DOSBOX_SetLoop(LoopHandler * handler) {
@@ -335,7 +393,8 @@ static void DOSBOX_UnlockSpeed( bool pressed ) {
 		}
 	} else {
 		LOG_MSG("Fast Forward OFF");
-		ticksLocked = false;
+		// Headless runs are never throttled
+		ticksLocked = control->arguments.headless;
 		if (autoadjust) {
 			autoadjust = false;
 			CPU_CycleAutoAdjust = true;
@@ -388,15 +447,42 @@ void DOSBOX_SetMachineTypeFromConfig(Section_prop* section)
 	       (machine != MCH_VGA && svgaCard == SVGA_None));
 }
 
+static void DOSBOX_ShutDown([[maybe_unused]] Section* sec)
+{
+	if (!control->arguments.headless)
+		return;
+
+	const auto wall_s = static_cast<double>(
+	                            GetTicksUsSince(headless_run.start_us)) / 1e6;
+	const auto emulated_s = static_cast<double>(PIC_Ticks -
+	                                            headless_run.start_ticks) /
+	                        millis_in_second;
+	const auto cycles = CPU_IdleStats.total_cycles - headless_run.start_cycles;
+
+	LOG_MSG("DOSBOX: Emulated %.2f s in %.2f s of wall-clock time (%.1fx real time), %" PRId64 " cycles",
+	        emulated_s,
+	        wall_s,
+	        wall_s > 0.0 ? emulated_s / wall_s : 0.0,
+	        cycles);
+}
+
 static void DOSBOX_RealInit(Section* sec)
 {
 	Section_prop* section = static_cast<Section_prop*>(sec);
 	/* Initialize some dosbox internals */
 	ticksRemain = 0;
 	ticksLast   = GetTicks();
-	ticksLocked = false;
+	// Headless runs hand out ticks as fast as they're emulated
+	ticksLocked = control->arguments.headless;
 	DOSBOX_SetLoop(&Normal_Loop);
 
+	if (control->arguments.headless) {
+		headless_run.start_us     = GetTicksUs();
+		headless_run.start_ticks  = PIC_Ticks;
+		headless_run.start_cycles = CPU_IdleStats.total_cycles;
+		sec->AddDestroyFunction(&DOSBOX_ShutDown);
+	}
+
 	MAPPER_AddHandler(DOSBOX_UnlockSpeed, SDL_SCANCODE_F12, MMOD2, "speedlock", "Speedlock");
 
 	DOSBOX_SetMachineTypeFromConfig(section);
@@ -663,6 +749,19 @@ void DOSBOX_Init()
 	pstring->Set_help("CPU core used in emulation ('auto' by default). 'auto' will switch to dynamic\n"
 	                  "if available and appropriate.");
 
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+	pint = secprop->Add_int("dynamic_cache_size", only_at_start, 8);
+	pint->SetMinMax(1, 256);
+	pint->Set_help("Size of the dynamic core's translation cache in MB (8 by default).\n"
+	               "Programs with a lot of code may run faster with a larger cache; the\n"
+	               "DYNCACHE debugger command shows how often code had to be translated again.");
+
+	pbool = secprop->Add_bool("dynamic_cache_persist", only_at_start, false);
+	pbool->Set_help("Remember where the dynamic core translated code in 'dynamic_cache.bin' in the\n"
+	                "config directory, so the same code is translated ahead of time, while the host\n"
+	                "has time to spare, on the next run (disabled by default).");
+#endif
+
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", nullptr};
 	pstring = secprop->Add_string("cputype", always, "auto");
 	pstring->Set_values(cputype_values);
@@ -696,6 +795,17 @@ void DOSBOX_Init()
 	pint->SetMinMax(1, 1000000);
 	pint->Set_help("Setting it lower than 100 will be a percentage (20 by default).");
 
+	const char* idle_detection_values[] = {"off", "halt", "polling", nullptr};
+	pstring = secprop->Add_string("idle_detection", always, "off");
+	pstring->Set_values(idle_detection_values);
+	pstring->Set_help(
+	        "Let the host sleep while the guest waits ('off' by default).\n"
+	        "  off:      Sleep in 1 ms steps once the cycles of a tick are done.\n"
+	        "  halt:     While the CPU is halted with interrupts enabled, sleep until\n"
+	        "            the next scheduled event or until there's input.\n"
+	        "  polling:  Also treat tight loops reading the keyboard status\n"
+	        "            ports as waiting, which skips ahead to the next event.");
+
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
 #endif
@@ -321,7 +321,9 @@ void GFX_SetTitle(const int32_t new_num_cycles, const bool is_paused = false)
 		             RunningProgram, num_cycles, cycles_ms_str.c_str(),
 		             is_paused ? hint_paused_str.c_str() : hint_mouse_str.c_str(), sdl.title_bar.x, sdl.title_bar.y, sdl.title_bar.x, sdl.title_bar.y);
 
-	SDL_SetWindowTitle(sdl.window, title_buf);
+	if (!sdl.headless) {
+		SDL_SetWindowTitle(sdl.window, title_buf);
+	}
 }
 
 void GFX_RefreshTitle(const bool is_paused = false)
@@ -1675,6 +1677,16 @@ uint8_t GFX_SetSize(const int width_px, const int height_px,
 	// The rendering objects are recreated below with new sizes, after which
 	// frame rendering is re-engaged with the output-type specific calls.
 
+	if (sdl.headless) {
+		// Keep the renderer happy, but never hand out a frame to draw
+		sdl.draw.width_px  = width_px;
+		sdl.draw.height_px = height_px;
+		sdl.draw.render_pixel_aspect_ratio = render_pixel_aspect_ratio;
+		sdl.video_mode    = video_mode;
+		sdl.draw.callback = callback;
+		return GFX_CAN_32 | GFX_CAN_RANDOM;
+	}
+
 	const bool double_width  = flags & GFX_DBL_W;
 	const bool double_height = flags & GFX_DBL_H;
 
@@ -2373,7 +2385,7 @@ static void switch_fullscreen(bool pressed)
 //
 bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 {
-	if (!sdl.active || sdl.updating)
+	if (!sdl.active || sdl.updating || sdl.headless)
 		return false;
 
 	switch (sdl.rendering_backend) {
@@ -2400,12 +2412,12 @@ bool GFX_StartUpdate(uint8_t * &pixels, int &pitch)
 	return false;
 }
 
-extern int64_t ticksDone;
-
 void GFX_EndUpdate(const uint16_t* changedLines)
 {
-	static int64_t cumulative_time_rendered = 0;
-	const auto start                        = GetTicksUs();
+	if (sdl.headless) {
+		sdl.updating = false;
+		return;
+	}
 
 	sdl.frame.update(changedLines);
 
@@ -2446,15 +2458,8 @@ void GFX_EndUpdate(const uint16_t* changedLines)
 		}
 	}
 
-	const auto elapsed = GetTicksUsSince(start);
-	cumulative_time_rendered += elapsed;
-	// Update ticksDone with the rendering time
-	if (cumulative_time_rendered >= 1000) {
-		const auto cumulative_ticks_rendered = cumulative_time_rendered / 1000;
-		ticksDone -= cumulative_ticks_rendered;
-		cumulative_time_rendered %= 1000;
-	}
-
+	// The rendering time counts against the auto cycles budget by itself,
+	// as the governor measures all host time spent between its sleeps
 	sdl.updating = false;
 	FrameMark;
 }
@@ -3620,11 +3625,13 @@ static void GUI_StartUp(Section* sec)
 	}
 
 	sdl.desktop.full.display_res = sdl.desktop.full.fixed && (!sdl.desktop.full.width || !sdl.desktop.full.height);
-	if (sdl.desktop.full.display_res) {
+	if (sdl.desktop.full.display_res && !sdl.headless) {
 		GFX_ObtainDisplayDimensions();
 	}
 
-	set_output(section, RENDER_IsAspectRatioCorrectionEnabled());
+	if (!sdl.headless) {
+		set_output(section, RENDER_IsAspectRatioCorrectionEnabled());
+	}
 
 	/* Get some Event handlers */
 	MAPPER_AddHandler(GFX_RequestExit, SDL_SCANCODE_F9, PRIMARY_MOD,
@@ -3705,7 +3712,7 @@ bool GFX_IsFullscreen() {
 }
 
 void GFX_RegenerateWindow(Section *sec) {
-	if (first_window) {
+	if (first_window || sdl.headless) {
 		first_window = false;
 		return;
 	}
@@ -3818,6 +3825,12 @@ static void maybe_auto_switch_shader()
 #endif
 }
 
+void GFX_WaitForEvents(const int timeout_ms)
+{
+	// Leaves the event in the queue
+	SDL_WaitEventTimeout(nullptr, timeout_ms);
+}
+
 bool GFX_Events()
 {
 #if defined(MACOSX)
@@ -4255,6 +4268,13 @@ static void messages_add_sdl()
 	        "\n"
 	        "  --exit                   Exit after running '-c <command>'s and [autoexec] sections.\n"
 	        "\n"
+	        "  --headless               Run without a window or audio device, as fast as the host\n"
+	        "                           allows, and exit after the [autoexec] sections like\n"
+	        "                           --exit. A timing report is logged on exit.\n"
+	        "\n"
+	        "  --capture-audio          Record the audio output to a WAV file in 'capture_dir'\n"
+	        "                           from the start. Useful together with --headless.\n"
+	        "\n"
 	        "  --startmapper            Run the mapper GUI.\n"
 	        "\n"
 	        "  --erasemapper            Delete the default mapper file.\n"
@@ -4844,6 +4864,14 @@ int sdl_main(int argc, char* argv[])
 			return err;
 		}
 
+		// SDL's dummy drivers give us a working event loop and timers
+		// without opening a window or an audio device
+		if (arguments->headless) {
+			sdl.headless = true;
+			SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+			SDL_setenv("SDL_AUDIODRIVER", "dummy", 1);
+		}
+
 		if (SDL_Init(SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) {
 			E_Exit("SDL: Can't init SDL %s", SDL_GetError());
 		}
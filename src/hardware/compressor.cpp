@@ -109,3 +109,12 @@ AudioFrame Compressor::Process(const AudioFrame in)
 	return {left * gain_scalar, right * gain_scalar};
 }
 
+void Compressor::Process(float* left, float* right, const int num_frames)
+{
+	for (int i = 0; i < num_frames; ++i) {
+		const auto out = Process(AudioFrame{left[i], right[i]});
+		left[i]  = out.left;
+		right[i] = out.right;
+	}
+}
+
@@ -87,6 +87,9 @@ public:
 
 	AudioFrame Process(const AudioFrame in);
 
+	// Processes a block of non-interleaved samples in place
+	void Process(float* left, float* right, const int num_frames);
+
 	// prevent copying
 	Compressor(const Compressor &) = delete;
 	// prevent assignment
@@ -44,6 +44,7 @@ uint32_t read_dword_from_port(const io_port_t port);
 void write_byte_to_port(const io_port_t port, const uint8_t val);
 void write_word_to_port(const io_port_t port, const uint16_t val);
 void write_dword_to_port(const io_port_t port, const uint32_t val);
+void IO_FreeAllHandlers();
 
 
 struct IOF_Entry {
@@ -299,6 +300,7 @@ uint8_t IO_ReadB(io_port_t port)
 	else {
 		IO_USEC_read_delay();
 		retval = read_byte_from_port(port);
+		CPU_CheckPortPolling(port, retval);
 	}
 	log_io(io_width_t::byte, false, port, retval);
 	return retval;
@@ -396,9 +398,8 @@ public:
 
 			total_bytes += readers * sizeof(io_read_f) + sizeof(io_read_handlers[i]);
 			total_bytes += writers * sizeof(io_write_f) + sizeof(io_write_handlers[i]);
-			io_read_handlers[i].clear();
-			io_write_handlers[i].clear();
 		}
+		IO_FreeAllHandlers();
 		LOG_DEBUG("IOBUS: Handlers consumed %d total bytes",
 		          static_cast<int>(total_bytes));
 	}
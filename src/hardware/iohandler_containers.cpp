@@ -21,6 +21,7 @@
 
 #include "dosbox.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 #include <functional>
@@ -65,63 +66,182 @@ constexpr auto &io_write_byte_handler = io_write_handlers[0];
 constexpr auto &io_write_word_handler = io_write_handlers[1];
 constexpr auto &io_write_dword_handler = io_write_handlers[2];
 
+// Flat dispatch tables, indexed directly by port, that mirror the handler
+// maps above so IN and OUT don't need a hash lookup. The maps own the
+// handlers; a table entry either calls the plain function a handler wraps
+// without going through std::function, or invokes the std::function itself.
+// An entry without a call has no handler registered.
+constexpr size_t io_num_ports = UINT16_MAX + 1;
+
+struct io_read_entry {
+	io_val_t (*call)(const void* target, io_port_t port, io_width_t width) = nullptr;
+	const void* target = nullptr;
+};
+
+struct io_write_entry {
+	void (*call)(const void* target, io_port_t port, io_val_t val,
+	             io_width_t width) = nullptr;
+	const void* target = nullptr;
+};
+
+static io_read_entry io_read_tables[io_widths][io_num_ports]   = {};
+static io_write_entry io_write_tables[io_widths][io_num_ports] = {};
+
+template <typename T>
+static io_val_t call_read_fn(const void* target, const io_port_t port,
+                             const io_width_t width)
+{
+	const auto fn = *static_cast<T (*const*)(io_port_t, io_width_t)>(target);
+	return fn(port, width);
+}
+
+static io_val_t call_read_f(const void* target, const io_port_t port,
+                            const io_width_t width)
+{
+	return (*static_cast<const io_read_f*>(target))(port, width);
+}
+
+template <typename T>
+static void call_write_fn(const void* target, const io_port_t port,
+                          const io_val_t val, const io_width_t width)
+{
+	const auto fn = *static_cast<void (*const*)(io_port_t, T, io_width_t)>(target);
+	fn(port, static_cast<T>(val), width);
+}
+
+static void call_write_f(const void* target, const io_port_t port,
+                         const io_val_t val, const io_width_t width)
+{
+	(*static_cast<const io_write_f*>(target))(port, val, width);
+}
+
+template <typename T>
+static bool set_read_fn(io_read_entry& entry, const io_read_f& handler)
+{
+	const auto fn = handler.target<T (*)(io_port_t, io_width_t)>();
+	if (!fn)
+		return false;
+	entry = {call_read_fn<T>, fn};
+	return true;
+}
+
+template <typename T>
+static bool set_write_fn(io_write_entry& entry, const io_write_f& handler)
+{
+	const auto fn = handler.target<void (*)(io_port_t, T, io_width_t)>();
+	if (!fn)
+		return false;
+	entry = {call_write_fn<T>, fn};
+	return true;
+}
+
+static void update_read_entry(const int width_index, const io_port_t port)
+{
+	auto& entry          = io_read_tables[width_index][port];
+	const auto& handlers = io_read_handlers[width_index];
+
+	const auto it = handlers.find(port);
+	if (it == handlers.end()) {
+		entry = {};
+		return;
+	}
+	const auto& handler = it->second;
+	if (set_read_fn<uint8_t>(entry, handler) ||
+	    set_read_fn<uint16_t>(entry, handler) ||
+	    set_read_fn<uint32_t>(entry, handler))
+		return;
+	entry = {call_read_f, &handler};
+}
+
+static void update_write_entry(const int width_index, const io_port_t port)
+{
+	auto& entry          = io_write_tables[width_index][port];
+	const auto& handlers = io_write_handlers[width_index];
+
+	const auto it = handlers.find(port);
+	if (it == handlers.end()) {
+		entry = {};
+		return;
+	}
+	const auto& handler = it->second;
+	if (set_write_fn<uint8_t>(entry, handler) ||
+	    set_write_fn<uint16_t>(entry, handler) ||
+	    set_write_fn<uint32_t>(entry, handler))
+		return;
+	entry = {call_write_f, &handler};
+}
+
 constexpr io_val_t blocked_read(const io_port_t, const io_width_t)
 {
 	return 0xff;
 }
 
+constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
+{
+	// nothing to write to
+}
+
+static void block_read_port(const io_port_t port)
+{
+	LOG(LOG_IO, LOG_WARN)("Unhandled read from port %04Xh; blocking", port);
+	io_read_byte_handler.emplace(port, blocked_read);
+	update_read_entry(0, port);
+}
+
+static void block_write_port(const io_port_t port, const uint8_t val)
+{
+	LOG(LOG_IO, LOG_WARN)("Unhandled write of value 0x%02x"
+	                      " (%u) to port %04Xh; blocking",
+	                      val, val, port);
+	io_write_byte_handler.emplace(port, blocked_write);
+	update_write_entry(0, port);
+}
+
 // type-sized IO handler API
 uint8_t read_byte_from_port(const io_port_t port)
 {
-	const auto [it, was_blocked] = io_read_byte_handler.emplace(port, blocked_read);
-	if (was_blocked)
-		LOG(LOG_IO, LOG_WARN)("Unhandled read from port %04Xh; blocking", port);
-	return it->second(port, io_width_t::byte) & 0xff;
+	const auto& reader = io_read_tables[0][port];
+	if (GCC_UNLIKELY(!reader.call))
+		block_read_port(port);
+	return reader.call(reader.target, port, io_width_t::byte) & 0xff;
 }
 
 uint16_t read_word_from_port(const io_port_t port)
 {
-	const auto reader = io_read_word_handler.find(port);
-	const auto value = reader != io_read_word_handler.end()
-	                           ? (reader->second(port, io_width_t::word) & 0xffff)
-	                           : static_cast<io_val_t>(
-	                                     read_byte_from_port(port) |
-	                                     (read_byte_from_port(port + 1) << 8));
+	const auto& reader = io_read_tables[1][port];
+	const auto value = reader.call
+	                         ? (reader.call(reader.target, port, io_width_t::word) & 0xffff)
+	                         : static_cast<io_val_t>(
+	                                   read_byte_from_port(port) |
+	                                   (read_byte_from_port(port + 1) << 8));
 	return check_cast<uint16_t>(value);
 }
 
 uint32_t read_dword_from_port(const io_port_t port)
 {
-	const auto reader = io_read_dword_handler.find(port);
-	const auto value = reader != io_read_dword_handler.end()
-	                           ? reader->second(port, io_width_t::dword)
-	                           : static_cast<io_val_t>(
-	                                     read_word_from_port(port) |
-	                                     (read_word_from_port(port + 2) << 16));
+	const auto& reader = io_read_tables[2][port];
+	const auto value = reader.call
+	                         ? reader.call(reader.target, port, io_width_t::dword)
+	                         : static_cast<io_val_t>(
+	                                   read_word_from_port(port) |
+	                                   (read_word_from_port(port + 2) << 16));
 	assert(value <= UINT32_MAX);
 	return static_cast<uint32_t>(value);
 }
 
-constexpr void blocked_write(const io_port_t, const io_val_t, const io_width_t)
-{
-	// nothing to write to
-}
-
 void write_byte_to_port(const io_port_t port, const uint8_t val)
 {
-	const auto [it, was_blocked] = io_write_byte_handler.emplace(port, blocked_write);
-	if (was_blocked)
-		LOG(LOG_IO, LOG_WARN)("Unhandled write of value 0x%02x"
-		                      " (%u) to port %04Xh; blocking",
-		                      val, val, port);
-	it->second(port, val, io_width_t::byte);
+	const auto& writer = io_write_tables[0][port];
+	if (GCC_UNLIKELY(!writer.call))
+		block_write_port(port, val);
+	writer.call(writer.target, port, val, io_width_t::byte);
 }
 
 void write_word_to_port(const io_port_t port, const uint16_t val)
 {
-	const auto writer = io_write_word_handler.find(port);
-	if (writer != io_write_word_handler.end()) {
-		writer->second(port, val, io_width_t::word);
+	const auto& writer = io_write_tables[1][port];
+	if (writer.call) {
+		writer.call(writer.target, port, val, io_width_t::word);
 	} else {
 		write_byte_to_port(port, static_cast<uint8_t>(val & 0xff));
 		write_byte_to_port(port + 1, static_cast<uint8_t>(val >> 8));
@@ -130,9 +250,9 @@ void write_word_to_port(const io_port_t port, const uint16_t val)
 
 void write_dword_to_port(const io_port_t port, const uint32_t val)
 {
-	const auto writer = io_write_dword_handler.find(port);
-	if (writer != io_write_dword_handler.end()) {
-		writer->second(port, val, io_width_t::dword);
+	const auto& writer = io_write_tables[2][port];
+	if (writer.call) {
+		writer.call(writer.target, port, val, io_width_t::dword);
 	} else {
 		write_word_to_port(port, static_cast<uint16_t>(val & 0xffff));
 		write_word_to_port(port + 2, static_cast<uint16_t>(val >> 16));
@@ -146,10 +266,15 @@ void IO_RegisterReadHandler(io_port_t port,
 {
 	while (range--) {
 		io_read_byte_handler[port] = handler;
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
+		update_read_entry(0, port);
+		if (max_width == io_width_t::word || max_width == io_width_t::dword) {
 			io_read_word_handler[port] = handler;
-		if (max_width == io_width_t::dword)
+			update_read_entry(1, port);
+		}
+		if (max_width == io_width_t::dword) {
 			io_read_dword_handler[port] = handler;
+			update_read_entry(2, port);
+		}
 		++port;
 	}
 }
@@ -161,10 +286,15 @@ void IO_RegisterWriteHandler(io_port_t port,
 {
 	while (range--) {
 		io_write_byte_handler[port] = handler;
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
+		update_write_entry(0, port);
+		if (max_width == io_width_t::word || max_width == io_width_t::dword) {
 			io_write_word_handler[port] = handler;
-		if (max_width == io_width_t::dword)
+			update_write_entry(1, port);
+		}
+		if (max_width == io_width_t::dword) {
 			io_write_dword_handler[port] = handler;
+			update_write_entry(2, port);
+		}
 		++port;
 	}
 }
@@ -175,10 +305,15 @@ void IO_FreeReadHandler(io_port_t port,
 {
 	while (range--) {
 		io_read_byte_handler.erase(port);
-		if (max_width == io_width_t::word || max_width == io_width_t::dword)
+		update_read_entry(0, port);
+		if (max_width == io_width_t::word || max_width == io_width_t::dword) {
 			io_read_word_handler.erase(port);
-		if (max_width == io_width_t::dword)
+			update_read_entry(1, port);
+		}
+		if (max_width == io_width_t::dword) {
 			io_read_dword_handler.erase(port);
+			update_read_entry(2, port);
+		}
 		++port;
 	}
 }
@@ -189,14 +324,31 @@ void IO_FreeWriteHandler(io_port_t port,
 {
 	while (range--) {
 		io_write_byte_handler.erase(port);
-		if (width == io_width_t::word || width == io_width_t::dword)
+		update_write_entry(0, port);
+		if (width == io_width_t::word || width == io_width_t::dword) {
 			io_write_word_handler.erase(port);
-		if (width == io_width_t::dword)
+			update_write_entry(1, port);
+		}
+		if (width == io_width_t::dword) {
 			io_write_dword_handler.erase(port);
+			update_write_entry(2, port);
+		}
 		++port;
 	}
 }
 
+void IO_FreeAllHandlers()
+{
+	for (int i = 0; i < io_widths; ++i) {
+		io_read_handlers[i].clear();
+		io_write_handlers[i].clear();
+		std::fill(std::begin(io_read_tables[i]), std::end(io_read_tables[i]),
+		          io_read_entry{});
+		std::fill(std::begin(io_write_tables[i]),
+		          std::end(io_write_tables[i]), io_write_entry{});
+	}
+}
+
 void IO_ReadHandleObject::Install(const io_port_t port,
                                   const io_read_f handler,
                                   const io_width_t max_width,
@@ -19,8 +19,10 @@
 
 #include "mem.h"
 
+#include <algorithm>
 #include <string.h>
 
+#include "free_extents.h"
 #include "inout.h"
 #include "paging.h"
 #include "pci_bus.h"
@@ -44,6 +46,7 @@ static struct MemoryBlock {
 	std::vector<page_t> pages           = {};
 	std::vector<PageHandler*> phandlers = {};
 	std::vector<MemHandle> mhandles     = {};
+	FreeExtents free_pages              = {};
 	struct {
 		Bitu start_page = 0;
 		Bitu end_page   = 0;
@@ -175,6 +178,7 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 }
 
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
+	PAGING_ForgetPhysPages(phys_page, pages);
 	for (;pages>0;pages--) {
 		memory.phandlers[phys_page]=handler;
 		phys_page++;
@@ -182,6 +186,7 @@ void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 }
 
 void MEM_ResetPageHandler(Bitu phys_page, Bitu pages) {
+	PAGING_ForgetPhysPages(phys_page, pages);
 	for (;pages>0;pages--) {
 		memory.phandlers[phys_page]=&ram_page_handler;
 		phys_page++;
@@ -203,22 +208,127 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+// Bulk transfers are split at page boundaries, and pages the TLB maps to
+// host memory are copied with memcpy. Everything else goes through the page
+// handlers a byte at a time like single accesses do: memory-mapped devices,
+// pages holding dynamic code (their handlers invalidate the code) and, while
+// the heavy debugger traces writes, all writes.
+static Bitu bytes_left_in_page(const PhysPt address)
+{
+	return 4096 - (address & 4095);
+}
+
+static HostPt get_host_read_pt(const PhysPt address)
+{
+	const HostPt tlb_addr = get_tlb_read(address);
+	return tlb_addr ? tlb_addr + address : nullptr;
+}
+
+static HostPt get_host_write_pt(const PhysPt address)
+{
+#if C_HEAVY_DEBUG
+	if (memwrite_trace_active)
+		return nullptr;
+#endif
+	const HostPt tlb_addr = get_tlb_write(address);
+	return tlb_addr ? tlb_addr + address : nullptr;
+}
+
+// The ranges must not cross a page boundary. Pages that aren't in the TLB
+// yet are linked by the first access through their handler, so only that
+// byte is transferred on its own.
+static void block_read_in_page(PhysPt pt, uint8_t* data, Bitu size)
+{
+	HostPt src = get_host_read_pt(pt);
+	if (!src) {
+		*data++ = mem_readb_inline(pt++);
+		if (!--size)
+			return;
+		src = get_host_read_pt(pt);
+	}
+	if (src) {
+		memcpy(data, src, size);
+		return;
+	}
+	while (size--)
+		*data++ = mem_readb_inline(pt++);
+}
+
+static void block_write_in_page(PhysPt pt, const uint8_t* data, Bitu size)
+{
+	HostPt dest = get_host_write_pt(pt);
+	if (!dest) {
+		mem_writeb_inline(pt++, *data++);
+		if (!--size)
+			return;
+		dest = get_host_write_pt(pt);
+	}
+	if (dest) {
+		memcpy(dest, data, size);
+		return;
+	}
+	while (size--)
+		mem_writeb_inline(pt++, *data++);
+}
+
+static void memcpy_in_page(PhysPt dest, PhysPt src, Bitu size)
+{
+	HostPt to   = get_host_write_pt(dest);
+	HostPt from = get_host_read_pt(src);
+	if (!to || !from) {
+		mem_writeb_inline(dest++, mem_readb_inline(src++));
+		if (!--size)
+			return;
+		to   = get_host_write_pt(dest);
+		from = get_host_read_pt(src);
+	}
+	if (!to || !from) {
+		while (size--)
+			mem_writeb_inline(dest++, mem_readb_inline(src++));
+		return;
+	}
+	// Guest code may rely on a forward copy repeating a pattern when the
+	// destination starts inside the source
+	if (to > from && to < from + size) {
+		while (size--)
+			*to++ = *from++;
+		return;
+	}
+	memmove(to, from, size);
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		const Bitu chunk = std::min({size,
+		                             bytes_left_in_page(dest),
+		                             bytes_left_in_page(src)});
+		memcpy_in_page(dest, src, chunk);
+		dest += chunk;
+		src += chunk;
+		size -= chunk;
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	uint8_t * write=reinterpret_cast<uint8_t *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		const Bitu chunk = std::min(size, bytes_left_in_page(pt));
+		block_read_in_page(pt, write, chunk);
+		pt += chunk;
+		write += chunk;
+		size -= chunk;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt, const void *data, size_t size)
 {
 	const uint8_t *read = static_cast<const uint8_t *>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		const Bitu chunk = std::min<Bitu>(size, bytes_left_in_page(pt));
+		block_write_in_page(pt, read, chunk);
+		pt += chunk;
+		read += chunk;
+		size -= chunk;
 	}
 }
 
@@ -242,33 +352,12 @@ uint32_t MEM_TotalPages(void)
 
 uint32_t MEM_FreeLargest()
 {
-	uint32_t size    = 0;
-	uint32_t largest = 0;
-	size_t   index   = XMS_START;
-	while (index < memory.pages.size()) {
-		if (!memory.mhandles[index]) {
-			++size;
-		} else {
-			largest = std::max(size, largest);
-			size = 0;
-		}
-		++index;
-	}
-	largest = std::max(size, largest);
-	return largest;
+	return memory.free_pages.Largest();
 }
 
 uint32_t MEM_FreeTotal()
 {
-	uint32_t free  = 0;
-	size_t   index = XMS_START;
-	while (index < memory.pages.size()) {
-		if (!memory.mhandles[index]) {
-			++free;
-		}
-		++index;
-	}
-	return free;
+	return memory.free_pages.Total();
 }
 
 uint32_t MEM_AllocatedPages(MemHandle handle) 
@@ -284,66 +373,39 @@ uint32_t MEM_AllocatedPages(MemHandle handle)
 
 //TODO Maybe some protection for this whole allocation scheme
 
-inline Bitu BestMatch(Bitu size) {
-	Bitu index=XMS_START;	
-	Bitu first=0;
-	Bitu best=0xfffffff;
-	Bitu best_first=0;
-	while (index < memory.pages.size()) {
-		/* Check if we are searching for first free page */
-		if (!first) {
-			/* Check if this is a free page */
-			if (!memory.mhandles[index]) {
-				first=index;	
-			}
-		} else {
-			/* Check if this still is used page */
-			if (memory.mhandles[index]) {
-				Bitu pages=index-first;
-				if (pages==size) {
-					return first;
-				} else if (pages>size) {
-					if (pages<best) {
-						best=pages;
-						best_first=first;
-					}
-				}
-				first=0;			//Always reset for new search
-			}
-		}
+// Chains count pages starting at index onto the handle next points to, and
+// returns where the next page would be chained
+static MemHandle* ChainPages(MemHandle* next, Bitu index, Bitu count)
+{
+	for (;count>0;count--) {
+		*next=static_cast<MemHandle>(index);
+		next=&memory.mhandles[index];
 		index++;
 	}
-	/* Check for the final block if we can */
-	if (first && (index-first>=size) && (index-first<best)) {
-		return first;
-	}
-	return best_first;
+	return next;
 }
 
 MemHandle MEM_AllocatePages(Bitu pages,bool sequence) {
 	MemHandle ret;
 	if (!pages) return 0;
+	auto& free_pages = memory.free_pages;
 	if (sequence) {
-		Bitu index=BestMatch(pages);
+		const auto count = check_cast<uint32_t>(pages);
+		const auto index = free_pages.FindBestFit(count);
 		if (!index) return 0;
-		MemHandle * next=&ret;
-		while (pages) {
-			*next=index;
-			next=&memory.mhandles[index];
-			index++;pages--;
-		}
-		*next=-1;
+		free_pages.Take(index, count);
+		*ChainPages(&ret, index, count)=-1;
 	} else {
-		if (MEM_FreeTotal()<pages) return 0;
+		if (free_pages.Total()<pages) return 0;
 		MemHandle * next=&ret;
 		while (pages) {
-			Bitu index=BestMatch(1);
+			const auto index = free_pages.FindBestFit(1);
 			if (!index) E_Exit("MEM:corruption during allocate");
-			while (pages && (!memory.mhandles[index])) {
-				*next=index;
-				next=&memory.mhandles[index];
-				index++;pages--;
-			}
+			const auto count = std::min(check_cast<uint32_t>(pages),
+			                            free_pages.LengthAt(index));
+			free_pages.Take(index, count);
+			next=ChainPages(next, index, count);
+			pages-=count;
 			*next=-1;		//Invalidate it in case we need another match
 		}
 	}
@@ -351,14 +413,21 @@ MemHandle MEM_AllocatePages(Bitu pages,bool sequence) {
 }
 
 MemHandle MEM_GetNextFreePage(void) {
-	return (MemHandle)BestMatch(1);
+	return static_cast<MemHandle>(memory.free_pages.FindBestFit(1));
 }
 
 void MEM_ReleasePages(MemHandle handle) {
 	while (handle>0) {
-		MemHandle next=memory.mhandles[handle];
-		memory.mhandles[handle]=0;
-		handle=next;
+		// Hand back each run of consecutive pages in one go
+		const auto first = handle;
+		uint32_t count = 0;
+		do {
+			MemHandle next=memory.mhandles[handle];
+			memory.mhandles[handle]=0;
+			handle=next;
+			count++;
+		} while (handle == first + static_cast<MemHandle>(count));
+		memory.free_pages.Release(first, count);
 	}
 }
 
@@ -383,40 +452,24 @@ bool MEM_ReAllocatePages(MemHandle & handle,Bitu pages,bool sequence) {
 	if (old_pages == pages) return true;
 	if (old_pages > pages) {
 		/* Decrease size */
-		pages--;index=handle;old_pages--;
+		pages--;index=handle;
 		while (pages) {
 			index=memory.mhandles[index];
-			pages--;old_pages--;
+			pages--;
 		}
 		MemHandle next=memory.mhandles[index];
 		memory.mhandles[index]=-1;
-		index=next;
-		while (old_pages) {
-			next=memory.mhandles[index];
-			memory.mhandles[index]=0;
-			index=next;
-			old_pages--;
-		}
+		MEM_ReleasePages(next);
 		return true;
 	} else {
 		/* Increase size, check for enough free space */
 		Bitu need=pages-old_pages;
 		if (sequence) {
-			index=last+1;
-			Bitu free=0;
-			while (static_cast<uint32_t>(index) < memory.pages.size() &&
-			       !memory.mhandles[index]) {
-				index++;
-				free++;
-			}
+			const auto free = memory.free_pages.LengthAt(last + 1);
 			if (free>=need) {
 				/* Enough space allocate more pages */
-				index=last;
-				while (need) {
-					memory.mhandles[index]=index+1;
-					need--;index++;
-				}
-				memory.mhandles[index]=-1;
+				memory.free_pages.Take(last + 1, check_cast<uint32_t>(need));
+				*ChainPages(&memory.mhandles[last], last + 1, need)=-1;
 				return true;
 			} else {
 				/* Not Enough space allocate new block and copy */
@@ -671,6 +724,10 @@ public:
 		memory.mhandles.clear();
 		memory.mhandles.resize(num_pages, 0);
 
+		// Everything above the HMA is free for XMS and EMS to allocate
+		const auto num_xms_pages = num_pages > XMS_START ? num_pages - XMS_START : 0;
+		memory.free_pages.Reset(XMS_START, check_cast<uint32_t>(num_xms_pages));
+
 		using page_range_t = std::pair<uint16_t, uint16_t>;
 		auto install_rom_page_handlers = [&](const page_range_t& page_range) {
 			for (auto p = page_range.first; p < page_range.second; ++p) {
@@ -35,6 +35,7 @@
 #include <speex/speex_resampler.h>
 
 #include "../capture/capture.h"
+#include "audio_block.h"
 #include "channel_names.h"
 #include "checks.h"
 #include "control.h"
@@ -46,6 +47,7 @@
 #include "midi.h"
 #include "pic.h"
 #include "setup.h"
+#include "spsc_ring.h"
 #include "string_utils.h"
 #include "timer.h"
 #include "tracy.h"
@@ -67,8 +69,6 @@ constexpr auto TickShift = 24;
 constexpr auto TickNext  = (1 << TickShift);
 constexpr auto TickMask  = (TickNext - 1);
 
-constexpr auto IndexShiftLocal = 14;
-
 // Over how many milliseconds will we permit a signal to grow from
 // zero up to peak amplitude? (recommended 10 to 20ms)
 constexpr auto EnvelopeMaxExpansionOverMs = 15u;
@@ -79,6 +79,9 @@ constexpr auto EnvelopeExpiresAfterSeconds = 10u;
 
 constexpr auto MaxPrebufferMs = 100;
 
+// The master effect chain runs on blocks of up to this many frames per tick
+constexpr auto MasterBlockFrames = 1024;
+
 template <class T, size_t ROWS, size_t COLS>
 using matrix = std::array<std::array<T, COLS>, ROWS>;
 
@@ -161,6 +164,11 @@ struct MixerSettings {
 	matrix<float, MixerBufferLength, 2> aux_reverb = {};
 	matrix<float, MixerBufferLength, 2> aux_chorus = {};
 
+	// Non-interleaved copies of the frames the master effect chain is
+	// working on, and of an effect's input
+	matrix<float, 2, MasterBlockFrames> master_block = {};
+	matrix<float, 2, MasterBlockFrames> effect_block = {};
+
 	std::vector<float> resample_temp = {};
 	std::vector<float> resample_out  = {};
 
@@ -178,6 +186,20 @@ struct MixerSettings {
 	std::atomic<int> max_frames_needed = 0;
 	std::atomic<int> tick_add = 0; // samples needed per millisecond tick
 
+	// Finished frames on their way to the audio device's callback, and how
+	// many of them may be queued at most (the maximum latency)
+	SpscRing<AudioFrame> output_queue  = SpscRing<AudioFrame>(MixerBufferLength);
+	std::atomic<int> max_queued_frames = 0;
+	std::atomic<int> prebuffer_frames  = 0;
+
+	// Cleared whenever the queue is drained or runs dry; the callback then
+	// waits for a block plus the prebuffer before playing again
+	std::atomic<bool> is_output_primed = false;
+
+	std::atomic<uint64_t> num_underruns      = 0;
+	std::atomic<uint64_t> num_overruns       = 0;
+	std::atomic<uint64_t> num_dropped_frames = 0;
+
 	int tick_counter = 0;
 	std::atomic<uint16_t> sample_rate = 0; // sample rate negotiated with SDL
 	uint16_t blocksize = 0; // matches SDL AudioSpec.samples type
@@ -1063,8 +1085,6 @@ void MixerChannel::Mix(const uint16_t frames_requested)
 
 void MixerChannel::AddSilence()
 {
-	MIXER_LockAudioDevice();
-
 	if (frames_done < frames_needed) {
 		if (prev_frame[0] == 0.0f && prev_frame[1] == 0.0f) {
 			frames_done = frames_needed;
@@ -1116,8 +1136,6 @@ void MixerChannel::AddSilence()
 		}
 	}
 	last_samples_were_silence = true;
-
-	MIXER_UnlockAudioDevice();
 }
 
 static void log_filter_settings(const std::string& channel_name,
@@ -1939,8 +1957,6 @@ void MixerChannel::AddSamples(const uint16_t frames, const Type* data)
 		}
 	}
 
-	MIXER_LockAudioDevice();
-
 	// Optionally filter, apply crossfeed, then mix the results to the
 	// master output
 	const uint16_t out_frames = static_cast<uint16_t>(mixer.resample_out.size()) /
@@ -1990,17 +2006,12 @@ void MixerChannel::AddSamples(const uint16_t frames, const Type* data)
 		mixpos = static_cast<work_index_t>((mixpos + 1) & MixerBufferMask);
 	}
 	frames_done += out_frames;
-
-	MIXER_UnlockAudioDevice();
 }
 
 void MixerChannel::AddStretched(const uint16_t len, int16_t* data)
 {
-	MIXER_LockAudioDevice();
-
 	if (frames_done >= frames_needed) {
 		LOG_MSG("Can't add, buffer full");
-		MIXER_UnlockAudioDevice();
 		return;
 	}
 	// Target samples this inputs gets stretched into
@@ -2052,8 +2063,6 @@ void MixerChannel::AddStretched(const uint16_t len, int16_t* data)
 	}
 
 	frames_done = frames_needed;
-
-	MIXER_UnlockAudioDevice();
 }
 
 void MixerChannel::AddSamples_m8(const uint16_t len, const uint8_t* data)
@@ -2141,10 +2150,7 @@ void MixerChannel::FillUp()
 		const auto frames_to_mix = std::clamp(
 		        frames_remaining, 0, static_cast<int>(MixerBufferLength));
 
-		MIXER_LockAudioDevice();
 		Mix(check_cast<work_index_t>(frames_to_mix));
-		MIXER_UnlockAudioDevice();
-		// Let SDL fetch frames after each chunk
 
 		frames_remaining = -frames_to_mix;
 	}
@@ -2224,146 +2230,131 @@ static constexpr int calc_tickadd(const int freq)
 }
 
 // Mix a certain amount of new sample frames
-static void mix_samples(const int frames_requested)
+using mixer_ring_t  = matrix<float, MixerBufferLength, 2>;
+using mixer_block_t = matrix<float, 2, MasterBlockFrames>;
+
+// The ring's frames are read and written as one run of interleaved floats
+static_assert(sizeof(mixer_ring_t) == MixerBufferLength * 2 * sizeof(float));
+
+static void read_block(const mixer_ring_t& ring, const work_index_t start_pos,
+                       const int num_frames, mixer_block_t& block)
 {
-	constexpr auto capture_buf_frames = 1024;
+	assert(num_frames <= MasterBlockFrames);
+	read_ring_frames(ring[0].data(), MixerBufferLength, start_pos,
+	                 num_frames, block[0].data(), block[1].data());
+}
 
-	const auto frames_added = check_cast<work_index_t>(
-	        std::min(frames_requested - mixer.frames_done, capture_buf_frames));
+static void write_block(const mixer_block_t& block, const work_index_t start_pos,
+                        const int num_frames, mixer_ring_t& ring)
+{
+	assert(num_frames <= MasterBlockFrames);
+	write_ring_frames(block[0].data(), block[1].data(), ring[0].data(),
+	                  MixerBufferLength, start_pos, num_frames);
+}
 
-	const auto start_pos = check_cast<work_index_t>(
-	        (mixer.pos + mixer.frames_done) & MixerBufferMask);
+static void apply_master_effects(const work_index_t start_pos, const int num_frames)
+{
+	assert(num_frames > 0);
 
-	// Render all channels and accumulate results in the master mixbuffer
-	for (const auto& [_, channel] : mixer.channels) {
-		channel->Mix(check_cast<work_index_t>(frames_requested));
-	}
+	auto& master = mixer.master_block;
+	auto& effect = mixer.effect_block;
+
+	read_block(mixer.work, start_pos, num_frames, master);
 
 	if (mixer.do_reverb) {
 		// Apply reverb effect to the reverb aux buffer, then mix the
 		// results to the master output
-		auto pos = start_pos;
+		read_block(mixer.aux_reverb, start_pos, num_frames, effect);
 
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.aux_reverb[pos][0],
-			                    mixer.aux_reverb[pos][1]};
-
-			// High-pass filter the reverb input
-			for (size_t ch = 0; ch < 2; ++ch) {
-				frame[ch] = mixer.reverb.highpass_filter[ch].filter(
-				        frame[ch]);
-			}
-
-			// MVerb operates on two non-interleaved sample streams
-			static float in_left[1]     = {};
-			static float in_right[1]    = {};
-			static float* reverb_buf[2] = {in_left, in_right};
-
-			in_left[0]  = frame.left;
-			in_right[0] = frame.right;
-
-			const auto in         = reverb_buf;
-			auto out              = reverb_buf;
-			constexpr auto frames = 1;
-			mixer.reverb.mverb.process(in, out, frames);
+		// High-pass filter the reverb input
+		for (size_t ch = 0; ch < 2; ++ch) {
+			filter_samples(mixer.reverb.highpass_filter[ch],
+			               effect[ch].data(),
+			               num_frames);
+		}
 
-			mixer.work[pos][0] += reverb_buf[0][0];
-			mixer.work[pos][1] += reverb_buf[1][0];
+		// MVerb operates on two non-interleaved sample streams, and
+		// reads each input frame before writing the output frame, so
+		// it can run in place
+		float* reverb_buf[2] = {effect[0].data(), effect[1].data()};
+		mixer.reverb.mverb.process(reverb_buf, reverb_buf, num_frames);
 
-			pos = (pos + 1) & MixerBufferMask;
+		for (size_t ch = 0; ch < 2; ++ch) {
+			add_samples(master[ch].data(), effect[ch].data(), num_frames);
 		}
 	}
 
 	if (mixer.do_chorus) {
 		// Apply chorus effect to the chorus aux buffer, then mix the
 		// results to the master output
-		auto pos = start_pos;
-
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.aux_chorus[pos][0],
-			                    mixer.aux_chorus[pos][1]};
-
-			mixer.chorus.chorus_engine.process(&frame.left, &frame.right);
+		read_block(mixer.aux_chorus, start_pos, num_frames, effect);
 
-			mixer.work[pos][0] += frame.left;
-			mixer.work[pos][1] += frame.right;
+		mixer.chorus.chorus_engine.process(effect[0].data(),
+		                                   effect[1].data(),
+		                                   num_frames);
 
-			pos = (pos + 1) & MixerBufferMask;
+		for (size_t ch = 0; ch < 2; ++ch) {
+			add_samples(master[ch].data(), effect[ch].data(), num_frames);
 		}
 	}
 
 	// Apply high-pass filter to the master output
-	auto pos = start_pos;
-
-	for (work_index_t i = 0; i < frames_added; ++i) {
-		for (size_t ch = 0; ch < 2; ++ch) {
-			mixer.work[pos][ch] = mixer.highpass_filter[ch].filter(
-			        mixer.work[pos][ch]);
-		}
-		pos = (pos + 1) & MixerBufferMask;
+	for (size_t ch = 0; ch < 2; ++ch) {
+		filter_samples(mixer.highpass_filter[ch], master[ch].data(), num_frames);
 	}
 
 	if (mixer.do_compressor) {
 		// Apply compressor to the master output as the very last step
-		pos = start_pos;
-
-		for (work_index_t i = 0; i < frames_added; ++i) {
-			AudioFrame frame = {mixer.work[pos][0], mixer.work[pos][1]};
-
-			frame = mixer.compressor.Process(frame);
-
-			mixer.work[pos][0] = frame.left;
-			mixer.work[pos][1] = frame.right;
-
-			pos = (pos + 1) & MixerBufferMask;
-		}
+		mixer.compressor.Process(master[0].data(), master[1].data(), num_frames);
 	}
 
-	// Capture audio output if requested
-	if (CAPTURE_IsCapturingAudio() || CAPTURE_IsCapturingVideo()) {
-		int16_t out[capture_buf_frames][2];
-		auto pos = start_pos;
-
-		for (work_index_t i = 0; i < frames_added; i++) {
-			const auto left = static_cast<uint16_t>(clamp_to_int16(
-			        static_cast<int>(mixer.work[pos][0])));
-
-			const auto right = static_cast<uint16_t>(clamp_to_int16(
-			        static_cast<int>(mixer.work[pos][1])));
+	write_block(master, start_pos, num_frames, mixer.work);
+}
 
-			out[i][0] = static_cast<int16_t>(host_to_le16(left));
-			out[i][1] = static_cast<int16_t>(host_to_le16(right));
+// Captures the master block as left by apply_master_effects()
+static void capture_master_block(const int num_frames)
+{
+	int16_t out[MasterBlockFrames][2];
 
-			pos = (pos + 1) & MixerBufferMask;
+	const auto& master = mixer.master_block;
+	for (size_t i = 0; i < static_cast<size_t>(num_frames); ++i) {
+		for (size_t ch = 0; ch < 2; ++ch) {
+			const auto sample = static_cast<uint16_t>(clamp_to_int16(
+			        static_cast<int>(master[ch][i])));
+			out[i][ch] = static_cast<int16_t>(host_to_le16(sample));
 		}
-
-		CAPTURE_AddAudioData(mixer.sample_rate,
-		                     frames_added,
-		                     reinterpret_cast<int16_t*>(out));
 	}
 
-	// Reset the tick_add for constant speed
-	if (is_mixer_irq_important()) {
-		mixer.tick_add = calc_tickadd(mixer.sample_rate);
-	}
-
-	mixer.frames_done = frames_requested;
+	CAPTURE_AddAudioData(mixer.sample_rate,
+	                     check_cast<uint32_t>(num_frames),
+	                     reinterpret_cast<int16_t*>(out));
 }
 
-static void handle_mix_samples()
+static void mix_samples(const int frames_requested)
 {
-	MIXER_LockAudioDevice();
+	const auto frames_added = check_cast<work_index_t>(
+	        std::min(frames_requested - mixer.frames_done, MasterBlockFrames));
 
-	mix_samples(mixer.frames_needed);
-	mixer.tick_counter += mixer.tick_add;
+	const auto start_pos = check_cast<work_index_t>(
+	        (mixer.pos + mixer.frames_done) & MixerBufferMask);
 
-	const auto frames_needed = mixer.frames_needed +
-	                           (mixer.tick_counter >> TickShift);
-	mixer.frames_needed = clamp_frames_needed(frames_needed);
+	// Render all channels and accumulate results in the master mixbuffer
+	for (const auto& [_, channel] : mixer.channels) {
+		channel->Mix(check_cast<work_index_t>(frames_requested));
+	}
 
-	mixer.tick_counter &= TickMask;
+	// MVerb spreads parameter changes over the block it's given, so it
+	// mustn't be handed an empty one
+	if (frames_added > 0) {
+		apply_master_effects(start_pos, frames_added);
 
-	MIXER_UnlockAudioDevice();
+		// Capture audio output if requested
+		if (CAPTURE_IsCapturingAudio() || CAPTURE_IsCapturingVideo()) {
+			capture_master_block(frames_added);
+		}
+	}
+
+	mixer.frames_done = frames_requested;
 }
 
 static void reduce_channels_done_counts(const int at_most)
@@ -2373,208 +2364,173 @@ static void reduce_channels_done_counts(const int at_most)
 	}
 }
 
-static void handle_mix_no_sound()
+// Hands the frames over to the audio device's callback. The queue is never
+// allowed to grow beyond the maximum latency; frames that don't fit are
+// dropped and counted as an overrun.
+static void enqueue_output_frames(work_index_t pos, const int num_frames)
 {
-	MIXER_LockAudioDevice();
+	auto& queue = mixer.output_queue;
 
-	mix_samples(mixer.frames_needed);
+	const auto num_queued = static_cast<int>(queue.Size());
+	const auto num_free = std::max(mixer.max_queued_frames - num_queued, 0);
 
-	/* Clear piece we've just generated */
-	for (auto i = 0; i < mixer.frames_needed; ++i) {
-		mixer.work[mixer.pos][0] = 0;
-		mixer.work[mixer.pos][1] = 0;
+	const auto num_to_push = std::min(num_frames, num_free);
 
-		mixer.pos = (mixer.pos + 1) & MixerBufferMask;
-	}
+	std::array<AudioFrame, 256> chunk = {};
 
-	reduce_channels_done_counts(mixer.frames_needed);
+	auto num_pushed = 0;
+	while (num_pushed < num_to_push) {
+		// Stop each chunk at the end of the work ring
+		const auto n = std::min({num_to_push - num_pushed,
+		                         static_cast<int>(chunk.size()),
+		                         MixerBufferLength - pos});
 
-	/* Set values for next tick */
-	mixer.tick_counter += mixer.tick_add;
-	mixer.frames_needed = clamp_frames_needed(mixer.tick_counter >> TickShift);
-	mixer.tick_counter &= TickMask;
-	mixer.frames_done = 0;
+		for (size_t i = 0; i < static_cast<size_t>(n); ++i) {
+			const auto& frame = mixer.work[pos + i];
+			chunk[i]          = {frame[0], frame[1]};
+		}
+		const auto num_taken = static_cast<int>(
+		        queue.TryPushBulk(chunk.data(), static_cast<size_t>(n)));
 
-	MIXER_UnlockAudioDevice();
+		num_pushed += num_taken;
+		if (num_taken < n) {
+			break;
+		}
+		pos = (pos + n) & MixerBufferMask;
+	}
+	if (num_pushed < num_frames) {
+		++mixer.num_overruns;
+		mixer.num_dropped_frames += check_cast<uint64_t>(num_frames - num_pushed);
+	}
 }
 
-static void SDLCALL mixer_callback([[maybe_unused]] void* userdata,
-                                   Uint8* stream, int len)
+// Nudges the mixing rate by a small amount so the queue hovers around
+// half a block above the prebuffer, which is its average fill level when
+// the host and the audio device clocks agree. Otherwise any drift between
+// the two would eventually end in an overrun or an underrun.
+static void adjust_tick_add()
 {
-	ZoneScoped;
-	memset(stream, 0, static_cast<size_t>(len));
+	const auto target_frames = mixer.prebuffer_frames + mixer.blocksize / 2;
+	const auto max_diff      = std::max(mixer.prebuffer_frames.load(), 1);
 
-	auto frames_requested = len / MixerFrameSize;
-	auto output           = reinterpret_cast<int16_t*>(stream);
-	auto reduce_frames    = 0;
-	work_index_t pos      = 0;
-
-	// Local resampling counter to manipulate the data when sending it off
-	// to the callback
-	auto index_add = (1 << IndexShiftLocal);
-	auto index     = (index_add % frames_requested) ? frames_requested : 0;
-
-	/* Enough room in the buffer ? */
-	if (mixer.frames_done < frames_requested) {
-		//		LOG_WARNING("Full underrun requested %d, have
-		//%d, min %d", frames_requested, mixer.frames_done.load(),
-		// mixer.min_frames_needed.load());
-		if ((frames_requested - mixer.frames_done) >
-		    (frames_requested >> 7)) { // Max 1 percent
-			                       // stretch.
-			return;
-		}
-		reduce_frames = mixer.frames_done;
-		index_add = (reduce_frames << IndexShiftLocal) / frames_requested;
-
-		mixer.tick_add = calc_tickadd(mixer.sample_rate +
-		                              mixer.min_frames_needed);
-
-	} else if (mixer.frames_done < mixer.max_frames_needed) {
-		auto frames_remaining = mixer.frames_done - frames_requested;
-
-		if (frames_remaining < mixer.min_frames_needed) {
-			if (!is_mixer_irq_important()) {
-				auto frames_needed = mixer.frames_needed -
-				                     frames_requested;
-
-				auto diff = (mixer.min_frames_needed > frames_needed
-				                     ? mixer.min_frames_needed.load()
-				                     : frames_needed) -
-				            frames_remaining;
-
-				mixer.tick_add = calc_tickadd(mixer.sample_rate +
-				                              (diff * 3));
-				frames_remaining = 0; // No stretching as we
-				                      // compensate with the
-				                      // tick_add value
-			} else {
-				frames_remaining = (mixer.min_frames_needed -
-				                    frames_remaining);
+	const auto num_queued = static_cast<int>(mixer.output_queue.Size());
+	const auto diff = clamp(num_queued - target_frames, -max_diff, max_diff);
 
-				frames_remaining = 1 + (2 * frames_remaining) /
-				                               mixer.min_frames_needed; // frames_remaining=1,2,3
-			}
-			//			LOG_WARNING("needed underrun
-			// requested %d, have %d, min %d, frames_remaining %d",
-			// frames_requested, mixer.frames_done.load(),
-			// mixer.min_frames_needed.load(), frames_remaining);
-			reduce_frames = frames_requested - frames_remaining;
-
-			index_add = (reduce_frames << IndexShiftLocal) /
-			            frames_requested;
-		} else {
-			reduce_frames = frames_requested;
-			//			LOG_MSG("regular run requested
-			//%d, have %d, min %d, frames_remaining %d",
-			// frames_requested, mixer.frames_done.load(),
-			// mixer.min_frames_needed.load(), frames_remaining);
-
-			/* Mixer tick value being updated:
-			 * 3 cases:
-			 * 1) A lot too high. >division by 5. but maxed by 2*
-			 * min to prevent too fast drops. 2) A little too high >
-			 * division by 8 3) A little to nothing above the
-			 * min_needed buffer > go to default value
-			 */
-			int diff = frames_remaining - mixer.min_frames_needed;
-
-			if (diff > (mixer.min_frames_needed << 1)) {
-				diff = mixer.min_frames_needed << 1;
-			}
-
-			if (diff > (mixer.min_frames_needed >> 1)) {
-				mixer.tick_add = calc_tickadd(mixer.sample_rate -
-				                              (diff / 5));
-			}
+	// At most an eighth of the prebuffer per second, which is well below
+	// what can be heard as a change in pitch
+	mixer.tick_add = calc_tickadd(mixer.sample_rate - diff / 8);
+}
 
-			else if (diff > (mixer.min_frames_needed >> 2)) {
-				mixer.tick_add = calc_tickadd(mixer.sample_rate -
-				                              (diff >> 3));
-			} else {
-				mixer.tick_add = calc_tickadd(mixer.sample_rate);
-			}
-		}
-	} else {
-		/* There is way too much data in the buffer */
-		//		LOG_WARNING("overflow run requested %u, have %u,
-		// min %u", frames_requested, mixer.frames_done.load(),
-		// mixer.min_frames_needed.load());
-		if (mixer.frames_done > MixerBufferLength) {
-			index_add = MixerBufferLength - 2 * mixer.min_frames_needed;
-		} else {
-			index_add = mixer.frames_done - 2 * mixer.min_frames_needed;
-		}
+// Throws away the frames the callback hasn't played yet. Only the consuming
+// side may pop from the queue, so this must only be called while the audio
+// device is paused or closed (meaning the callback isn't running).
+static void drain_output_queue()
+{
+	std::array<AudioFrame, 256> unplayed = {};
+	while (mixer.output_queue.PopBulk(unplayed.data(), unplayed.size()) > 0) {
+	}
+	mixer.is_output_primed = false;
+}
 
-		index_add = (index_add << IndexShiftLocal) / frames_requested;
-		reduce_frames = mixer.frames_done - 2 * mixer.min_frames_needed;
+// Clears the given frames in the work and aux buffers so they can be mixed
+// into again
+static void clear_mixed_frames(const work_index_t start_pos, const int num_frames)
+{
+	const auto first = std::min(num_frames, MixerBufferLength - start_pos);
 
-		mixer.tick_add = calc_tickadd(mixer.sample_rate -
-		                              (mixer.min_frames_needed / 5));
+	for (auto buf : {&mixer.work, &mixer.aux_reverb, &mixer.aux_chorus}) {
+		std::fill_n(buf->begin() + start_pos, first, std::array<float, 2>{});
+		std::fill_n(buf->begin(), num_frames - first, std::array<float, 2>{});
 	}
+}
 
-	reduce_channels_done_counts(reduce_frames);
+// Moves on from the frames finished this tick, delivering them to the audio
+// device or throwing them away, and sets up the next tick
+static void finish_tick(const bool deliver_frames)
+{
+	const auto num_frames = mixer.frames_needed.load();
 
-	// Reset mixer.tick_add when irqs are important
-	if (is_mixer_irq_important()) {
+	if (deliver_frames) {
+		enqueue_output_frames(mixer.pos, num_frames);
+	}
+	// The drift correction is only for live playback; captures and fast
+	// forward need the exact rate
+	if (deliver_frames && !is_mixer_irq_important()) {
+		adjust_tick_add();
+	} else {
 		mixer.tick_add = calc_tickadd(mixer.sample_rate);
 	}
+	clear_mixed_frames(mixer.pos, num_frames);
 
-	mixer.frames_done -= reduce_frames;
-
-	const auto frames_needed = mixer.frames_needed - reduce_frames;
-	mixer.frames_needed      = clamp_frames_needed(frames_needed);
-
-	pos       = mixer.pos;
-	mixer.pos = check_cast<work_index_t>((mixer.pos + reduce_frames) &
+	mixer.pos = check_cast<work_index_t>((mixer.pos + num_frames) &
 	                                     MixerBufferMask);
+	reduce_channels_done_counts(num_frames);
 
-	if (frames_requested != reduce_frames) {
-		while (frames_requested--) {
-			const auto i = check_cast<work_index_t>(
-			        (pos + (index >> IndexShiftLocal)) & MixerBufferMask);
-			index += index_add;
+	/* Set values for next tick */
+	mixer.tick_counter += mixer.tick_add;
+	mixer.frames_needed = clamp_frames_needed(mixer.tick_counter >> TickShift);
+	mixer.tick_counter &= TickMask;
+	mixer.frames_done = 0;
 
-			*output++ = clamp_to_int16(
-			        static_cast<int>(mixer.work[i][0]));
-			*output++ = clamp_to_int16(
-			        static_cast<int>(mixer.work[i][1]));
-		}
-		// Clean the used buffers
-		while (reduce_frames--) {
-			pos &= MixerBufferMask;
+	TracyPlot("Mixer queued frames",
+	          static_cast<int64_t>(mixer.output_queue.Size()));
+}
 
-			mixer.work[pos][0] = 0.0f;
-			mixer.work[pos][1] = 0.0f;
+static void handle_mix_samples()
+{
+	mix_samples(mixer.frames_needed);
+	finish_tick(true);
+}
 
-			mixer.aux_reverb[pos][0] = 0.0f;
-			mixer.aux_reverb[pos][1] = 0.0f;
+static void handle_mix_no_sound()
+{
+	mix_samples(mixer.frames_needed);
+	finish_tick(false);
+}
 
-			mixer.aux_chorus[pos][0] = 0.0f;
-			mixer.aux_chorus[pos][1] = 0.0f;
+// Runs on SDL's audio thread, and only ever touches the output queue and
+// the atomic counters, so it never waits for the emulation thread (nor
+// the other way around).
+static void SDLCALL mixer_callback([[maybe_unused]] void* userdata,
+                                   Uint8* stream, int len)
+{
+	ZoneScoped;
+	memset(stream, 0, static_cast<size_t>(len));
 
-			++pos;
+	const auto frames_requested = len / MixerFrameSize;
+	auto& queue                 = mixer.output_queue;
+
+	// After starting and after running dry, wait until this block plus
+	// a full prebuffer is queued, so one late tick doesn't cause a dropout
+	// on every following callback
+	if (!mixer.is_output_primed) {
+		const auto primed_frames = std::min(frames_requested +
+		                                            mixer.prebuffer_frames,
+		                                    mixer.max_queued_frames.load());
+		if (static_cast<int>(queue.Size()) < primed_frames) {
+			return;
 		}
-	} else {
-		while (reduce_frames--) {
-			pos &= MixerBufferMask;
-
-			*output++ = clamp_to_int16(
-			        static_cast<int>(mixer.work[pos][0]));
-			*output++ = clamp_to_int16(
-			        static_cast<int>(mixer.work[pos][1]));
+		mixer.is_output_primed = true;
+	}
 
-			mixer.work[pos][0] = 0.0f;
-			mixer.work[pos][1] = 0.0f;
+	static std::vector<AudioFrame> frames = {};
+	if (frames.size() < static_cast<size_t>(frames_requested)) {
+		frames.resize(static_cast<size_t>(frames_requested));
+	}
 
-			mixer.aux_reverb[pos][0] = 0.0f;
-			mixer.aux_reverb[pos][1] = 0.0f;
+	const auto num_popped = queue.PopBulk(frames.data(),
+	                                      static_cast<size_t>(frames_requested));
 
-			mixer.aux_chorus[pos][0] = 0.0f;
-			mixer.aux_chorus[pos][1] = 0.0f;
+	auto output = reinterpret_cast<int16_t*>(stream);
+	for (size_t i = 0; i < num_popped; ++i) {
+		*output++ = clamp_to_int16(static_cast<int>(frames[i].left));
+		*output++ = clamp_to_int16(static_cast<int>(frames[i].right));
+	}
 
-			++pos;
-		}
+	// The rest of the stream stays silent
+	if (num_popped < static_cast<size_t>(frames_requested)) {
+		++mixer.num_underruns;
+		mixer.is_output_primed = false;
 	}
 }
 
@@ -2635,13 +2591,18 @@ static void set_mixer_state(const MixerState requested)
 	if (mixer.sdldevice) {
 		SDL_PauseAudioDevice(mixer.sdldevice, mixer.state != MixerState::On);
 	}
+	// Once paused, SDL no longer runs the callback, so we can drop what it
+	// didn't play instead of leaving it for when the device resumes
+	if (mixer.state != MixerState::On) {
+		drain_output_queue();
+	}
 	//
 	// When unpaused, the device pulls frames queued by the
-	// handle_mix_samples() function, which it fetches from each channel's
-	// callback (every millisecond tick), and mixes into a stereo frame
-	// buffer.
+	// handle_mix_samples() function, which fetches them from each channel's
+	// callback (every millisecond tick), and mixes them into a stereo frame
+	// buffer before handing them over through the output queue.
 	//
-	// When paused, the audio device stops reading frames from our buffer,
+	// When paused, the audio device stops reading frames from the queue,
 	// so it's imporant that the we no longer queue them, which is why we
 	// use handle_mix_no_sound() (to throw away frames instead of queuing).
 }
@@ -2661,6 +2622,22 @@ void MIXER_CloseAudioDevice()
 	if (mixer.sdldevice) {
 		SDL_CloseAudioDevice(mixer.sdldevice);
 		mixer.sdldevice = 0;
+
+		// With the audio thread gone, we can take over the consuming
+		// side and drop whatever it didn't play
+		drain_output_queue();
+
+		if (mixer.num_underruns || mixer.num_overruns) {
+			LOG_MSG("MIXER: The audio device ran dry %" PRIu64
+			        " times; %" PRIu64 " frames were dropped %" PRIu64
+			        " times as the output queue was full",
+			        mixer.num_underruns.load(),
+			        mixer.num_dropped_frames.load(),
+			        mixer.num_overruns.load());
+		}
+		mixer.num_underruns      = 0;
+		mixer.num_overruns       = 0;
+		mixer.num_dropped_frames = 0;
 	}
 	mixer.state = MixerState::Uninitialized;
 }
@@ -2730,6 +2707,16 @@ static bool init_sdl_sound(Section_prop* section)
 	        mixer.sample_rate.load(),
 	        mixer.blocksize);
 
+	// The device is still paused, so the callback can't see these change
+	const auto prebuffer_frames = (mixer.sample_rate * mixer.prebuffer_ms) / 1000;
+	mixer.prebuffer_frames      = prebuffer_frames;
+
+	// The queue's capacity bounds the latency as well, which only matters
+	// with the very largest blocksizes
+	const auto queue_capacity = static_cast<int>(mixer.output_queue.Capacity());
+	mixer.max_queued_frames = std::min(mixer.blocksize * 2 + 2 * prebuffer_frames,
+	                                   queue_capacity);
+
 	return true;
 }
 
@@ -2775,6 +2762,11 @@ void MIXER_Init(Section* sec)
 	mixer.sample_rate = check_cast<uint16_t>(section->Get_int("rate"));
 	mixer.blocksize = static_cast<uint16_t>(section->Get_int("blocksize"));
 
+	const auto requested_prebuffer_ms = section->Get_int("prebuffer");
+
+	mixer.prebuffer_ms = check_cast<uint16_t>(
+	        clamp(requested_prebuffer_ms, 1, MaxPrebufferMs));
+
 	const auto configured_state = section->Get_bool("nosound")
 	                                    ? MixerState::NoSound
 	                                    : MixerState::On;
@@ -2783,6 +2775,11 @@ void MIXER_Init(Section* sec)
 		LOG_MSG("MIXER: Sound output disabled ('nosound' mode)");
 		set_mixer_state(MixerState::NoSound);
 
+	} else if (control->arguments.headless) {
+		// Still mixed every tick, so the output can be captured
+		LOG_MSG("MIXER: Sound output disabled (headless mode)");
+		set_mixer_state(MixerState::NoSound);
+
 	} else {
 		if (init_sdl_sound(section)) {
 			set_mixer_state(MixerState::On);
@@ -2794,11 +2791,6 @@ void MIXER_Init(Section* sec)
 	mixer.tick_counter = (mixer.sample_rate % (1000 / 8)) ? TickNext : 0;
 	mixer.tick_add     = calc_tickadd(mixer.sample_rate);
 
-	const auto requested_prebuffer_ms = section->Get_int("prebuffer");
-
-	mixer.prebuffer_ms = check_cast<uint16_t>(
-	        clamp(requested_prebuffer_ms, 1, MaxPrebufferMs));
-
 	const auto prebuffer_frames = (mixer.sample_rate * mixer.prebuffer_ms) / 1000;
 
 	mixer.pos           = 0;
@@ -98,6 +98,15 @@ public:
         *sampleL= *sampleL+resultL*1.4f;
         *sampleR= *sampleR+resultR*1.4f;
     }
+
+    // Processes a block of non-interleaved samples in place
+    void process(float *samplesL, float *samplesR, int sampleFrames)
+    {
+        for (int i = 0; i < sampleFrames; ++i)
+        {
+            process(&samplesL[i], &samplesR[i]);
+        }
+    }
 };
 
 #endif
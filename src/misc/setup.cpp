@@ -1777,6 +1777,8 @@ void Config::ParseArguments()
 	arguments.exit        = cmdline->FindRemoveBoolArgument("exit");
 	arguments.securemode = cmdline->FindRemoveBoolArgument("securemode");
 	arguments.noautoexec = cmdline->FindRemoveBoolArgument("noautoexec");
+	arguments.headless   = cmdline->FindRemoveBoolArgument("headless");
+	arguments.capture_audio = cmdline->FindRemoveBoolArgument("capture-audio");
 
 	arguments.eraseconf = cmdline->FindRemoveBoolArgument("eraseconf") ||
 	                      cmdline->FindRemoveBoolArgument("resetconf");
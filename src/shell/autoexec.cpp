@@ -319,8 +319,9 @@ AutoExecModule::AutoExecModule(Section* configuration)
 		AddLine(Placement::CommandsBeforeSecureMode, argument);
 	}
 
-	// Check for the -exit switch, which indicates they want to quit
-	const bool exit_arg_exists = arguments->exit;
+	// Check for the -exit switch, which indicates they want to quit; batch
+	// runs always quit once the [autoexec] sections are done
+	const bool exit_arg_exists = arguments->exit || arguments->headless;
 
 	// Check if instant-launch is active
 	const bool using_instant_launch_with_executable =
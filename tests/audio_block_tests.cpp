@@ -0,0 +1,359 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "audio_block.h"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <Iir.h>
+#include <gtest/gtest.h>
+
+#include "../src/hardware/compressor.h"
+#include "audio_frame.h"
+#include "mverb/MVerb.h"
+#include "tal-chorus/ChorusEngine.h"
+
+namespace {
+
+constexpr int sample_rate = 48000;
+constexpr int ring_frames = 16 * 1024; // like the mixer's work buffer
+constexpr int ring_mask   = ring_frames - 1;
+constexpr int block_frames = 1000;
+
+using Ring  = std::vector<std::array<float, 2>>;
+using Block = std::array<std::vector<float>, 2>;
+
+Ring make_noise_ring(const unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> dist(-20000.0f, 20000.0f);
+
+	Ring ring(ring_frames);
+	for (auto& frame : ring) {
+		frame = {dist(rng), dist(rng)};
+	}
+	return ring;
+}
+
+// The mixer's master effect chain, set up like its defaults with the
+// medium reverb and normal chorus presets
+struct MasterChain {
+	MVerb<float> mverb = {};
+	std::array<Iir::Butterworth::HighPass<2>, 2> reverb_highpass = {};
+	ChorusEngine chorus = ChorusEngine(sample_rate);
+	std::array<Iir::Butterworth::HighPass<2>, 2> master_highpass = {};
+	Compressor compressor = {};
+
+	bool do_reverb = true;
+
+	MasterChain()
+	{
+		using V = MVerb<float>;
+		mverb.setParameter(V::PREDELAY, 0.00f);
+		mverb.setParameter(V::EARLYMIX, 0.75f);
+		mverb.setParameter(V::SIZE, 0.50f);
+		mverb.setParameter(V::DENSITY, 0.50f);
+		mverb.setParameter(V::BANDWIDTHFREQ, 0.95f);
+		mverb.setParameter(V::DECAY, 0.42f);
+		mverb.setParameter(V::DAMPINGFREQ, 0.21f);
+		mverb.setParameter(V::GAIN, 1.0f);
+		mverb.setParameter(V::MIX, 1.0f);
+		mverb.setSampleRate(static_cast<float>(sample_rate));
+
+		chorus.setSampleRate(static_cast<float>(sample_rate));
+		chorus.setEnablesChorus(true, false);
+
+		for (auto& f : reverb_highpass) {
+			f.setup(sample_rate, 170.0);
+		}
+		for (auto& f : master_highpass) {
+			f.setup(sample_rate, 20.0);
+		}
+		compressor.Configure(sample_rate, 32767.0f, -6.0f, 3.0f, 0.01f, 5000.0f, 10.0f);
+	}
+};
+
+// The chain as it used to run, one frame at a time with masked indices
+void process_per_frame(MasterChain& c, Ring& work, const Ring& aux_reverb,
+                       const Ring& aux_chorus, const int start_pos,
+                       const int num_frames)
+{
+	if (c.do_reverb) {
+		auto pos = start_pos;
+		for (int i = 0; i < num_frames; ++i) {
+			float left  = c.reverb_highpass[0].filter(aux_reverb[pos][0]);
+			float right = c.reverb_highpass[1].filter(aux_reverb[pos][1]);
+			float* buf[2] = {&left, &right};
+			c.mverb.process(buf, buf, 1);
+			work[pos][0] += left;
+			work[pos][1] += right;
+			pos = (pos + 1) & ring_mask;
+		}
+	}
+	auto pos = start_pos;
+	for (int i = 0; i < num_frames; ++i) {
+		AudioFrame frame = {aux_chorus[pos][0], aux_chorus[pos][1]};
+		c.chorus.process(&frame.left, &frame.right);
+		work[pos][0] += frame.left;
+		work[pos][1] += frame.right;
+		pos = (pos + 1) & ring_mask;
+	}
+	pos = start_pos;
+	for (int i = 0; i < num_frames; ++i) {
+		for (size_t ch = 0; ch < 2; ++ch) {
+			work[pos][ch] = c.master_highpass[ch].filter(work[pos][ch]);
+		}
+		pos = (pos + 1) & ring_mask;
+	}
+	pos = start_pos;
+	for (int i = 0; i < num_frames; ++i) {
+		const auto frame = c.compressor.Process({work[pos][0], work[pos][1]});
+		work[pos][0] = frame.left;
+		work[pos][1] = frame.right;
+		pos = (pos + 1) & ring_mask;
+	}
+}
+
+void read_block(const Ring& ring, const int start_pos, const int num_frames,
+                Block& block)
+{
+	read_ring_frames(ring[0].data(), ring_frames, start_pos, num_frames,
+	                 block[0].data(), block[1].data());
+}
+
+void write_block(const Block& block, const int start_pos, const int num_frames,
+                 Ring& ring)
+{
+	write_ring_frames(block[0].data(), block[1].data(), ring[0].data(),
+	                  ring_frames, start_pos, num_frames);
+}
+
+// The chain as the mixer runs it now, on whole non-interleaved blocks
+void process_blocks(MasterChain& c, Ring& work, const Ring& aux_reverb,
+                    const Ring& aux_chorus, const int start_pos,
+                    const int num_frames)
+{
+	static Block master = {std::vector<float>(block_frames),
+	                       std::vector<float>(block_frames)};
+	static Block effect = {std::vector<float>(block_frames),
+	                       std::vector<float>(block_frames)};
+
+	read_block(work, start_pos, num_frames, master);
+
+	if (c.do_reverb) {
+		read_block(aux_reverb, start_pos, num_frames, effect);
+		for (size_t ch = 0; ch < 2; ++ch) {
+			filter_samples(c.reverb_highpass[ch], effect[ch].data(), num_frames);
+		}
+		float* buf[2] = {effect[0].data(), effect[1].data()};
+		c.mverb.process(buf, buf, num_frames);
+		for (size_t ch = 0; ch < 2; ++ch) {
+			add_samples(master[ch].data(), effect[ch].data(), num_frames);
+		}
+	}
+
+	read_block(aux_chorus, start_pos, num_frames, effect);
+	c.chorus.process(effect[0].data(), effect[1].data(), num_frames);
+	for (size_t ch = 0; ch < 2; ++ch) {
+		add_samples(master[ch].data(), effect[ch].data(), num_frames);
+	}
+
+	for (size_t ch = 0; ch < 2; ++ch) {
+		filter_samples(c.master_highpass[ch], master[ch].data(), num_frames);
+	}
+	c.compressor.Process(master[0].data(), master[1].data(), num_frames);
+
+	write_block(master, start_pos, num_frames, work);
+}
+
+TEST(AudioBlock, InterleaveRoundTrip)
+{
+	const std::vector<float> frames = {1, 2, 3, 4, 5, 6};
+	std::vector<float> left(3), right(3), out(6);
+
+	deinterleave_frames(frames.data(), left.data(), right.data(), 3);
+	EXPECT_EQ(left, (std::vector<float>{1, 3, 5}));
+	EXPECT_EQ(right, (std::vector<float>{2, 4, 6}));
+
+	interleave_frames(left.data(), right.data(), out.data(), 3);
+	EXPECT_EQ(out, frames);
+}
+
+TEST(AudioBlock, RingFramesWrapAround)
+{
+	constexpr int frames = 4;
+	const std::vector<float> ring = {1, 2, 3, 4, 5, 6, 7, 8};
+	std::vector<float> left(3), right(3);
+
+	read_ring_frames(ring.data(), frames, 2, 3, left.data(), right.data());
+	EXPECT_EQ(left, (std::vector<float>{5, 7, 1}));
+	EXPECT_EQ(right, (std::vector<float>{6, 8, 2}));
+
+	std::vector<float> out(8);
+	write_ring_frames(left.data(), right.data(), out.data(), frames, 2, 3);
+	EXPECT_EQ(out, (std::vector<float>{1, 2, 0, 0, 5, 6, 7, 8}));
+}
+
+TEST(AudioBlock, RingFramesWithoutWrap)
+{
+	constexpr int frames = 4;
+	const std::vector<float> ring = {1, 2, 3, 4, 5, 6, 7, 8};
+	std::vector<float> left(4), right(4);
+
+	read_ring_frames(ring.data(), frames, 0, 4, left.data(), right.data());
+	EXPECT_EQ(left, (std::vector<float>{1, 3, 5, 7}));
+	EXPECT_EQ(right, (std::vector<float>{2, 4, 6, 8}));
+
+	std::vector<float> out(8);
+	write_ring_frames(left.data(), right.data(), out.data(), frames, 0, 4);
+	EXPECT_EQ(out, ring);
+}
+
+TEST(AudioBlock, AddSamples)
+{
+	std::vector<float> dest = {1, 2, 3};
+	const std::vector<float> src = {10, 20, 30};
+
+	add_samples(dest.data(), src.data(), 3);
+	EXPECT_EQ(dest, (std::vector<float>{11, 22, 33}));
+
+	add_samples(dest.data(), src.data(), 0);
+	EXPECT_EQ(dest, (std::vector<float>{11, 22, 33}));
+}
+
+TEST(AudioBlock, FilterSamplesMatchesPerSample)
+{
+	Iir::Butterworth::HighPass<2> per_sample = {};
+	Iir::Butterworth::HighPass<2> block      = {};
+	per_sample.setup(sample_rate, 20.0);
+	block.setup(sample_rate, 20.0);
+
+	const auto ring = make_noise_ring(1);
+	std::vector<float> expected(ring_frames), actual(ring_frames);
+	for (int i = 0; i < ring_frames; ++i) {
+		expected[i] = per_sample.filter(ring[i][0]);
+		actual[i]   = ring[i][0];
+	}
+	filter_samples(block, actual.data(), ring_frames);
+
+	EXPECT_EQ(actual, expected);
+}
+
+// Without the reverb, which now spreads parameter changes over each block,
+// the block path must produce exactly the same output, also across the wrap
+// of the ring.
+TEST(AudioBlock, MasterChainMatchesPerFrame)
+{
+	// MVerb's delay lines are far too big for the stack
+	auto per_frame_chain = std::make_unique<MasterChain>();
+	auto block_chain     = std::make_unique<MasterChain>();
+	per_frame_chain->do_reverb = false;
+	block_chain->do_reverb     = false;
+
+	const auto aux_reverb = make_noise_ring(2);
+	const auto aux_chorus = make_noise_ring(3);
+	auto expected         = make_noise_ring(4);
+	auto actual           = expected;
+
+	auto pos = ring_frames - 2500;
+	for (int i = 0; i < 10; ++i) {
+		process_per_frame(*per_frame_chain, expected, aux_reverb, aux_chorus, pos, block_frames);
+		process_blocks(*block_chain, actual, aux_reverb, aux_chorus, pos, block_frames);
+		pos = (pos + block_frames) & ring_mask;
+	}
+	EXPECT_EQ(actual, expected);
+}
+
+// MVerb ramps its smoothed parameters over each block it's given, so one
+// frame at a time they reach their targets at once but over a whole block
+// only by its end, with some rounding left over. After a silent warm-up
+// the parameters have settled and the outputs only differ by that rounding.
+TEST(AudioBlock, MasterChainWithReverbMatchesPerFrame)
+{
+	auto per_frame_chain = std::make_unique<MasterChain>();
+	auto block_chain     = std::make_unique<MasterChain>();
+
+	const Ring silence(ring_frames);
+	auto expected = silence;
+	auto actual   = silence;
+
+	auto pos = 0;
+	for (int i = 0; i < 4; ++i) {
+		process_per_frame(*per_frame_chain, expected, silence, silence, pos, block_frames);
+		process_blocks(*block_chain, actual, silence, silence, pos, block_frames);
+		pos = (pos + block_frames) & ring_mask;
+	}
+
+	const auto aux_reverb = make_noise_ring(8);
+	const auto aux_chorus = make_noise_ring(9);
+	expected              = make_noise_ring(10);
+	actual                = expected;
+
+	pos = ring_frames - 2500;
+	for (int i = 0; i < 10; ++i) {
+		process_per_frame(*per_frame_chain, expected, aux_reverb, aux_chorus, pos, block_frames);
+		process_blocks(*block_chain, actual, aux_reverb, aux_chorus, pos, block_frames);
+		pos = (pos + block_frames) & ring_mask;
+	}
+
+	// less than half a step of the 16-bit output
+	constexpr float tolerance = 0.5f;
+	for (int i = 0; i < ring_frames; ++i) {
+		for (size_t ch = 0; ch < 2; ++ch) {
+			ASSERT_NEAR(actual[i][ch], expected[i][ch], tolerance)
+			        << "frame " << i << ", channel " << ch;
+		}
+	}
+}
+
+TEST(AudioBlock, MasterChainBenchmark)
+{
+	using namespace std::chrono;
+	constexpr int num_blocks = 500;
+
+	const auto aux_reverb = make_noise_ring(5);
+	const auto aux_chorus = make_noise_ring(6);
+	auto work             = make_noise_ring(7);
+
+	auto run = [&](auto process) {
+		auto chain       = std::make_unique<MasterChain>();
+		int pos          = 0;
+		const auto start = steady_clock::now();
+		for (int i = 0; i < num_blocks; ++i) {
+			process(*chain, work, aux_reverb, aux_chorus, pos, block_frames);
+			pos = (pos + block_frames) & ring_mask;
+		}
+		return duration_cast<nanoseconds>(steady_clock::now() - start).count() /
+		       num_blocks;
+	};
+	const auto per_frame_ns = run(process_per_frame);
+	const auto block_ns     = run(process_blocks);
+
+	printf("Master effect chain per 1000 frames: per-frame %lld ns, blocks %lld ns\n",
+	       static_cast<long long>(per_frame_ns),
+	       static_cast<long long>(block_ns));
+}
+
+} // namespace
@@ -0,0 +1,173 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "free_extents.h"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t first_page = 0x110;
+constexpr uint32_t num_pages  = 4096;
+
+TEST(FreeExtents, StartsWithOneRun)
+{
+	FreeExtents extents;
+	extents.Reset(first_page, num_pages);
+	EXPECT_EQ(extents.Total(), num_pages);
+	EXPECT_EQ(extents.Largest(), num_pages);
+	EXPECT_EQ(extents.NumExtents(), 1);
+	EXPECT_EQ(extents.FindBestFit(1), first_page);
+	EXPECT_EQ(extents.FindBestFit(num_pages), first_page);
+	EXPECT_EQ(extents.FindBestFit(num_pages + 1), 0);
+}
+
+TEST(FreeExtents, EmptyPool)
+{
+	FreeExtents extents;
+	extents.Reset(first_page, 0);
+	EXPECT_EQ(extents.Total(), 0);
+	EXPECT_EQ(extents.Largest(), 0);
+	EXPECT_EQ(extents.FindBestFit(1), 0);
+}
+
+TEST(FreeExtents, TakeSplitsRun)
+{
+	FreeExtents extents;
+	extents.Reset(100, 50);
+	extents.Take(100, 20);
+	EXPECT_EQ(extents.Total(), 30);
+	EXPECT_EQ(extents.LengthAt(100), 0);
+	EXPECT_EQ(extents.LengthAt(120), 30);
+	extents.Take(120, 30);
+	EXPECT_EQ(extents.Total(), 0);
+	EXPECT_EQ(extents.NumExtents(), 0);
+}
+
+TEST(FreeExtents, PicksSmallestFittingRun)
+{
+	FreeExtents extents;
+	extents.Reset(100, 100);
+	extents.Take(100, 100);
+	extents.Release(100, 10); // [100, 110)
+	extents.Release(120, 4);  // [120, 124)
+	extents.Release(130, 6);  // [130, 136)
+	extents.Release(150, 4);  // [150, 154)
+
+	EXPECT_EQ(extents.FindBestFit(4), 120); // exact, lowest first
+	EXPECT_EQ(extents.FindBestFit(5), 130);
+	EXPECT_EQ(extents.FindBestFit(7), 100);
+	EXPECT_EQ(extents.FindBestFit(11), 0);
+	EXPECT_EQ(extents.Largest(), 10);
+}
+
+TEST(FreeExtents, ReleaseMergesNeighbours)
+{
+	FreeExtents extents;
+	extents.Reset(100, 30);
+	extents.Take(100, 30);
+
+	extents.Release(100, 10);
+	extents.Release(120, 10);
+	EXPECT_EQ(extents.NumExtents(), 2);
+
+	// Fills the gap, joining both sides into one run
+	extents.Release(110, 10);
+	EXPECT_EQ(extents.NumExtents(), 1);
+	EXPECT_EQ(extents.LengthAt(100), 30);
+	EXPECT_EQ(extents.Total(), 30);
+}
+
+// Finds the best fitting run the way MEM_AllocatePages used to, by scanning
+// every page
+uint32_t scan_best_fit(const std::vector<bool>& used, const uint32_t count)
+{
+	uint32_t best       = 0;
+	uint32_t best_first = 0;
+	uint32_t page       = first_page;
+	while (page < used.size()) {
+		if (used[page]) {
+			++page;
+			continue;
+		}
+		const auto first = page;
+		while (page < used.size() && !used[page])
+			++page;
+		const auto length = page - first;
+		if (length >= count && (!best || length < best)) {
+			best       = length;
+			best_first = first;
+		}
+	}
+	return best_first;
+}
+
+TEST(FreeExtents, AllocationChurnMatchesScan)
+{
+	FreeExtents extents;
+	extents.Reset(first_page, num_pages);
+	std::vector<bool> used(first_page + num_pages, false);
+
+	struct Block {
+		uint32_t first;
+		uint32_t count;
+	};
+	std::vector<Block> blocks = {};
+
+	std::mt19937 rng(1234);
+	std::uniform_int_distribution<uint32_t> size_dist(1, 64);
+	uint32_t num_used = 0;
+
+	for (int i = 0; i < 20000; ++i) {
+		if (blocks.empty() || rng() % 100 < 55) {
+			const auto count = size_dist(rng);
+			const auto first = extents.FindBestFit(count);
+			ASSERT_EQ(first, scan_best_fit(used, count));
+			if (!first)
+				continue;
+			extents.Take(first, count);
+			for (auto p = first; p < first + count; ++p)
+				used[p] = true;
+			blocks.push_back({first, count});
+			num_used += count;
+		} else {
+			const auto index = rng() % blocks.size();
+			const auto block = blocks[index];
+			blocks[index]    = blocks.back();
+			blocks.pop_back();
+			extents.Release(block.first, block.count);
+			for (auto p = block.first; p < block.first + block.count; ++p)
+				used[p] = false;
+			num_used -= block.count;
+		}
+		ASSERT_EQ(extents.Total(), num_pages - num_used);
+	}
+
+	// Handing everything back merges it into the single starting run
+	for (const auto& block : blocks)
+		extents.Release(block.first, block.count);
+	EXPECT_EQ(extents.NumExtents(), 1);
+	EXPECT_EQ(extents.Largest(), num_pages);
+}
+
+} // namespace
@@ -21,7 +21,10 @@
 #include "../src/hardware/iohandler_containers.cpp"
 
 #include <cassert>
+#include <chrono>
 #include <cstdint>
+#include <cstdio>
+#include <unordered_map>
 
 #include <gtest/gtest.h>
 
@@ -195,4 +198,70 @@ TEST(iohandler_containers, adjacent_dword_write)
 	EXPECT_EQ(read_word_from_port(word_port_start), val >> 16);
 }
 
+TEST(iohandler_containers, free_handler)
+{
+	constexpr uint16_t port = 0x3d5;
+
+	IO_RegisterReadHandler(port, read_byte_new, io_width_t::byte);
+	byte_val_new = 0x12;
+	EXPECT_EQ(read_byte_from_port(port), 0x12);
+
+	IO_FreeReadHandler(port, io_width_t::byte);
+	EXPECT_EQ(read_byte_from_port(port), 0xff);
+}
+
+TEST(iohandler_containers, capturing_handler)
+{
+	constexpr uint16_t port = 0x3d6;
+
+	uint32_t last_write = 0;
+	IO_RegisterWriteHandler(
+	        port,
+	        [&last_write](io_port_t, io_val_t val, io_width_t) {
+		        last_write = val;
+	        },
+	        io_width_t::dword);
+
+	write_dword_to_port(port, 0x12345678);
+	EXPECT_EQ(last_write, 0x12345678u);
+
+	IO_FreeWriteHandler(port, io_width_t::dword);
+}
+
+// Times byte reads through the flat dispatch tables against the hash map
+// lookup they replaced; prints the results rather than asserting on them
+TEST(iohandler_containers, dispatch_benchmark)
+{
+	using namespace std::chrono;
+	constexpr int iterations = 2000000;
+	constexpr uint16_t port  = 0x3da;
+
+	IO_RegisterReadHandler(port, read_byte_new, io_width_t::byte);
+	std::unordered_map<io_port_t, io_read_f> map_handlers = {};
+	map_handlers.emplace(port, read_byte_new);
+	byte_val_new = 1;
+
+	uint32_t map_sum     = 0;
+	const auto map_start = steady_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		const auto [it, was_blocked] = map_handlers.emplace(port, blocked_read);
+		map_sum += it->second(port, io_width_t::byte) & 0xff;
+	}
+	const auto map_time = steady_clock::now() - map_start;
+
+	uint32_t table_sum     = 0;
+	const auto table_start = steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		table_sum += read_byte_from_port(port);
+	const auto table_time = steady_clock::now() - table_start;
+
+	EXPECT_EQ(map_sum, table_sum);
+	printf("IN of %d bytes: hash map %lld us, flat table %lld us\n",
+	       iterations,
+	       static_cast<long long>(duration_cast<microseconds>(map_time).count()),
+	       static_cast<long long>(duration_cast<microseconds>(table_time).count()));
+
+	IO_FreeReadHandler(port, io_width_t::byte);
+}
+
 } // namespace
@@ -0,0 +1,351 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "pic_event_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+void handler_a(uint32_t) {}
+void handler_b(uint32_t) {}
+void handler_c(uint32_t) {}
+
+std::vector<PicEventQueue::Event> drain(PicEventQueue& queue)
+{
+	std::vector<PicEventQueue::Event> events = {};
+	while (!queue.IsEmpty())
+		events.push_back(queue.Pop());
+	return events;
+}
+
+TEST(PicEventQueue, PopsInIndexOrder)
+{
+	PicEventQueue queue;
+	queue.Add(0.5, handler_a, 1);
+	queue.Add(0.1, handler_b, 2);
+	queue.Add(0.9, handler_c, 3);
+	queue.Add(0.3, handler_a, 4);
+
+	EXPECT_EQ(queue.Size(), 4);
+	EXPECT_EQ(queue.Next().value, 2);
+
+	const auto events = drain(queue);
+	ASSERT_EQ(events.size(), 4);
+	EXPECT_EQ(events[0].value, 2);
+	EXPECT_EQ(events[1].value, 4);
+	EXPECT_EQ(events[2].value, 1);
+	EXPECT_EQ(events[3].value, 3);
+}
+
+TEST(PicEventQueue, EqualIndexesRunInOrderAdded)
+{
+	PicEventQueue queue;
+	for (uint32_t i = 0; i < 100; ++i)
+		queue.Add(0.25, (i % 2) ? handler_a : handler_b, i);
+
+	const auto events = drain(queue);
+	ASSERT_EQ(events.size(), 100);
+	for (uint32_t i = 0; i < 100; ++i)
+		EXPECT_EQ(events[i].value, i);
+}
+
+TEST(PicEventQueue, RemoveAllOfHandler)
+{
+	PicEventQueue queue;
+	for (uint32_t i = 0; i < 30; ++i)
+		queue.Add(i * 0.01, (i % 3) ? handler_a : handler_b, i);
+
+	queue.RemoveAll(handler_a);
+	queue.RemoveAll(handler_c); // nothing scheduled
+
+	const auto events = drain(queue);
+	ASSERT_EQ(events.size(), 10);
+	for (const auto& event : events)
+		EXPECT_EQ(event.handler, handler_b);
+}
+
+TEST(PicEventQueue, RemoveSpecificValue)
+{
+	PicEventQueue queue;
+	queue.Add(0.1, handler_a, 1);
+	queue.Add(0.2, handler_a, 2);
+	queue.Add(0.3, handler_b, 1);
+	queue.Add(0.4, handler_a, 1);
+
+	queue.RemoveSpecific(handler_a, 1);
+
+	const auto events = drain(queue);
+	ASSERT_EQ(events.size(), 2);
+	EXPECT_EQ(events[0].handler, handler_a);
+	EXPECT_EQ(events[0].value, 2);
+	EXPECT_EQ(events[1].handler, handler_b);
+}
+
+TEST(PicEventQueue, GrowsInsteadOfDropping)
+{
+	// The old queue dropped anything past 512 events
+	PicEventQueue queue;
+	for (uint32_t i = 0; i < 5000; ++i)
+		queue.Add(5000.0 - i, handler_a, i);
+	EXPECT_EQ(queue.Size(), 5000);
+	EXPECT_EQ(queue.Next().value, 4999);
+}
+
+TEST(PicEventQueue, AdvanceKeepsOrder)
+{
+	PicEventQueue queue;
+	queue.Add(1.5, handler_a, 1);
+	queue.Add(0.5, handler_a, 2);
+	queue.Advance(1.0);
+
+	EXPECT_DOUBLE_EQ(queue.Next().index, -0.5);
+	const auto events = drain(queue);
+	EXPECT_EQ(events[0].value, 2);
+	EXPECT_DOUBLE_EQ(events[1].index, 0.5);
+}
+
+// Replaying a trace of scheduler operations
+// ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+// The trace mimics what a busy machine schedules: self-rescheduling VGA
+// line events, SB DMA transfers that get cancelled and restarted, OPL
+// timers removed by value, GUS voice ramps and NE2000 polling. Both the
+// heap and the sorted list the PIC used to keep replay it, and must run
+// the same events in the same order.
+
+enum class Op { Add, RemoveAll, RemoveSpecific, Run, Tick };
+
+struct TraceOp {
+	Op op;
+	int handler;
+	double index;
+	uint32_t value;
+};
+
+constexpr int num_trace_handlers = 8;
+
+void trace_handler0(uint32_t) {}
+void trace_handler1(uint32_t) {}
+void trace_handler2(uint32_t) {}
+void trace_handler3(uint32_t) {}
+void trace_handler4(uint32_t) {}
+void trace_handler5(uint32_t) {}
+void trace_handler6(uint32_t) {}
+void trace_handler7(uint32_t) {}
+
+constexpr PIC_EventHandler trace_handlers[num_trace_handlers] = {
+        trace_handler0, trace_handler1, trace_handler2, trace_handler3,
+        trace_handler4, trace_handler5, trace_handler6, trace_handler7};
+
+std::vector<TraceOp> make_trace(const int num_ticks)
+{
+	std::vector<TraceOp> trace = {};
+	std::mt19937 rng(4321);
+	std::uniform_real_distribution<double> delay(0.0, 1.0);
+
+	for (int tick = 0; tick < num_ticks; ++tick) {
+		for (int step = 1; step <= 20; ++step) {
+			const double now = step / 20.0;
+			// VGA line and retrace events
+			for (int i = 0; i < 16; ++i)
+				trace.push_back({Op::Add, 0, now + delay(rng) * 0.05, 0});
+			// SB DMA restarts
+			trace.push_back({Op::RemoveAll, 1, 0, 0});
+			trace.push_back({Op::Add, 1, now + 0.1, 0});
+			// OPL timers
+			const auto timer = static_cast<uint32_t>(rng() % 2);
+			trace.push_back({Op::RemoveSpecific, 2, 0, timer});
+			trace.push_back({Op::Add, 2, now + 0.08 + delay(rng), timer});
+			// GUS voices
+			for (uint32_t voice = 0; voice < 8; ++voice)
+				trace.push_back({Op::Add, 3 + static_cast<int>(voice % 3),
+				                 now + delay(rng) * 2.0, voice});
+			// NE2000 and other periodic pollers
+			trace.push_back({Op::Add, 6 + static_cast<int>(rng() % 2),
+			                 now + delay(rng) * 10.0, 0});
+			trace.push_back({Op::Run, 0, now, 0});
+		}
+		trace.push_back({Op::Tick, 0, 0, 0});
+	}
+	return trace;
+}
+
+// The sorted singly linked list the PIC used before, with a growable pool
+class ListEventQueue {
+public:
+	struct Entry {
+		double index;
+		uint32_t value;
+		PIC_EventHandler handler;
+		Entry* next;
+	};
+
+	ListEventQueue() : entries(64 * 1024)
+	{
+		for (size_t i = 0; i + 1 < entries.size(); ++i)
+			entries[i].next = &entries[i + 1];
+		free_entry = &entries[0];
+	}
+
+	void Add(const double index, const PIC_EventHandler handler,
+	         const uint32_t value)
+	{
+		Entry* entry = free_entry;
+		assert(entry);
+		free_entry = entry->next;
+		*entry     = {index, value, handler, nullptr};
+
+		Entry** where = &next_entry;
+		while (*where && (*where)->index <= index)
+			where = &(*where)->next;
+		entry->next = *where;
+		*where      = entry;
+	}
+
+	template <typename Match>
+	void RemoveIf(Match match)
+	{
+		Entry** where = &next_entry;
+		while (*where) {
+			Entry* entry = *where;
+			if (match(*entry)) {
+				*where      = entry->next;
+				entry->next = free_entry;
+				free_entry  = entry;
+			} else {
+				where = &entry->next;
+			}
+		}
+	}
+
+	void Pop()
+	{
+		Entry* entry = next_entry;
+		next_entry   = entry->next;
+		entry->next  = free_entry;
+		free_entry   = entry;
+	}
+
+	void Advance(const double amount)
+	{
+		for (Entry* entry = next_entry; entry; entry = entry->next)
+			entry->index -= amount;
+	}
+
+	Entry* next_entry = nullptr;
+
+private:
+	std::vector<Entry> entries = {};
+	Entry* free_entry          = nullptr;
+};
+
+// Returns a running checksum of the events in the order they ran
+uint64_t replay(PicEventQueue& queue, const std::vector<TraceOp>& trace)
+{
+	uint64_t checksum = 0;
+	for (const auto& op : trace) {
+		const auto handler = trace_handlers[op.handler];
+		switch (op.op) {
+		case Op::Add: queue.Add(op.index, handler, op.value); break;
+		case Op::RemoveAll: queue.RemoveAll(handler); break;
+		case Op::RemoveSpecific:
+			queue.RemoveSpecific(handler, op.value);
+			break;
+		case Op::Run:
+			while (!queue.IsEmpty() && queue.Next().index <= op.index) {
+				const auto event = queue.Pop();
+				checksum = checksum * 31 +
+				           reinterpret_cast<uintptr_t>(event.handler) +
+				           event.value;
+			}
+			break;
+		case Op::Tick: queue.Advance(1.0); break;
+		}
+	}
+	return checksum;
+}
+
+uint64_t replay(ListEventQueue& queue, const std::vector<TraceOp>& trace)
+{
+	uint64_t checksum = 0;
+	for (const auto& op : trace) {
+		const auto handler = trace_handlers[op.handler];
+		switch (op.op) {
+		case Op::Add: queue.Add(op.index, handler, op.value); break;
+		case Op::RemoveAll:
+			queue.RemoveIf([=](const auto& e) {
+				return e.handler == handler;
+			});
+			break;
+		case Op::RemoveSpecific:
+			queue.RemoveIf([=](const auto& e) {
+				return e.handler == handler && e.value == op.value;
+			});
+			break;
+		case Op::Run:
+			while (queue.next_entry && queue.next_entry->index <= op.index) {
+				const auto event = *queue.next_entry;
+				queue.Pop();
+				checksum = checksum * 31 +
+				           reinterpret_cast<uintptr_t>(event.handler) +
+				           event.value;
+			}
+			break;
+		case Op::Tick: queue.Advance(1.0); break;
+		}
+	}
+	return checksum;
+}
+
+TEST(PicEventQueue, ReplayTraceBenchmark)
+{
+	using namespace std::chrono;
+	const auto trace = make_trace(1000);
+
+	PicEventQueue heap_queue;
+	auto start              = steady_clock::now();
+	const auto heap_result  = replay(heap_queue, trace);
+	const auto heap_time_us = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+	ListEventQueue list_queue;
+	start                   = steady_clock::now();
+	const auto list_result  = replay(list_queue, trace);
+	const auto list_time_us = duration_cast<microseconds>(steady_clock::now() - start).count();
+
+	EXPECT_EQ(heap_result, list_result);
+	EXPECT_EQ(heap_queue.Size(), [&] {
+		size_t n = 0;
+		for (auto e = list_queue.next_entry; e; e = e->next)
+			++n;
+		return n;
+	}());
+
+	printf("Replayed %zu scheduler operations: heap %lld us, sorted list %lld us\n",
+	       trace.size(),
+	       static_cast<long long>(heap_time_us),
+	       static_cast<long long>(list_time_us));
+}
+
+} // namespace
@@ -0,0 +1,108 @@
+/*
+ *  SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ *  Copyright (C) 2023-2023  The DOSBox Staging Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "spsc_ring.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr auto iterations = 100000;
+
+TEST(SpscRing, CapacityIsPowerOfTwo)
+{
+	EXPECT_EQ(SpscRing<int>(1).Capacity(), 1);
+	EXPECT_EQ(SpscRing<int>(64).Capacity(), 64);
+	EXPECT_EQ(SpscRing<int>(65).Capacity(), 128);
+}
+
+TEST(SpscRing, TrivialSerial)
+{
+	SpscRing<int> q(64);
+	for (int iteration = 0; iteration != 16; ++iteration) {
+		EXPECT_TRUE(q.IsEmpty());
+		for (int i = 0; i != 64; ++i)
+			EXPECT_TRUE(q.TryPush(i));
+		EXPECT_EQ(q.Size(), 64);
+
+		// Full, so further pushes are refused
+		EXPECT_FALSE(q.TryPush(64));
+
+		int item = -1;
+		for (int i = 0; i != 64; ++i) {
+			EXPECT_TRUE(q.TryPop(item));
+			EXPECT_EQ(item, i);
+		}
+		EXPECT_FALSE(q.TryPop(item));
+		EXPECT_TRUE(q.IsEmpty());
+	}
+}
+
+TEST(SpscRing, BulkWrapsAround)
+{
+	SpscRing<int> q(8);
+	std::vector<int> source = {0, 1, 2, 3, 4, 5};
+	std::vector<int> target(8);
+
+	for (int iteration = 0; iteration != 16; ++iteration) {
+		EXPECT_EQ(q.TryPushBulk(source.data(), source.size()), 6);
+		EXPECT_EQ(q.PopBulk(target.data(), 4), 4);
+		for (int i = 0; i != 4; ++i)
+			EXPECT_EQ(target[i], i);
+		EXPECT_EQ(q.PopBulk(target.data(), target.size()), 2);
+		EXPECT_EQ(target[0], 4);
+		EXPECT_EQ(target[1], 5);
+	}
+
+	// Only the free space is filled
+	EXPECT_EQ(q.TryPushBulk(source.data(), source.size()), 6);
+	EXPECT_EQ(q.TryPushBulk(source.data(), source.size()), 2);
+	EXPECT_EQ(q.Size(), 8);
+}
+
+TEST(SpscRing, ProducerConsumer)
+{
+	SpscRing<int> q(128);
+
+	auto producer = std::thread([&q]() {
+		for (int i = 0; i != iterations; ++i)
+			while (!q.TryPush(i))
+				std::this_thread::yield();
+	});
+
+	std::vector<int> got(32);
+	int expected = 0;
+	while (expected != iterations) {
+		const auto n = q.PopBulk(got.data(), got.size());
+		if (!n) {
+			std::this_thread::yield();
+			continue;
+		}
+		for (size_t i = 0; i != n; ++i)
+			EXPECT_EQ(got[i], expected++);
+	}
+	producer.join();
+	EXPECT_TRUE(q.IsEmpty());
+}
+
+} // namespace